@@ -2908,4 +2908,5 @@
  *
  */
 #define DEBUG_IO PD0
-#define DEBUG_ISR_CPU_USAGE
\ No newline at end of file
+#define DEBUG_ISR_CPU_USAGE
+//#define DEBUG_STEP_JITTER   // Per axis step timing error, shown by M593 I
\ No newline at end of file
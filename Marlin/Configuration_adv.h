@@ -1873,6 +1873,7 @@
 #if ENABLED(LIN_ADVANCE)
   //#define EXTRA_LIN_ADVANCE_K // Enable for second linear advance constants
   #define LIN_ADVANCE_K 0.02    // Unit: mm compression per 1mm/s extruder speed
+  #define LIN_ADVANCE_SMOOTH_TIME 0.04 // (s) The advance follows the E speed averaged over this window. Set with M900 W.
   //#define LA_DEBUG            // If enabled, this will generate debug information output over USB.
   #define EXPERIMENTAL_SCURVE // Enable this option to permit S-Curve Acceleration
 #endif
@@ -2127,6 +2128,35 @@
 
 #define AXIS_SIZE 4
 #define SHAPED_WAITING_MIN_TIME 20
+// Each time the shaper runs dry while gcode is still coming in, its delivery window (ms)
+// grows by SHAPED_WAITING_STEP_TIME up to SHAPED_WAITING_MAX_TIME, and shrinks back while the flow keeps up.
+#define SHAPED_WAITING_MAX_TIME 60
+#define SHAPED_WAITING_STEP_TIME 10
+// Blocks arriving slower than they print are stretched up to this ratio to keep the shaper fed
+#define SHAPED_SLOWDOWN_MAX_RATIO 2
+// A longer gap (ms) between two blocks is idle time, not slow gcode
+#define SHAPED_ARRIVAL_IDLE_TIME 200
+
+// Gcode streamed from the HMI is kept in a line indexed ring of this many bytes.
+// More bytes give the HMI more slack when the print is made of tiny segments.
+#define HMI_GCODE_BUFFER_SIZE (1024*4)
+
+// Accept heatshrink compressed gcode packets from the HMI, negotiated by
+// PRINTER_ID_SET_GCODE_ENCODING. Old HMI firmware keeps sending plain text.
+#define HMI_GCODE_COMPRESSION
+// Accept MeatPack nibble packed gcode packets from the HMI, negotiated the same way
+#define HMI_GCODE_MEATPACK
+// Accept G0/G1 as binary records mixed with the text lines, they skip the gcode parser
+#define HMI_GCODE_MOTION
+// Turn the plain G0/G1 text lines into the same records as they arrive, so the
+// gcode ring holds them pre-parsed. Requires HMI_GCODE_MOTION.
+// Off by default: it is not negotiated and rewrites the text of every HMI, and
+// a G0/G1 shorter than a 24 byte record takes more of the ring. Turn it on
+// after a print on the machine shows no change in moves and no ring starving
+// (M2000 S18) with the HMI firmware in use.
+//#define HMI_GCODE_PREPARSE
+// Lines the gcode ring holds, HMI_GCODE_BUFFER_SIZE / 8 when not set
+//#define HMI_GCODE_LINE_COUNT 512
 
 // Transmission to Host Buffer Size
 // To save 386 bytes of PROGMEM (and TX_BUFFER_SIZE+3 bytes of RAM) set to 0.
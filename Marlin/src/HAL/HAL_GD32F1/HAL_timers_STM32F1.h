@@ -85,6 +85,14 @@ timer_dev* get_timer_dev(int number);
 
 #define HAL_timer_get_count(timer_num) timer_get_count(TIMER_DEV(timer_num))
 
+/**
+ * Only X (PB10) and Z (PE11) step pins of this board sit on a timer output, Y, E and X2 are
+ * plain GPIOs, so every axis is stepped from the STEP_TIMER ISR. The DWT cycle counter, enabled
+ * by calibrate_delay_loop(), is a free running clock to measure the real pulse timing against.
+ */
+#define HAL_CYCLES_PER_US ((F_CPU) / 1000000UL)
+#define HAL_cycle_count() (*(volatile uint32_t *)0xE0001004)
+
 // TODO change this
 
 #define HAL_TEMP_TIMER_ISR() extern "C" void tempTC_Handler(void)
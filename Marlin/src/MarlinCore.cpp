@@ -1741,7 +1741,13 @@ void marlin_loop() {
     if (system_service.get_status() >= SYSTEM_STATUE_PAUSING && system_service.get_status() <= SYSTEM_STATUE_STOPPED) {
       while(!queue.ring_buffer.empty()) {
         GCodeQueue::CommandLine &command = queue.ring_buffer.peek_next_command();
-        LOG_I("Clear GCodeQueue: %s\r\n", command.buffer);
+        if (command.buffer[0] == GCODE_MOTION_MARKER) {
+          // A binary motion record, not a string
+          LOG_I("Clear GCodeQueue: motion record, line: %u\r\n", command.lines);
+        }
+        else {
+          LOG_I("Clear GCodeQueue: %s\r\n", command.buffer);
+        }
         queue.ring_buffer.advance_pos(queue.ring_buffer.index_r, -1);
       }
     }
@@ -118,6 +118,8 @@
       idex_set_parked(true);
       set_duplication_enabled(false);
 
+      axisManager.input_shaper_select(axisManager.input_shaper_tool_profile());
+
       #ifdef EVENT_GCODE_IDEX_AFTER_MODECHANGE
         gcode.process_subcommands_now_P(PSTR(EVENT_GCODE_IDEX_AFTER_MODECHANGE));
       #endif
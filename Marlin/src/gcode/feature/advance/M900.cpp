@@ -39,6 +39,7 @@
  *  K<factor>   Set current advance K factor (Slot 0).
  *  L<factor>   Set secondary advance K factor (Slot 1). Requires EXTRA_LIN_ADVANCE_K.
  *  S<0/1>      Activate slot 0 or 1. Requires EXTRA_LIN_ADVANCE_K.
+ *  W<seconds>  Set the window the advance is smoothed over (0-0.2)
  */
 void GcodeSuite::M900() {
 
@@ -110,6 +111,16 @@ void GcodeSuite::M900() {
     kref = newK;
   }
 
+  if (parser.seenval('W')) {
+    const float W = parser.value_float();
+    if (!WITHIN(W, 0, 0.2f))
+      echo_value_oor('W', false);
+    else if (W != planner.extruder_advance_smooth[tool_index]) {
+      planner.synchronize();
+      planner.extruder_advance_smooth[tool_index] = W;
+    }
+  }
+
   if (!parser.seen_any()) {
 
     #if ENABLED(EXTRA_LIN_ADVANCE_K)
@@ -129,13 +140,18 @@ void GcodeSuite::M900() {
 
       SERIAL_ECHO_START();
       #if EXTRUDERS < 2
-        SERIAL_ECHOLNPAIR("Advance K=", planner.extruder_advance_K[0]);
+        SERIAL_ECHOLNPAIR("Advance K=", planner.extruder_advance_K[0], " W=", planner.extruder_advance_smooth[0]);
       #else
         SERIAL_ECHOPGM("Advance K");
         LOOP_L_N(i, EXTRUDERS) {
           SERIAL_CHAR(' ', '0' + i, ':');
           SERIAL_DECIMAL(planner.extruder_advance_K[i]);
         }
+        SERIAL_ECHOPGM(" W");
+        LOOP_L_N(i, EXTRUDERS) {
+          SERIAL_CHAR(' ', '0' + i, ':');
+          SERIAL_DECIMAL(planner.extruder_advance_smooth[i]);
+        }
         SERIAL_EOL();
       #endif
 
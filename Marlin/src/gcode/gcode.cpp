@@ -209,6 +209,60 @@ void GcodeSuite::get_destination_from_command() {
   #endif
 }
 
+#if ENABLED(HMI_GCODE_MOTION)
+
+  /**
+   * Set XYZE destination and feedrate from a binary motion record,
+   * the same way get_destination_from_command() does for the text
+   */
+  void GcodeSuite::get_destination_from_motion(const gcode_motion_t &motion) {
+    const float value[] = { motion.x, motion.y, motion.z };
+
+    #if ENABLED(CANCEL_OBJECTS)
+      const bool &skip_move = cancelable.skipping;
+    #else
+      constexpr bool skip_move = false;
+    #endif
+
+    LOOP_LINEAR_AXES(i) {
+      if (TEST(motion.flags, i)) {
+        const float v = parser.axis_value_to_mm((AxisEnum)i, value[i]);
+        if (skip_move)
+          destination[i] = current_position[i];
+        else
+          destination[i] = axis_is_relative(AxisEnum(i)) ? current_position[i] + v : LOGICAL_TO_NATIVE(v, i);
+        if (system_service.get_status() == SYSTEM_STATUE_PRINTING) {
+          destination[i] += print_control.xyz_offset[i];
+        }
+      }
+      else
+        destination[i] = current_position[i];
+    }
+
+    if (motion.flags & GCODE_MOTION_E) {
+      const float v = parser.axis_value_to_mm(E_AXIS, motion.e);
+      destination.e = axis_is_relative(E_AXIS) ? current_position.e + v : v;
+    }
+    else
+      destination.e = current_position.e;
+
+    #if ENABLED(POWER_LOSS_RECOVERY) && !PIN_EXISTS(POWER_LOSS)
+      // Only update power loss recovery on moves with E
+      if (recovery.enabled && IS_SD_PRINTING() && (motion.flags & GCODE_MOTION_E) && (motion.flags & (GCODE_MOTION_X | GCODE_MOTION_Y)))
+        recovery.save();
+    #endif
+
+    if ((motion.flags & GCODE_MOTION_F) && motion.f > 0)
+      feedrate_mm_s = MMM_TO_MMS(parser.linear_value_to_mm(motion.f));
+
+    #if ENABLED(PRINTCOUNTER)
+      if (!DEBUGGING(DRYRUN) && !skip_move)
+        print_job_timer.incFilamentUsed(destination.e - current_position.e);
+    #endif
+  }
+
+#endif
+
 /**
  * Dwell waits immediately. It does not synchronize. Use M400 instead of G4
  */
@@ -1071,6 +1125,18 @@ void GcodeSuite::process_next_command() {
 
   TERN_(POWER_LOSS_RECOVERY, recovery.queue_index_r = queue.ring_buffer.index_r);
 
+  #if ENABLED(HMI_GCODE_MOTION)
+    // A binary G0/G1 from the HMI, nothing to parse
+    if (command.buffer[0] == GCODE_MOTION_MARKER) {
+      gcode_motion_t motion;
+      memcpy(&motion, command.buffer, sizeof(motion));  // the buffer may be unaligned for float loads
+      KEEPALIVE_STATE(IN_HANDLER);
+      G0_G1(motion);
+      queue.ok_to_send();
+      return;
+    }
+  #endif
+
   if (DEBUGGING(ECHO)) {
     SERIAL_ECHO_START();
     SERIAL_ECHOLN(command.buffer);
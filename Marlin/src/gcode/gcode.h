@@ -314,6 +314,10 @@
   #define HAS_FAST_MOVES 1
 #endif
 
+#if ENABLED(HMI_GCODE_MOTION)
+  struct gcode_motion_t;
+#endif
+
 enum AxisRelative : uint8_t {
   LOGICAL_AXIS_LIST(REL_E, REL_X, REL_Y, REL_Z, REL_I, REL_J, REL_K)
   #if HAS_EXTRUDERS
@@ -383,6 +387,9 @@ public:
   static int8_t get_target_extruder_from_command();
   static int8_t get_target_e_stepper_from_command();
   static void get_destination_from_command();
+  #if ENABLED(HMI_GCODE_MOTION)
+    static void get_destination_from_motion(const gcode_motion_t &motion);
+  #endif
 
   static void process_parsed_command(const bool no_ok=false);
   static void process_next_command();
@@ -439,6 +446,9 @@ private:
   #endif
 
   static void G0_G1(TERN_(HAS_FAST_MOVES, const bool fast_move=false));
+  #if ENABLED(HMI_GCODE_MOTION)
+    static void G0_G1(const gcode_motion_t &motion);
+  #endif
 
   #if ENABLED(ARC_SUPPORT)
     static void G2_G3(const bool clockwise);
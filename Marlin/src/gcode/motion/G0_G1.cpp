@@ -45,21 +45,16 @@ bool x_first_move = false;
 #endif
 
 /**
- * G0, G1: Coordinated movement of X Y Z E axes
+ * The move of a G0/G1, given as text or as a motion record of the HMI.
+ * get_destination() sets the destination and feedrate, axes has a bit per
+ * linear axis the command names and has_e tells if it names E.
  */
-void GcodeSuite::G0_G1(TERN_(HAS_FAST_MOVES, const bool fast_move/*=false*/)) {
+template <typename GET_DESTINATION>
+static void G0_G1_move(const bool fast_move, const linear_axis_bits_t axes, const bool has_e, GET_DESTINATION get_destination) {
 
   if (IsRunning()
     #if ENABLED(NO_MOTION_BEFORE_HOMING)
-      && !homing_needed_error(
-        LINEAR_AXIS_GANG(
-            (parser.seen_test('X') ? _BV(X_AXIS) : 0),
-          | (parser.seen_test('Y') ? _BV(Y_AXIS) : 0),
-          | (parser.seen_test('Z') ? _BV(Z_AXIS) : 0),
-          | (parser.seen_test(AXIS4_NAME) ? _BV(I_AXIS) : 0),
-          | (parser.seen_test(AXIS5_NAME) ? _BV(J_AXIS) : 0),
-          | (parser.seen_test(AXIS6_NAME) ? _BV(K_AXIS) : 0))
-      )
+      && !homing_needed_error(axes)
     #endif
   ) {
     TERN_(FULL_REPORT_TO_HOST_FEATURE, set_and_report_grblstate(M_RUNNING));
@@ -79,7 +74,7 @@ void GcodeSuite::G0_G1(TERN_(HAS_FAST_MOVES, const bool fast_move/*=false*/)) {
      *
      */
     float bf_x = destination[X_AXIS];
-    get_destination_from_command();                 // Get X Y Z E F (and set cutter power)
+    get_destination();                              // Get X Y Z E F (and set cutter power)
     if (bf_x != destination[X_AXIS] && print_control.first_start_gcode) {
       print_control.first_start_gcode = false;
       x_first_move = true;
@@ -100,9 +95,7 @@ void GcodeSuite::G0_G1(TERN_(HAS_FAST_MOVES, const bool fast_move/*=false*/)) {
 
       if (MIN_AUTORETRACT <= MAX_AUTORETRACT) {
         // When M209 Autoretract is enabled, convert E-only moves to firmware retract/recover moves
-        if (fwretract.autoretract_enabled && parser.seen_test('E')
-          && !parser.seen(LINEAR_AXIS_GANG("X", "Y", "Z", AXIS4_STR, AXIS5_STR, AXIS6_STR))
-        ) {
+        if (fwretract.autoretract_enabled && has_e && !axes) {
           const float echange = destination.e - current_position.e;
           // Is this a retract or recover move?
           if (WITHIN(ABS(echange), MIN_AUTORETRACT, MAX_AUTORETRACT) && fwretract.retracted[active_extruder] == (echange > 0.0)) {
@@ -128,9 +121,9 @@ void GcodeSuite::G0_G1(TERN_(HAS_FAST_MOVES, const bool fast_move/*=false*/)) {
 
     #if ENABLED(NANODLP_Z_SYNC)
       #if ENABLED(NANODLP_ALL_AXIS)
-        #define _MOVE_SYNC parser.seenval('X') || parser.seenval('Y') || parser.seenval('Z')  // For any move wait and output sync message
+        #define _MOVE_SYNC (axes & (_BV(X_AXIS) | _BV(Y_AXIS) | _BV(Z_AXIS)))  // For any move wait and output sync message
       #else
-        #define _MOVE_SYNC parser.seenval('Z')  // Only for Z move
+        #define _MOVE_SYNC TEST(axes, Z_AXIS)  // Only for Z move
       #endif
       if (_MOVE_SYNC) {
         planner.synchronize();
@@ -142,3 +135,41 @@ void GcodeSuite::G0_G1(TERN_(HAS_FAST_MOVES, const bool fast_move/*=false*/)) {
     #endif
   }
 }
+
+/**
+ * G0, G1: Coordinated movement of X Y Z E axes
+ */
+void GcodeSuite::G0_G1(TERN_(HAS_FAST_MOVES, const bool fast_move/*=false*/)) {
+  G0_G1_move(TERN0(HAS_FAST_MOVES, fast_move),
+    LINEAR_AXIS_GANG(
+        (parser.seen_test('X') ? _BV(X_AXIS) : 0),
+      | (parser.seen_test('Y') ? _BV(Y_AXIS) : 0),
+      | (parser.seen_test('Z') ? _BV(Z_AXIS) : 0),
+      | (parser.seen_test(AXIS4_NAME) ? _BV(I_AXIS) : 0),
+      | (parser.seen_test(AXIS5_NAME) ? _BV(J_AXIS) : 0),
+      | (parser.seen_test(AXIS6_NAME) ? _BV(K_AXIS) : 0)),
+    parser.seen_test('E'),
+    [] { get_destination_from_command(); }
+  );
+}
+
+#if ENABLED(HMI_GCODE_MOTION)
+
+  #if LINEAR_AXES > 3
+    #error "HMI_GCODE_MOTION records only carry X, Y and Z."
+  #endif
+
+  /**
+   * G0, G1 from a binary motion record of the HMI
+   */
+  void GcodeSuite::G0_G1(const gcode_motion_t &motion) {
+    static_assert(GCODE_MOTION_X == _BV(X_AXIS) && GCODE_MOTION_Y == _BV(Y_AXIS) && GCODE_MOTION_Z == _BV(Z_AXIS),
+                  "The XYZ flags of a motion record must be the axis bits.");
+    G0_G1_move(motion.flags & GCODE_MOTION_G0,
+      motion.flags & (GCODE_MOTION_X | GCODE_MOTION_Y | GCODE_MOTION_Z),
+      motion.flags & GCODE_MOTION_E,
+      [&motion] { get_destination_from_motion(motion); }
+    );
+  }
+
+#endif
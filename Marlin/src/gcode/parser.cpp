@@ -86,6 +86,80 @@ void GCodeParser::reset() {
   #endif
 }
 
+/**
+ * Slicers write values with a few decimals. Their digits make an integer
+ * that is exact in a float, and one division by an exact power of ten then
+ * rounds correctly, the same as strtof. Longer values fall back to strtof.
+ */
+#define DECIMAL_MAX_MANTISSA (1UL << 24)
+
+static const float decimal_pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+float GCodeParser::parse_float(char * const p) {
+  const char *s = p;
+  const bool neg = (*s == '-');
+  if (neg || *s == '+') s++;
+
+  uint32_t mantissa = 0;
+  uint8_t decimals = 0;
+  bool point = false;
+  for (;; s++) {
+    const char c = *s;
+    if (NUMERIC(c)) {
+      mantissa = mantissa * 10 + (c - '0');
+      if (point) decimals++;
+      if (mantissa >= DECIMAL_MAX_MANTISSA || decimals >= COUNT(decimal_pow10)) break;
+    }
+    else if (c == '.' && !point)
+      point = true;
+    else {
+      const float f = decimals ? mantissa / decimal_pow10[decimals] : (float)mantissa;
+      return neg ? -f : f;
+    }
+  }
+
+  // Too many digits, cut at 'E' so it isn't read as an exponent
+  char *e = p;
+  for (;;) {
+    const char c = *e;
+    if (c == '\0' || c == ' ') break;
+    if (c == 'E' || c == 'e') {
+      *e = '\0';
+      const float ret = strtof(p, nullptr);
+      *e = c;
+      return ret;
+    }
+    ++e;
+  }
+  return strtof(p, nullptr);
+}
+
+// Up to 9 digits fit a uint32_t, strtol/strtoul handle the rest and clamp
+int32_t GCodeParser::parse_long(const char * const p) {
+  const char *s = p;
+  const bool neg = (*s == '-');
+  if (neg || *s == '+') s++;
+
+  uint32_t v = 0;
+  for (uint8_t n = 0; NUMERIC(*s); s++, n++) {
+    if (n == 9) return strtol(p, nullptr, 10);
+    v = v * 10 + (*s - '0');
+  }
+  return neg ? -(int32_t)v : (int32_t)v;
+}
+
+uint32_t GCodeParser::parse_ulong(const char * const p) {
+  const char *s = p;
+  if (*s == '+') s++;
+
+  uint32_t v = 0;
+  for (uint8_t n = 0; NUMERIC(*s); s++, n++) {
+    if (n == 9) return strtoul(p, nullptr, 10);
+    v = v * 10 + (*s - '0');
+  }
+  return (*s == '-') ? strtoul(p, nullptr, 10) : v;
+}
+
 #if ENABLED(GCODE_QUOTED_STRINGS)
 
   // Pass the address after the first quote (if any)
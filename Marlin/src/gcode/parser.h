@@ -256,29 +256,17 @@ public:
   // The value as a string
   static inline char* value_string() { return value_ptr; }
 
-  // Float removes 'E' to prevent scientific notation interpretation
-  static inline float value_float() {
-    if (value_ptr) {
-      char *e = value_ptr;
-      for (;;) {
-        const char c = *e;
-        if (c == '\0' || c == ' ') break;
-        if (c == 'E' || c == 'e') {
-          *e = '\0';
-          const float ret = strtof(value_ptr, nullptr);
-          *e = c;
-          return ret;
-        }
-        ++e;
-      }
-      return strtof(value_ptr, nullptr);
-    }
-    return 0;
-  }
+  // Decimal text to number without strtof/strtol for the usual short values
+  static float parse_float(char * const p);
+  static int32_t parse_long(const char * const p);
+  static uint32_t parse_ulong(const char * const p);
+
+  // Float ignores 'E' to prevent scientific notation interpretation
+  static inline float value_float() { return value_ptr ? parse_float(value_ptr) : 0; }
 
   // Code value as a long or ulong
-  static inline int32_t value_long() { return value_ptr ? strtol(value_ptr, nullptr, 10) : 0L; }
-  static inline uint32_t value_ulong() { return value_ptr ? strtoul(value_ptr, nullptr, 10) : 0UL; }
+  static inline int32_t value_long() { return value_ptr ? parse_long(value_ptr) : 0L; }
+  static inline uint32_t value_ulong() { return value_ptr ? parse_ulong(value_ptr) : 0UL; }
 
   // Code value for use as time
   static inline millis_t value_millis() { return value_ulong(); }
@@ -22,6 +22,7 @@
 #include "AxisManager.h"
 #include "shaper/MoveQueue.h"
 #include "../gcode/gcode.h"
+#include "motion.h"
 
 #include "../../../snapmaker/J1/common_type.h"
 
@@ -40,56 +41,165 @@ static const char *dbg_name[SHAPER_DBG_MAX] = {
   "NOT_ENOUGH_FUNC_LIST_RESC",
   "CALC_STEP_TIMEOUT_COUNT",
   "CALC_STEP_TIME",
-  "ABORT_END_BLOCK"
+  "ABORT_END_BLOCK",
+  "STEP_UNDERRUN",
+  "STEPS_GENERATED",
+  "DEFERRED_DELIVERY",
+  "STARVED_STOPS",
+  "FEED_SLOWDOWN",
+  "STEP_ISR",
+  "BATCHED_STEPS",
+  "BATCH_MAX_ERROR_US",
+  "E_PEAK_RATE"
 };
 
 
 void AxisManager::input_shaper_reset() {
 
-  AxisInputShaper::axis_input_shaper_x.type = (InputShaperType)DEFAULT_IS_TYPE;
-  AxisInputShaper::axis_input_shaper_x.frequency = DEFAULT_IS_FREQ;
-  AxisInputShaper::axis_input_shaper_x.zeta = DEFAULT_IS_DAMP;
+  for (int i = 0; i < INPUT_SHAPER_PROFILE_COUNT; i++) {
+    for (int axis = X_AXIS; axis <= Y_AXIS; axis++) {
+      shaper_profiles[i][axis].type = DEFAULT_IS_TYPE;
+      shaper_profiles[i][axis].freq = DEFAULT_IS_FREQ;
+      shaper_profiles[i][axis].dampe = DEFAULT_IS_DAMP;
+    }
+  }
 
-  AxisInputShaper::axis_input_shaper_y.type = (InputShaperType)DEFAULT_IS_TYPE;
-  AxisInputShaper::axis_input_shaper_y.frequency = DEFAULT_IS_FREQ;
-  AxisInputShaper::axis_input_shaper_y.zeta = DEFAULT_IS_DAMP;
+  input_shaper_load_profile();
+
+}
+
+// Copy the active profile into the shapers, they take it on the next initAxisShaper()
+void AxisManager::input_shaper_load_profile() {
+
+  input_shaper_profile_t *profile = shaper_profiles[shaper_profile];
+
+  AxisInputShaper::axis_input_shaper_x.type = (InputShaperType)profile[X_AXIS].type;
+  AxisInputShaper::axis_input_shaper_x.frequency = profile[X_AXIS].freq;
+  AxisInputShaper::axis_input_shaper_x.zeta = profile[X_AXIS].dampe;
+
+  AxisInputShaper::axis_input_shaper_y.type = (InputShaperType)profile[Y_AXIS].type;
+  AxisInputShaper::axis_input_shaper_y.frequency = profile[Y_AXIS].freq;
+  AxisInputShaper::axis_input_shaper_y.zeta = profile[Y_AXIS].dampe;
 
 }
 
 ErrCode AxisManager::input_shaper_set(int axis, int type, float freq, float dampe)  {
+  return input_shaper_set_profile(shaper_profile, axis, type, freq, dampe);
+}
 
-  if (axis != X_AXIS && axis != Y_AXIS) return E_PARAM;
+ErrCode AxisManager::input_shaper_get(int axis, int &type, float &freq, float &dampe) {
+  return input_shaper_get_profile(shaper_profile, axis, type, freq, dampe);
+}
+
+ErrCode AxisManager::input_shaper_set_profile(uint8_t profile, int axis, int type, float freq, float dampe)  {
 
-  AxisInputShaper* axis_input_shaper = axisManager.axis[axis].axis_input_shaper;
-  if (freq != axis_input_shaper->frequency || dampe != axis_input_shaper->zeta || type != (int)axis_input_shaper->type) {
-    axis_input_shaper->setConfig(type, freq, dampe);
-    planner.synchronize();
-    axisManager.initAxisShaper();
-    axisManager.abort();
+  if (axis != X_AXIS && axis != Y_AXIS) return E_PARAM;
+  if (profile >= INPUT_SHAPER_PROFILE_COUNT) return E_PARAM;
+
+  input_shaper_profile_t &p = shaper_profiles[profile][axis];
+  p.type = type;
+  p.freq = freq;
+  p.dampe = dampe;
+
+  // Other profiles are only stored, they apply when their tool is selected
+  if (profile == shaper_profile) {
+    AxisInputShaper* axis_input_shaper = axisManager.axis[axis].axis_input_shaper;
+    if (freq != axis_input_shaper->frequency || dampe != axis_input_shaper->zeta || type != (int)axis_input_shaper->type) {
+      axis_input_shaper->setConfig(type, freq, dampe);
+      planner.synchronize();
+      axisManager.initAxisShaper();
+      axisManager.abort();
+    }
   }
-  LOG_I("setting: axis: %d type: %s, frequency: %lf, zeta: %lf\n", axis, input_shaper_type_name[type], freq, dampe);
+  LOG_I("setting: profile: %d axis: %d type: %s, frequency: %lf, zeta: %lf\n", profile, axis, input_shaper_type_name[type], freq, dampe);
 
   return E_SUCCESS;
 }
 
-ErrCode AxisManager::input_shaper_get(int axis, int &type, float &freq, float &dampe) {
+ErrCode AxisManager::input_shaper_get_profile(uint8_t profile, int axis, int &type, float &freq, float &dampe) {
 
   if (axis != X_AXIS && axis != Y_AXIS) return E_PARAM;
+  if (profile >= INPUT_SHAPER_PROFILE_COUNT) return E_PARAM;
 
-  AxisInputShaper* axis_input_shaper = axisManager.axis[axis].axis_input_shaper;
-  type = (int)axis_input_shaper->type;
-  freq = axis_input_shaper->frequency;
-  dampe = axis_input_shaper->zeta;
+  input_shaper_profile_t &p = shaper_profiles[profile][axis];
+  type = p.type;
+  freq = p.freq;
+  dampe = p.dampe;
   // LOG_I("getting: axis: %d type: %s, frequency: %lf, zeta: %lf\n", axis, input_shaper_type_name[type], freq, dampe);
 
   return E_SUCCESS;
 }
 
+/*
+ Switch to the profile of another tool, never waits for motion. The shapers
+ only change between moves: with the planner empty, as it is at a tool change
+ or M605, the switch happens at once, otherwise shaped_loop() makes it once
+ the queued moves are done. It is skipped when both profiles hold the same
+ settings.
+*/
+void AxisManager::input_shaper_select(uint8_t profile) {
+
+  if (profile >= INPUT_SHAPER_PROFILE_COUNT || profile == shaper_profile) return;
+
+  input_shaper_profile_t *from = shaper_profiles[shaper_profile];
+  input_shaper_profile_t *to = shaper_profiles[profile];
+  shaper_profile = profile;
+
+  bool changed = false;
+  for (int axis = X_AXIS; axis <= Y_AXIS; axis++) {
+    if (from[axis].type != to[axis].type || from[axis].freq != to[axis].freq || from[axis].dampe != to[axis].dampe) {
+      changed = true;
+    }
+  }
+  LOG_I("input shaper profile: %d, changed: %d\n", profile, changed);
+  if (!changed) return;
+
+  input_shaper_load_profile();
+  shaper_switch_pending = true;
+  if (!planner.has_blocks_queued()) input_shaper_switch();
+}
+
+// Restart the idle pipeline with the loaded profile. Nothing is queued, so the
+// abort is served here as shaped_loop() would, moves queued next are kept
+void AxisManager::input_shaper_switch() {
+  shaper_switch_pending = false;
+  initAxisShaper();
+  abort();
+  planner.clear_block_buffer();
+  req_abort = false;
+}
+
+uint8_t AxisManager::input_shaper_tool_profile() {
+  #if ENABLED(DUAL_X_CARRIAGE)
+    if (idex_is_duplicating()) return INPUT_SHAPER_PROFILE_DUP;
+  #endif
+  return active_extruder ? INPUT_SHAPER_PROFILE_T1 : INPUT_SHAPER_PROFILE_T0;
+}
+
 void AxisManager::show_debug_info() {
   LOG_I("debug info for input shaper:\n");
   for (int i = 0; i < SHAPER_DBG_MAX; i++) {
     LOG_I("[%s] = %d\n", dbg_name[i], counts[i]);
   }
+
+  const millis_t elapsed = millis() - debug_start_ms;
+  if (elapsed) {
+    LOG_I("steps generated per second: %d\n", (int)((uint64_t)counts[SHAPER_DBG_STEPS_GENERATED] * 1000 / elapsed));
+    LOG_I("step isr entries per second: %d\n", (int)((uint64_t)counts[SHAPER_DBG_STEP_ISR] * 1000 / elapsed));
+  }
+
+  for (int i = 0; i < AXIS_SIZE; i++) {
+    LOG_I("func params peak of axis %d: %d\n", i, axis[i].func_manager.max_size);
+  }
+  LOG_I("func params arena peak: %d/%d chunks of %d\n", FuncManager::chunk_peak, FUNC_PARAMS_CHUNK_COUNT, FUNC_PARAMS_CHUNK_SIZE);
+  #if ENABLED(DEBUG_STEP_JITTER)
+    for (int i = 0; i < AXIS_SIZE; i++) {
+      LOG_I("step jitter of axis %d: max %d us, mean %d us\n", i, step_jitter.max_us[i],
+            step_jitter.samples[i] ? (int)(step_jitter.sum_us[i] / step_jitter.samples[i]) : 0);
+    }
+  #endif
+  LOG_I("delivery window: %d ms, lookahead: %d ms, block arrival: %d us\n", (int)planner.shaped_window_time,
+        (int)planner.shaped_lookahead_time, (int)(planner.shaped_arrival_time * 1000));
 }
 
 
@@ -97,6 +207,14 @@ void AxisManager::reset_debug_info() {
   for (int i = 0; i < SHAPER_DBG_MAX; i++) {
     counts[i] = 0;
   }
+
+  for (int i = 0; i < AXIS_SIZE; i++) {
+    axis[i].func_manager.max_size = 0;
+  }
+  TERN_(DEBUG_STEP_JITTER, step_jitter.reset());
+  FuncManager::chunk_peak = FuncManager::chunk_used;
+  planner.shaped_window_time = SHAPED_WAITING_MIN_TIME;
+  debug_start_ms = millis();
 }
 
 void GcodeSuite::M593() {
@@ -115,6 +233,25 @@ void GcodeSuite::M593() {
     //     LOG_I("Send too many\n");
     //     return;
     // }
+
+    // M593 T<profile> stores the shaper of a tool that is not active
+    const uint8_t profile = parser.seenval('T') ? parser.value_byte() : axisManager.shaper_profile;
+    if (profile >= INPUT_SHAPER_PROFILE_COUNT) {
+        LOG_E("invalid profile: %d\n", profile);
+        return;
+    }
+    if (profile != axisManager.shaper_profile) {
+        bool x = parser.seen('X');
+        bool y = parser.seen('Y');
+        for (int i = X_AXIS; i <= Y_AXIS; i++) {
+            if ((i == X_AXIS && !x && y) || (i == Y_AXIS && !y && x)) continue;
+            int type; float frequency, zeta;
+            axisManager.input_shaper_get_profile(profile, i, type, frequency, zeta);
+            axisManager.input_shaper_set_profile(profile, i, parser.intval('P', type), parser.floatval('F', frequency), parser.floatval('D', zeta));
+        }
+        return;
+    }
+
     bool update = false;
     // if (parser.seen('P') || parser.seen('F') || parser.seen('D')) {
     //     update = true;
@@ -139,6 +276,7 @@ void GcodeSuite::M593() {
             axis_input_shaper->logParams();
         } else {
             axis_input_shaper->setConfig(type, frequency, zeta);
+            axisManager.shaper_profiles[profile][X_AXIS] = {type, frequency, zeta};
         }
     }
     if (y) {
@@ -154,6 +292,7 @@ void GcodeSuite::M593() {
             axis_input_shaper->logParams();
         } else {
             axis_input_shaper->setConfig(type, frequency, zeta);
+            axisManager.shaper_profiles[profile][Y_AXIS] = {type, frequency, zeta};
         }
     }
     LOG_I("update: %d\n", update);
@@ -226,6 +365,93 @@ float Axis::getCurrentSpeedMMs() {
 }
 
 #if ENABLED(LIN_ADVANCE)
+
+/*
+ Pressure advance on the shaped E path. The advance P = K * E speed of every
+ generated move is kept for one smoothing window W, and E follows
+
+   e(t) = nominal(t) + (1 / W) * integral of P over [t - W, t]
+
+ so a step of P at a junction turns into a ramp of its E speed over W, and
+ the advance goes back to zero once the motion has been at rest for W.
+*/
+#define ADVANCE_HISTORY_SIZE 32
+#define ADVANCE_HISTORY_MOD(n) ((n)&(ADVANCE_HISTORY_SIZE-1))
+#define ADVANCE_SMOOTH_MIN_TIME 1.0f    // ms
+#define ADVANCE_TIME_EPS 0.0001f        // ms
+
+typedef struct {
+  time_double_t start_t;
+  float t;
+  float p;      // advance at the start of the move, steps
+  float slope;  // steps per ms
+} advance_segment_t;
+
+static advance_segment_t advance_history[ADVANCE_HISTORY_SIZE];
+static uint8_t advance_history_tail, advance_history_head;
+
+void Axis::resetAdvanceHistory() {
+    advance_history_tail = 0;
+    advance_history_head = 0;
+}
+
+// The history is full. The two oldest entries the window has not reached yet
+// become one line of the same area, so the advance still integrates back to zero
+static void mergeAdvanceHistory() {
+    advance_segment_t *a = &advance_history[ADVANCE_HISTORY_MOD(advance_history_tail + 1)];
+    const advance_segment_t *b = &advance_history[ADVANCE_HISTORY_MOD(advance_history_tail + 2)];
+    const float area = (a->p + 0.5f * a->slope * a->t) * a->t + (b->p + 0.5f * b->slope * b->t) * b->t;
+    const float t = (b->start_t - a->start_t) + b->t;
+    a->slope = 2 * (area - a->p * t) / sq(t);
+    a->t = t;
+    for (uint8_t i = ADVANCE_HISTORY_MOD(advance_history_tail + 2); i != advance_history_head; i = ADVANCE_HISTORY_MOD(i + 1)) {
+        advance_history[i] = advance_history[ADVANCE_HISTORY_MOD(i + 1)];
+    }
+    advance_history_head = ADVANCE_HISTORY_MOD(advance_history_head - 1);
+}
+
+// Emit E from pos at speed over t ms, split where the speed changes sign. Returns the end position.
+float Axis::addEAxisFuncParams(int32_t origin, float pos, float speed, float accelerate, time_double_t start_t, float t) {
+    float split = t;
+    if (!IS_ZERO(accelerate)) {
+        const float zero_t = -speed / accelerate;
+        if (zero_t > ADVANCE_TIME_EPS && zero_t < t - ADVANCE_TIME_EPS) {
+            split = zero_t;
+        }
+    }
+
+    for (;;) {
+        const float a = 0.5f * accelerate;
+        const float end_pos = pos + (speed + a * split) * split;
+        const float dy = end_pos - pos;
+
+        int type;
+        if (IS_ZERO(dy)) {
+            type = 0;
+        } else {
+            type = dy > 0 ? 1 : -1;
+        }
+        func_manager.addFuncParamsExtend(origin, a, speed, pos, type, start_t + split, end_pos);
+
+        const float end_speed = speed + accelerate * split;
+        const int rate = (int)(_MAX(ABS(speed), ABS(end_speed)) * 1000);
+        if (rate > axisManager.counts[SHAPER_DBG_E_PEAK_RATE]) {
+            axisManager.counts[SHAPER_DBG_E_PEAK_RATE] = rate;
+        }
+
+        pos = end_pos;
+        if (split >= t) {
+            break;
+        }
+        start_t += split;
+        speed = end_speed;
+        t -= split;
+        split = t;
+    }
+
+    return pos;
+}
+
 FORCE_INLINE bool Axis::generateEAxisFuncParams(uint8_t block_index, uint8_t move_start, uint8_t move_end) {
     uint8_t move_index;
     if (generated_move_index == -1) {
@@ -233,89 +459,82 @@ FORCE_INLINE bool Axis::generateEAxisFuncParams(uint8_t block_index, uint8_t mov
     } else {
         move_index = moveQueue.nextMoveIndex(generated_move_index);
     }
-    float l_eda = 0.0;
+
+    block_t *block = &planner.block_buffer[block_index];
+    const float K = block->use_advance_lead ? planner.extruder_advance_K[block->extruder] * 1000 : 0;
+    const float window = _MAX(planner.extruder_advance_smooth[block->extruder] * 1000, ADVANCE_SMOOTH_MIN_TIME);
+    const float inv_window = 1.0f / window;
 
     while (move_index != moveQueue.nextMoveIndex(move_end)) {
         Move *move = &moveQueue.moves[move_index];
 
         if (IS_ZERO(move->t)) {
+          generated_move_index = move_index;
           move_index = moveQueue.nextMoveIndex(move_index);
           continue;
         }
 
-        // #define K (0.04)
-        float K = planner.block_buffer[block_index].use_advance_lead ? planner.extruder_advance_K[active_extruder] * 1000 : 0;
-        float delta_v = IS_ZERO(move->accelerate) ? 0 : K * move->accelerate;
-        float eda = delta_v * move->t * move->axis_r[axis];
-
-        // LOG_I("k: %lf, d_v: %lf, eda: %lf\n", K, delta_v, eda);
-
-        double a = 0.5f * move->accelerate * move->axis_r[axis];
-        double b, c, x2, y2, dx, dy;
-
-        if (delta_v < 0 && move->start_v + delta_v > 0 && move->end_v + delta_v < 0) {
-            float zero_t = ABS((move->start_v + delta_v) / move->accelerate);
-            float zero_pos = ((move->start_v + delta_v) * zero_t + 0.5f * move->accelerate * sq(zero_t)) * move->axis_r[axis];
-
-            y2 = move->start_pos_e + delta_e + zero_pos;
-            dy = zero_pos;
-            x2 = zero_t;
-            dx = zero_t;
+        // A move adds up to two functions for each window piece, one piece per
+        // kept move plus the gap before them. Go on with it on the next pass
+        // when the arena can't take them all.
+        const uint8_t kept = ADVANCE_HISTORY_MOD(advance_history_head - advance_history_tail);
+        if (func_manager.getFreeSize() < 2 * (kept + 2)) {
+            return false;
+        }
 
-            c = move->start_pos_e + delta_e;
-            b = dy / dx - a * x2;
+        const float r = move->axis_r[axis];
+        const float p_slope = K * r * move->accelerate;
 
-            int type;
-            if (IS_ZERO(dy)) {
-                type = 0;
-            } else {
-                type = dy > 0 ? 1 : -1;
+        // Keep this move's advance for the window
+        if (ADVANCE_HISTORY_MOD(advance_history_head + 1) == advance_history_tail) {
+            mergeAdvanceHistory();
+        }
+        advance_segment_t *seg = &advance_history[advance_history_head];
+        seg->start_t = move->start_t;
+        seg->t = move->t;
+        seg->p = K * r * move->start_v;
+        seg->slope = p_slope;
+        advance_history_head = ADVANCE_HISTORY_MOD(advance_history_head + 1);
+
+        float pos = move->start_pos_e + advance;
+        float t = 0;
+        while (t < move->t) {
+            // Find the advance at the far end of the window and how long it stays on that move
+            float lag_p = 0, lag_slope = 0, lag_t;
+            float o;
+            for (;;) {
+                seg = &advance_history[advance_history_tail];
+                o = (move->start_t - seg->start_t) + t - window;
+                if (o < seg->t - ADVANCE_TIME_EPS) {
+                    break;
+                }
+                advance_history_tail = ADVANCE_HISTORY_MOD(advance_history_tail + 1);
             }
-
-            time_double_t end_t = move->start_t + zero_t;
-            func_manager.addFuncParamsExtend(a, b, c, type, end_t, y2);
-
-            y2 = move->end_pos_e + delta_e + eda;
-            dy = move->end_pos_e - move->start_pos_e + eda - zero_pos;
-            x2 = move->t - zero_t;
-            dx = move->t - zero_t;
-
-            c = move->start_pos_e + delta_e + zero_pos;
-            b = dy / dx - a * x2;
-
-            if (IS_ZERO(dy)) {
-                type = 0;
+            if (o <= -ADVANCE_TIME_EPS) {
+                lag_t = -o;
             } else {
-                type = dy > 0 ? 1 : -1;
+                o = _MAX(o, 0.0f);
+                lag_p = seg->p + seg->slope * o;
+                lag_slope = seg->slope;
+                lag_t = seg->t - o;
             }
 
-            end_t = move->end_t;
-            func_manager.addFuncParamsExtend(a, b, c, type, end_t, y2);
-        } else {
-            y2 = move->end_pos_e + delta_e + eda;
-            dy = move->end_pos_e - move->start_pos_e + eda;
-            x2 = move->t;
-            dx = move->t;
-
-            c = move->start_pos_e + delta_e;
-            b = dy / dx - a * x2;
-
-            int type;
-            if (IS_ZERO(dy)) {
-                type = 0;
-            } else {
-                type = dy > 0 ? 1 : -1;
-            }
-            time_double_t end_t = move->end_t;
-            func_manager.addFuncParamsExtend(a, b, c, type, end_t, y2);
+            const float end_t = _MIN(move->t, t + lag_t);
+            const float v = move->start_v + move->accelerate * t;
+            const float speed = r * v + (K * r * v - lag_p) * inv_window;
+            const float accelerate = r * move->accelerate + (p_slope - lag_slope) * inv_window;
+            pos = addEAxisFuncParams(move->e_origin, pos, speed, accelerate, move->start_t + t, end_t - t);
+            t = end_t;
         }
 
-        delta_e += eda;
-        l_eda += eda;
+        const float move_advance = pos - move->end_pos_e;
+        block->steps.e += move_advance - advance;
+        advance = move_advance;
+        block->shaper_data.e_advance = advance;
+        generated_move_index = move_index;
         move_index = moveQueue.nextMoveIndex(move_index);
     }
 
-    planner.block_buffer[block_index].steps.e += l_eda;
     generated_move_index = move_end;
     return true;
 }
@@ -334,12 +553,18 @@ FORCE_INLINE bool Axis::generateAxisFuncParams(uint8_t move_start, uint8_t move_
     Move *move = &moveQueue.moves[move_index];
 
     if (IS_ZERO(move->t)) {
+      generated_move_index = move_index;
       move_index = moveQueue.nextMoveIndex(move_index);
       continue;
     }
 
+    // Stop before the write, the next pass goes on from generated_move_index
+    if (func_manager.getFreeSize() < 1) {
+      return false;
+    }
     generateLineFuncParams(move);
 
+    generated_move_index = move_index;
     move_index = moveQueue.nextMoveIndex(move_index);
   }
   generated_move_index = move_end;
@@ -403,9 +628,12 @@ bool AxisManager::generateAllAxisFuncParams(uint8_t block_index, block_t* block)
         }
     }
 
-    uint8_t new_move_tail = moveQueue.calculateMoveStart(move_start, axisManager.shaped_delta_window);
+    // The moves stay until every axis has generated the block
+    if (res) {
+        uint8_t new_move_tail = moveQueue.calculateMoveStart(move_start, axisManager.shaped_delta_window);
 
-    moveQueue.updateMoveTail(new_move_tail);
+        moveQueue.updateMoveTail(new_move_tail);
+    }
 
     axisManager.updateMinLastTime();
 
@@ -451,22 +679,13 @@ bool AxisManager::calcNextAxisStepper() {
         }
     }
 
-    bool is_consumed = true;
-
-    // Fine the closest time of all the axes
-    time_double_t min_print_time = 2000000000;
-    for (int i = 0; i < AXIS_SIZE; ++i) {
-        if (!axis[i].is_consumed) {
-            if (axis[i].print_time < min_print_time) {
-                min_print_time = axis[i].print_time;
-                print_axis = i;
-                is_consumed = false;
-            }
-        }
-    }
+    // Find the closest time of all the axes
+    time_double_t min_print_time;
+    const int8_t next_axis = nextStepAxis(axis, AXIS_SIZE, min_print_time);
 
-    // is_consumed == false, means that we has a steps need to output
-    if (!is_consumed) {
+    // An axis has a step that needs to output
+    if (next_axis >= 0) {
+        print_axis = next_axis;
         axis[print_axis].is_consumed = true;
 
         print_dir = axis[print_axis].dir;
@@ -480,7 +699,9 @@ bool AxisManager::calcNextAxisStepper() {
 
         print_time = min_print_time;
 
+        AXIS_STEPPER_BARRIER();
         axis_steppper_head = nextAxisStepper(axis_steppper_head);
+        counts[SHAPER_DBG_STEPS_GENERATED]++;
 
         return true;
     } else {
@@ -488,3 +709,23 @@ bool AxisManager::calcNextAxisStepper() {
     }
 }
 
+
+/*
+ Precompute step events until the ring is full, called from the marlin task.
+ The ISR is never masked: an event is written before the head store that
+ publishes it, and calc_busy keeps the ISR out of the calculation state while
+ the task is in it. The ISR only calculates a step itself when the ring ran
+ dry outside of a task calculation.
+*/
+void AxisManager::fillAxisSteppers() {
+    while (!req_abort && getAxisStepperFreeSize()) {
+        calc_busy = true;
+        AXIS_STEPPER_BARRIER();
+        const bool res = calcNextAxisStepper();
+        AXIS_STEPPER_BARRIER();
+        calc_busy = false;
+        if (!res) {
+            break;
+        }
+    }
+}
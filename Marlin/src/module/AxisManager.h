@@ -30,9 +30,47 @@
 
 #define T0_T1_AXIS_INDEX  (4)
 
-#define AXIS_STEPPER_SIZE 4
+// Step events are precomputed by the marlin task, the stepper ISR only pops them.
+// Must be a power of 2 and no more than 128
+#ifndef AXIS_STEPPER_SIZE
+  #define AXIS_STEPPER_SIZE 64
+#endif
 #define AXIS_STEPPER_MOD(n) ((n)&(AXIS_STEPPER_SIZE-1))
 
+// Step events the ISR computes itself when it picks up the first block
+#define AXIS_STEPPER_ISR_PREFILL 3
+
+// How soon (us) the ISR looks again at a dry ring while the task is computing the next step
+#define AXIS_STEPPER_RETRY_TIME 10
+
+// Orders the writes of a step event before the index store that publishes it
+#define AXIS_STEPPER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+// Step gaps longer than this (ms) are not taken into the per axis jitter statistics
+#define STEP_JITTER_MAX_GAP 10
+
+// At high step rates one ISR entry outputs up to SHAPER_STEP_BATCH_MAX steps of the same axis and
+// direction, as long as each of them is due within SHAPER_STEP_BATCH_TIME (ms) of the entry.
+// That time bounds how early a batched step is output. Set SHAPER_STEP_BATCH_MAX to 1 to disable.
+#ifndef SHAPER_STEP_BATCH_MAX
+  #define SHAPER_STEP_BATCH_MAX 2
+#endif
+#ifndef SHAPER_STEP_BATCH_TIME
+  #define SHAPER_STEP_BATCH_TIME 0.04f
+#endif
+
+// Input shaper profiles, one per tool plus one for duplication / mirror printing
+#define INPUT_SHAPER_PROFILE_T0     0
+#define INPUT_SHAPER_PROFILE_T1     1
+#define INPUT_SHAPER_PROFILE_DUP    2
+#define INPUT_SHAPER_PROFILE_COUNT  3
+
+typedef struct {
+  int type;
+  float freq;
+  float dampe;
+} input_shaper_profile_t;
+
 enum InputShaperDebugInfoType {
   SHAPER_DBG_EMPTY_MOVES_COUNT = 0,
   SHAPER_DBG_NO_STEPS,
@@ -41,6 +79,15 @@ enum InputShaperDebugInfoType {
   SHAPER_DBG_CALC_STEP_TIMEOUT_COUNT,
   SHAPER_DBG_CALC_STEP_TIME,
   SHAPER_DBG_ABORT_END_BLOCK,
+  SHAPER_DBG_STEP_UNDERRUN,
+  SHAPER_DBG_STEPS_GENERATED,
+  SHAPER_DBG_DEFERRED_DELIVERY,
+  SHAPER_DBG_STARVED_STOPS,
+  SHAPER_DBG_FEED_SLOWDOWN,
+  SHAPER_DBG_STEP_ISR,
+  SHAPER_DBG_BATCHED_STEPS,
+  SHAPER_DBG_BATCH_MAX_ERROR_US,
+  SHAPER_DBG_E_PEAK_RATE,
 
   SHAPER_DBG_MAX
 };
@@ -76,7 +123,8 @@ class Axis {
     time_double_t last_print_time = 0;
     bool time_interval_valid = false;
 
-    double delta_e = 0;
+    // Pressure advance at the end of the generated E, steps
+    float advance = 0;
 
   private:
     int8_t axis;
@@ -124,7 +172,12 @@ class Axis {
         dir = 0;
         is_get_next_step_null = false;
 
-        delta_e = 0;
+        advance = 0;
+        #if ENABLED(LIN_ADVANCE)
+          if (axis == E_AXIS) {
+              resetAdvanceHistory();
+          }
+        #endif
 
         if (axis_input_shaper != nullptr) {
             axis_input_shaper->reset();
@@ -166,13 +219,73 @@ class Axis {
 
     #if ENABLED(LIN_ADVANCE)
     FORCE_INLINE bool generateEAxisFuncParams(uint8_t block_index, uint8_t move_start, uint8_t move_end);
+    float addEAxisFuncParams(int32_t origin, float pos, float speed, float accelerate, time_double_t start_t, float t);
+    static void resetAdvanceHistory();
     #endif
 
 };
 
+/*
+ The scheduling core of calcNextAxisStepper(): the axis whose pending step is
+ due first, the lower axis on a tie, -1 when no axis has a pending step. It
+ only reads the axes, so the host test runs it against a reference schedule.
+*/
+FORCE_INLINE int8_t nextStepAxis(const Axis *axes, uint8_t count, time_double_t &print_time) {
+    int8_t next = -1;
+    for (uint8_t i = 0; i < count; ++i) {
+        if (!axes[i].is_consumed && (next < 0 || axes[i].print_time < print_time)) {
+            next = i;
+            print_time = axes[i].print_time;
+        }
+    }
+    return next;
+}
+
+#if ENABLED(DEBUG_STEP_JITTER)
+  // Real gap between two pulses of an axis against the gap of their print times
+  class StepJitter {
+    public:
+      uint32_t max_us[AXIS_SIZE];
+      uint32_t sum_us[AXIS_SIZE];
+      uint32_t samples[AXIS_SIZE];
+
+      void reset() {
+          for (int i = 0; i < AXIS_SIZE; i++) {
+              max_us[i] = 0;
+              sum_us[i] = 0;
+              samples[i] = 0;
+          }
+      }
+
+      // A pulse of axis i planned at time went out at the cycle count cycle
+      FORCE_INLINE void record(int8_t i, const time_double_t &time, uint32_t cycle) {
+          if (i < 0 || i >= AXIS_SIZE) {
+              return;
+          }
+          const float planned = time - last_time[i];
+          if (planned > 0 && planned < STEP_JITTER_MAX_GAP) {
+              const int32_t error_us = (int32_t)((cycle - last_cycle[i]) / HAL_CYCLES_PER_US) - (int32_t)LROUND(planned * 1000);
+              const uint32_t jitter_us = ABS(error_us);
+              if (jitter_us > max_us[i]) {
+                  max_us[i] = jitter_us;
+              }
+              sum_us[i] += jitter_us;
+              samples[i]++;
+          }
+          last_cycle[i] = cycle;
+          last_time[i] = time;
+      }
+
+    private:
+      uint32_t last_cycle[AXIS_SIZE];
+      time_double_t last_time[AXIS_SIZE];
+  };
+#endif
+
 class AxisManager {
   public:
     int counts[20] = {0};
+    millis_t debug_start_ms = 0;
     bool T0_T1_simultaneously_move_req = false;
     bool T0_T1_simultaneously_move = false;
     float T0_T1_target_pos;
@@ -187,6 +300,11 @@ class AxisManager {
     Axis axis[AXIS_SIZE];
     Axis axis_t0_t1;
 
+    input_shaper_profile_t shaper_profiles[INPUT_SHAPER_PROFILE_COUNT][2];
+    uint8_t shaper_profile = INPUT_SHAPER_PROFILE_T0;
+    // The shapers still run the previous profile until the queued moves are done
+    bool shaper_switch_pending = false;
+
     volatile bool req_abort;
 
     // MoveQueue
@@ -208,9 +326,23 @@ class AxisManager {
     int8_t print_dir = 0;
     int current_steps[AXIS_SIZE];
 
+    // Single producer, single consumer: the marlin task writes head, the ISR writes tail.
+    // The ISR only produces itself when the ring is dry and the task is not inside a
+    // calculation, calc_busy is set by the task while it is
     AxisStepper axis_steppers[AXIS_STEPPER_SIZE];
-    uint8_t axis_steppper_tail;
-    uint8_t axis_steppper_head;
+    volatile uint8_t axis_steppper_tail;
+    volatile uint8_t axis_steppper_head;
+    volatile bool calc_busy = false;
+
+    // Steps output by the current ISR entry, and how far ahead of their time
+    int8_t step_batch_axis = -1;
+    int8_t step_batch_dir = 0;
+    uint8_t step_batch_count = 0;
+    float step_batch_ahead = 0;
+
+    #if ENABLED(DEBUG_STEP_JITTER)
+      StepJitter step_jitter;
+    #endif
 
     FORCE_INLINE uint8_t getAxisStepperSize() {
         return AXIS_STEPPER_MOD(axis_steppper_head - axis_steppper_tail);
@@ -230,6 +362,12 @@ class AxisManager {
     void input_shaper_reset();
     ErrCode input_shaper_set(int axis, int type, float freq, float dampe);
     ErrCode input_shaper_get(int axis, int &type, float &freq, float &dampe);
+    ErrCode input_shaper_set_profile(uint8_t profile, int axis, int type, float freq, float dampe);
+    ErrCode input_shaper_get_profile(uint8_t profile, int axis, int &type, float &freq, float &dampe);
+    void input_shaper_load_profile();
+    void input_shaper_select(uint8_t profile);
+    void input_shaper_switch();
+    uint8_t input_shaper_tool_profile();
     void show_debug_info();
     void reset_debug_info();
 
@@ -296,6 +434,10 @@ class AxisManager {
 
         axis_steppper_tail = 0;
         axis_steppper_head = 0;
+
+        step_batch_axis = -1;
+        step_batch_count = 0;
+        step_batch_ahead = 0;
     }
 
     void abort() {
@@ -341,12 +483,13 @@ class AxisManager {
         return true;
     }
 
-    int addEmptyMove() {
+    // min_time: how long the stop must last at least, the advance window of E
+    int addEmptyMove(float min_time = 0) {
         if (!isShaped()) {
             return -1;
         }
         // LOG_I("shaped_delta_window: %lf\n", shaped_delta_window);
-        return moveQueue.addEmptyMove(shaped_delta_window + 0.001f);
+        return moveQueue.addEmptyMove(_MAX(shaped_delta_window, min_time) + 0.001f);
     }
 
     FORCE_INLINE bool getNextZeroAxisStepper(AxisStepper* axis_stepper) {
@@ -355,10 +498,22 @@ class AxisManager {
         }
 
         AxisStepper* current_stepper = &axis_steppers[axis_steppper_tail];
+        const float ahead = step_batch_ahead + current_stepper->delta_time;
 
         if (current_stepper->delta_time > 0.005) {
-            return false;
+            // Batch a following step of the same axis and direction if it is due soon enough
+            if (step_batch_count >= SHAPER_STEP_BATCH_MAX || current_stepper->axis != step_batch_axis
+                || current_stepper->dir != step_batch_dir || ahead > SHAPER_STEP_BATCH_TIME) {
+                return false;
+            }
+            step_batch_count++;
+            counts[SHAPER_DBG_BATCHED_STEPS]++;
+            const int ahead_us = ahead * 1000;
+            if (ahead_us > counts[SHAPER_DBG_BATCH_MAX_ERROR_US]) {
+                counts[SHAPER_DBG_BATCH_MAX_ERROR_US] = ahead_us;
+            }
         }
+        step_batch_ahead = ahead;
 
         axis_stepper->axis = current_stepper->axis;
         axis_stepper->dir = current_stepper->dir;
@@ -374,16 +529,28 @@ class AxisManager {
     };
 
     FORCE_INLINE bool getNextAxisStepper(AxisStepper* axis_stepper) {
-        if (getAxisStepperSize() == 0 && !calcNextAxisStepper()) {
-            return false;
+        if (getAxisStepperSize() == 0) {
+            // The task fell behind, calculate the step in the ISR. Not while the
+            // task is inside a calculation, the step it works on comes in a moment
+            if (calc_busy || !calcNextAxisStepper()) {
+                return false;
+            }
+            counts[SHAPER_DBG_STEP_UNDERRUN]++;
         }
 
         AxisStepper* current_stepper = &axis_steppers[axis_steppper_tail];
         axis_stepper->axis = current_stepper->axis;
         axis_stepper->dir = current_stepper->dir;
-        axis_stepper->delta_time = current_stepper->delta_time;
+        // Steps merged into the last ISR entry went out early, the wait is still measured from the entry
+        axis_stepper->delta_time = current_stepper->delta_time + step_batch_ahead;
         axis_stepper->print_time = current_stepper->print_time;
 
+        step_batch_axis = current_stepper->axis;
+        step_batch_dir = current_stepper->dir;
+        step_batch_count = 1;
+        step_batch_ahead = 0;
+        counts[SHAPER_DBG_STEP_ISR]++;
+
         if (axis_stepper->axis != T0_T1_AXIS_INDEX) {
             current_steps[axis_stepper->axis] += axis_stepper->dir;
         }
@@ -393,6 +560,8 @@ class AxisManager {
     };
 
     bool calcNextAxisStepper();
+
+    void fillAxisSteppers();
 };
 
 
@@ -140,6 +140,10 @@ volatile uint8_t Planner::block_buffer_head,    // Index of the next block to be
                  Planner::block_buffer_tail;    // Index of the busy block, if any
 uint16_t Planner::cleaning_buffer_counter;      // A counter to disable queuing of blocks
 uint8_t Planner::delay_before_delivering;       // This counter delays delivery of blocks when queue becomes empty to allow the opportunity of merging blocks
+float Planner::shaped_window_time = SHAPED_WAITING_MIN_TIME,
+      Planner::shaped_arrival_time,
+      Planner::shaped_lookahead_time;
+millis_t Planner::shaped_arrival_ms;
 // float Planner::flow_control_e_delta = 0.0;
 
 planner_settings_t Planner::settings;           // Initialized by settings.load()
@@ -236,7 +240,8 @@ float Planner::previous_nominal_speed_sqr;
 #endif
 
 #if ENABLED(LIN_ADVANCE)
-  float Planner::extruder_advance_K[EXTRUDERS]; // Initialized by settings.load()
+  float Planner::extruder_advance_K[EXTRUDERS], // Initialized by settings.load()
+        Planner::extruder_advance_smooth[EXTRUDERS];
 #endif
 
 #if HAS_POSITION_FLOAT
@@ -1305,6 +1310,11 @@ void Planner::shaped_loop() {
 
     const uint8_t nr_moves = movesplanned();
 
+    // A shaper profile switch waits for the moves of the previous profile
+    if (axisManager.shaper_switch_pending && !nr_moves) {
+      axisManager.input_shaper_switch();
+    }
+
     if (axisManager.req_abort) {
       axisManager.abort();
       clear_block_buffer();
@@ -1312,13 +1322,15 @@ void Planner::shaped_loop() {
       return;
     }
 
+    axisManager.fillAxisSteppers();
+
     if (!nr_moves) {
         return;
     }
 
     float remaining_consume_time = axisManager.getRemainingConsumeTime();
 
-    if (remaining_consume_time > SHAPED_WAITING_MIN_TIME) {
+    if (remaining_consume_time > shaped_window_time) {
       return;
     }
 
@@ -1362,7 +1374,14 @@ void Planner::shaped_loop() {
 
     float need_shaped_time = SHAPED_WAITING_MIN_TIME + axisManager.shaped_right_delta;
 
-    if (index != head_index && planed_time + remaining_consume_time < need_shaped_time) {
+    // Above the minimum window the planner still has time to settle more blocks, so only the settled
+    // ones are delivered. Unsettled blocks are taken, and a stop inserted, once the window has drained.
+    const bool short_of_time = index != head_index && planed_time + remaining_consume_time < need_shaped_time;
+
+    if (short_of_time && remaining_consume_time > SHAPED_WAITING_MIN_TIME) {
+        axisManager.counts[SHAPER_DBG_DEFERRED_DELIVERY]++;
+    }
+    else if (short_of_time) {
         while (index != head_index) {
             block = &block_buffer[index];
             if (!block->shaper_data.is_create_move) {
@@ -1395,11 +1414,24 @@ void Planner::shaped_loop() {
             if (index != head_index) {
               axisManager.counts[SHAPER_DBG_EMPTY_MOVES_COUNT]++;
             }
-            axisManager.addEmptyMove();
+            // Gcode is still coming in, so this stop is a starvation: widen the window
+            // to start the feed-forward slowdown earlier next time
+            if (millis() - shaped_arrival_ms < SHAPED_ARRIVAL_IDLE_TIME) {
+              axisManager.counts[SHAPER_DBG_STARVED_STOPS]++;
+              shaped_window_time = _MIN(shaped_window_time + SHAPED_WAITING_STEP_TIME, SHAPED_WAITING_MAX_TIME);
+            }
             block = &block_buffer[prev_block_index(index)];
-            block->shaper_data.last_print_time += axisManager.shaped_left_delta;
+            // The stop lasts until the pressure advance of E is back to zero
+            const float advance_time = TERN0(LIN_ADVANCE, extruder_advance_K[block->extruder] ? extruder_advance_smooth[block->extruder] * 1000 : 0);
+            axisManager.addEmptyMove(advance_time);
+            block->shaper_data.last_print_time += _MAX(axisManager.shaped_left_delta, advance_time);
         }
     }
+    else {
+        shaped_window_time -= (shaped_window_time - SHAPED_WAITING_MIN_TIME) * 0.015625f;
+    }
+
+    shaped_lookahead_time = planed_time + remaining_consume_time;
 
     block_buffer_planned = index;
 
@@ -2432,6 +2464,26 @@ bool Planner::_populate_block(block_t * const block, bool split_move,
         statistics_slowdown_cnt++;
       }
     }
+
+    // Gcode arriving slower than it prints drains the shaper. While the lookahead seen at the last
+    // delivery is short of the window, stretch the block toward the arrival interval so the motion
+    // slows down smoothly instead of being stopped by an empty move in shaped_loop().
+    const millis_t arrival_ms = millis();
+    const millis_t arrival_gap = arrival_ms - shaped_arrival_ms;
+    shaped_arrival_ms = arrival_ms;
+    if (arrival_gap < SHAPED_ARRIVAL_IDLE_TIME) {
+      shaped_arrival_time += ((float)arrival_gap - shaped_arrival_time) * 0.125f;
+      const int32_t arrival_us = LROUND(shaped_arrival_time * 1000);
+      const int32_t block_us = LROUND(1000000.0f / inverse_secs);
+      if (shaped_lookahead_time < shaped_window_time + axisManager.shaped_right_delta && arrival_us > block_us) {
+        const int32_t nst = _MIN(arrival_us, block_us * (SHAPED_SLOWDOWN_MAX_RATIO));
+        inverse_secs = 1000000.0f / nst;
+        #if defined(XY_FREQUENCY_LIMIT) || HAS_WIRED_LCD
+          segment_time_us = nst;
+        #endif
+        axisManager.counts[SHAPER_DBG_FEED_SLOWDOWN]++;
+      }
+    }
   #endif
 
   #if HAS_WIRED_LCD
@@ -2608,7 +2660,7 @@ bool Planner::_populate_block(block_t * const block, bool split_move,
        * de > 0             : Extruder is running forward (e.g., for "Wipe while retracting" (Slic3r) or "Combing" (Cura) moves)
        */
       block->use_advance_lead =  esteps
-                              && extruder_advance_K[active_extruder]
+                              && extruder_advance_K[extruder]
                               && de > 0;
 
       if (block->use_advance_lead) {
@@ -2627,12 +2679,13 @@ bool Planner::_populate_block(block_t * const block, bool split_move,
         if (block->e_D_ratio > 3.0f)
           block->use_advance_lead = false;
         else {
-          // const uint32_t max_accel_steps_per_s2 = MAX_E_JERK(extruder) / (extruder_advance_K[active_extruder] * block->e_D_ratio) * steps_per_mm;
-          // if (TERN0(LA_DEBUG, accel > max_accel_steps_per_s2))
-          //   SERIAL_ECHOLNPGM("Acceleration limited.");
+          // The advance adds K * acceleration to the E speed, keep that offset within the E jerk
+          const uint32_t max_accel_steps_per_s2 = MAX_E_JERK(extruder) / (extruder_advance_K[extruder] * block->e_D_ratio) * steps_per_mm;
+          if (TERN0(LA_DEBUG, accel > max_accel_steps_per_s2))
+            SERIAL_ECHOLNPGM("Acceleration limited.");
           // LOG_I("junction_deviation_mm: %lf\n", junction_deviation_mm);
           // LOG_I("max_e_jerk: %lf %lf %lf %lf\n", accel / steps_per_mm, max_accel_steps_per_s2 / steps_per_mm, MAX_E_JERK(extruder), block->e_D_ratio);
-          // NOMORE(accel, max_accel_steps_per_s2);
+          NOMORE(accel, max_accel_steps_per_s2);
         }
       }
     #endif
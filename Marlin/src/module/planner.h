@@ -167,6 +167,7 @@ typedef struct shaper_data_t {
     uint8_t move_end;
 
     time_double_t last_print_time;
+    float e_advance;      // Pressure advance of E at the end of the block, steps
 
     void init() {
         is_create_move = false;
@@ -175,6 +176,7 @@ typedef struct shaper_data_t {
         is_start = false;
         is_end = false;
         last_print_time = 0;
+        e_advance = 0;
     }
 
 } shaper_data_t;
@@ -372,6 +374,10 @@ class Planner {
                             block_buffer_tail;      // Index of the busy block, if any
     static uint16_t cleaning_buffer_counter;        // A counter to disable queuing of blocks
     static uint8_t delay_before_delivering;         // This counter delays delivery of blocks when queue becomes empty to allow the opportunity of merging blocks
+    static float shaped_window_time,                // Adaptive delivery window of the shaper (ms)
+                 shaped_arrival_time,               // Smoothed interval between blocks entering the planner (ms)
+                 shaped_lookahead_time;             // Shaped plus planned time seen at the last delivery (ms)
+    static millis_t shaped_arrival_ms;              // When the last block entered the planner
     // static float flow_control_e_delta;
 
     #if ENABLED(DISTINCT_E_FACTORS)
@@ -435,7 +441,8 @@ class Planner {
     #endif
 
     #if ENABLED(LIN_ADVANCE)
-      static float extruder_advance_K[EXTRUDERS];
+      static float extruder_advance_K[EXTRUDERS],
+                   extruder_advance_smooth[EXTRUDERS];  // (s) Window the E speed is averaged over for the advance
     #endif
 
     /**
@@ -36,7 +36,7 @@
  */
 
 // Change EEPROM version if the structure changes
-#define EEPROM_VERSION "V86"
+#define EEPROM_VERSION "V88"
 #define EEPROM_OFFSET 100
 
 // Check the integrity of data offsets.
@@ -400,6 +400,7 @@ typedef struct SettingsDataStruct {
   // LIN_ADVANCE
   //
   float planner_extruder_advance_K[_MAX(EXTRUDERS, 1)]; // M900 K  planner.extruder_advance_K
+  float planner_extruder_advance_smooth[_MAX(EXTRUDERS, 1)]; // M900 W  planner.extruder_advance_smooth
 
   //
   // HAS_MOTOR_CURRENT_PWM
@@ -502,7 +503,7 @@ typedef struct SettingsDataStruct {
 
   float heat_bed_center_offset[2];
 
-  is_setting_t input_shaper[2];
+  is_setting_t input_shaper[INPUT_SHAPER_PROFILE_COUNT][2];
 
   uint8_t z_home_sg;
 
@@ -1267,6 +1268,15 @@ void MarlinSettings::postprocess() {
         dummyf = 0;
         for (uint8_t q = _MAX(EXTRUDERS, 1); q--;) EEPROM_WRITE(dummyf);
       #endif
+
+      _FIELD_TEST(planner_extruder_advance_smooth);
+
+      #if ENABLED(LIN_ADVANCE)
+        EEPROM_WRITE(planner.extruder_advance_smooth);
+      #else
+        dummyf = 0;
+        for (uint8_t q = _MAX(EXTRUDERS, 1); q--;) EEPROM_WRITE(dummyf);
+      #endif
     }
 
     //
@@ -1377,20 +1387,22 @@ void MarlinSettings::postprocess() {
     // // input shapper
     // //
     {
-      is_setting_t input_shaper[2];
+      is_setting_t input_shaper[INPUT_SHAPER_PROFILE_COUNT][2];
       _FIELD_TEST(input_shaper);
 
       int type; float freq, damp;
-      axisManager.input_shaper_get(X_AXIS, type, freq, damp);
-      input_shaper[X_AXIS].axis = X_AXIS;
-      input_shaper[X_AXIS].type = type;
-      input_shaper[X_AXIS].freq = freq;
-      input_shaper[X_AXIS].dampe = damp;
-      axisManager.input_shaper_get(Y_AXIS, type, freq, damp);
-      input_shaper[Y_AXIS].axis = Y_AXIS;
-      input_shaper[Y_AXIS].type = type;
-      input_shaper[Y_AXIS].freq = freq;
-      input_shaper[Y_AXIS].dampe = damp;
+      for (uint8_t i = 0; i < INPUT_SHAPER_PROFILE_COUNT; i++) {
+        axisManager.input_shaper_get_profile(i, X_AXIS, type, freq, damp);
+        input_shaper[i][X_AXIS].axis = X_AXIS;
+        input_shaper[i][X_AXIS].type = type;
+        input_shaper[i][X_AXIS].freq = freq;
+        input_shaper[i][X_AXIS].dampe = damp;
+        axisManager.input_shaper_get_profile(i, Y_AXIS, type, freq, damp);
+        input_shaper[i][Y_AXIS].axis = Y_AXIS;
+        input_shaper[i][Y_AXIS].type = type;
+        input_shaper[i][Y_AXIS].freq = freq;
+        input_shaper[i][Y_AXIS].dampe = damp;
+      }
 
       EEPROM_WRITE(input_shaper);
     }
@@ -2271,6 +2283,14 @@ void MarlinSettings::postprocess() {
         if (!valid)
           COPY(planner.extruder_advance_K, extruder_advance_K);
       #endif
+
+      float extruder_advance_smooth[_MAX(EXTRUDERS, 1)];
+      _FIELD_TEST(planner_extruder_advance_smooth);
+      EEPROM_READ(extruder_advance_smooth);
+      #if ENABLED(LIN_ADVANCE)
+        if (!valid)
+          COPY(planner.extruder_advance_smooth, extruder_advance_smooth);
+      #endif
     }
 
     //
@@ -2408,17 +2428,18 @@ void MarlinSettings::postprocess() {
     // // input shaper
     //
     {
-      is_setting_t input_shaper[2];
+      is_setting_t input_shaper[INPUT_SHAPER_PROFILE_COUNT][2];
       _FIELD_TEST(input_shaper);
       EEPROM_READ(input_shaper);
 
-      AxisInputShaper::axis_input_shaper_x.type = (InputShaperType)input_shaper[0].type;
-      AxisInputShaper::axis_input_shaper_x.frequency = input_shaper[0].freq;
-      AxisInputShaper::axis_input_shaper_x.zeta = input_shaper[0].dampe;
-
-      AxisInputShaper::axis_input_shaper_y.type = (InputShaperType)input_shaper[1].type;
-      AxisInputShaper::axis_input_shaper_y.frequency = input_shaper[1].freq;
-      AxisInputShaper::axis_input_shaper_y.zeta = input_shaper[1].dampe;
+      for (uint8_t i = 0; i < INPUT_SHAPER_PROFILE_COUNT; i++) {
+        for (uint8_t axis = X_AXIS; axis <= Y_AXIS; axis++) {
+          axisManager.shaper_profiles[i][axis].type = input_shaper[i][axis].type;
+          axisManager.shaper_profiles[i][axis].freq = input_shaper[i][axis].freq;
+          axisManager.shaper_profiles[i][axis].dampe = input_shaper[i][axis].dampe;
+        }
+      }
+      axisManager.input_shaper_load_profile();
 
     }
 
@@ -3130,6 +3151,7 @@ void MarlinSettings::reset() {
   #if ENABLED(LIN_ADVANCE)
     LOOP_L_N(i, EXTRUDERS) {
       planner.extruder_advance_K[i] = LIN_ADVANCE_K;
+      planner.extruder_advance_smooth[i] = LIN_ADVANCE_SMOOTH_TIME;
       TERN_(EXTRA_LIN_ADVANCE_K, other_extruder_advance_K[i] = LIN_ADVANCE_K);
     }
   #endif
@@ -4067,10 +4089,10 @@ void MarlinSettings::reset() {
     #if ENABLED(LIN_ADVANCE)
       CONFIG_ECHO_HEADING("Linear Advance:");
       #if EXTRUDERS < 2
-        CONFIG_ECHO_MSG("  M900 K", planner.extruder_advance_K[0]);
+        CONFIG_ECHO_MSG("  M900 K", planner.extruder_advance_K[0], " W", planner.extruder_advance_smooth[0]);
       #else
         LOOP_L_N(i, EXTRUDERS)
-          CONFIG_ECHO_MSG("  M900 T", i, " K", planner.extruder_advance_K[i]);
+          CONFIG_ECHO_MSG("  M900 T", i, " K", planner.extruder_advance_K[i], " W", planner.extruder_advance_smooth[i]);
       #endif
     #endif
 
@@ -4126,12 +4148,14 @@ void MarlinSettings::reset() {
 
     {
       int type; float freq, damp;
-      axisManager.input_shaper_get(X_AXIS, type, freq, damp);
-      SERIAL_ECHOPAIR_P("M593 X P", type, " F", freq, " D", damp);
-      SERIAL_EOL();
-      axisManager.input_shaper_get(Y_AXIS, type, freq, damp);
-      SERIAL_ECHOPAIR_P("M593 Y P", type, " F", freq, " D", damp);
-      SERIAL_EOL();
+      for (uint8_t i = 0; i < INPUT_SHAPER_PROFILE_COUNT; i++) {
+        axisManager.input_shaper_get_profile(i, X_AXIS, type, freq, damp);
+        SERIAL_ECHOPAIR_P("M593 T", i, " X P", type, " F", freq, " D", damp);
+        SERIAL_EOL();
+        axisManager.input_shaper_get_profile(i, Y_AXIS, type, freq, damp);
+        SERIAL_ECHOPAIR_P("M593 T", i, " Y P", type, " F", freq, " D", damp);
+        SERIAL_EOL();
+      }
     }
 
     #if ENABLED(BACKLASH_GCODE)
@@ -428,15 +428,29 @@ bool AxisInputShaper::moveShaperWindowToNext(FuncManager *func_manager, uint8_t
     return true;
 }
 
+/*
+ Every step of the window checks for room first, it stops before writing
+ anything when the arena is short and goes on from the same window state
+ when the block is generated again.
+*/
 bool AxisInputShaper::generateShapedFuncParams(FuncManager* func_manager, uint8_t move_shaper_start, uint8_t move_shaper_end) {
     if (!is_shaper_window_init) {
+        if (func_manager->getFreeSize() < SHAPER_STEP_MAX_FUNCS) {
+            return false;
+        }
         moveShaperWindowByIndex(func_manager, move_shaper_start, move_shaper_end);
         // func_manager.addDeltaTimeFuncParams(shaper_window.func_params.a, shaper_window.func_params.b, shaper_window.func_params.c, func_manager.last_time, shaper_window.time, shaper_window.pos);
 
         is_shaper_window_init = true;
     }
 
-    while (moveShaperWindowToNext(func_manager, move_shaper_start, move_shaper_end)) {
+    for (;;) {
+        if (func_manager->getFreeSize() < SHAPER_STEP_MAX_FUNCS) {
+            return false;
+        }
+        if (!moveShaperWindowToNext(func_manager, move_shaper_start, move_shaper_end)) {
+            break;
+        }
         // func_manager.addDeltaTimeFuncParams(shaper_window.func_params.a, shaper_window.func_params.b, shaper_window.func_params.c, func_manager.last_time, shaper_window.time, shaper_window.pos);
         // printf("axis: %d, generateFuncParams: %lf, %lf, %lf \n", axis, shaper_window.pos, func_manager.getPos(shaper_window.time), shaper_window.time);
     }
@@ -38,6 +38,9 @@ enum class InputShaperType : int
   zvddd = 8
 };
 
+// Functions one step of the shaper window adds at most, see addFuncParamsToManager()
+#define SHAPER_STEP_MAX_FUNCS 2
+
 class ShaperParams
 {
 public:
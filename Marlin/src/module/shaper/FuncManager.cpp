@@ -21,81 +21,176 @@
 
 #include "FuncManager.h"
 #include "../AxisManager.h"
+#include "../stepper.h"
 #include "../../../../snapmaker/debug/debug.h"
 
-FuncParams FuncManager::FUNC_PARAMS_X[FUNC_PARAMS_X_SIZE];
-FuncParams FuncManager::FUNC_PARAMS_Y[FUNC_PARAMS_Y_SIZE];
-FuncParams FuncManager::FUNC_PARAMS_Z[FUNC_PARAMS_Z_SIZE];
-FuncParamsExtend FuncManager::FUNC_PARAMS_E[FUNC_PARAMS_E_SIZE];
-FuncParams FuncManager::FUNC_PARAMS_T[FUNC_PARAMS_T_SIZE];
-
-int8_t FuncManager::FUNC_PARAMS_TYPE_X[FUNC_PARAMS_X_SIZE];
-int8_t FuncManager::FUNC_PARAMS_TYPE_Y[FUNC_PARAMS_Y_SIZE];
-int8_t FuncManager::FUNC_PARAMS_TYPE_Z[FUNC_PARAMS_Z_SIZE];
-int8_t FuncManager::FUNC_PARAMS_TYPE_E[FUNC_PARAMS_E_SIZE];
-int8_t FuncManager::FUNC_PARAMS_TYPE_T[FUNC_PARAMS_T_SIZE];
-
-float FuncManager::getPos(time_double_t time) {
-    int func_start = func_params_tail;
-    while (time > funcParams[func_start].right_time && func_start != prevFuncParamsIndex(func_params_head)) {
-        func_start = nextFuncParamsIndex(func_start);
+float FuncManager::params_a[FUNC_PARAMS_ARENA_SIZE];
+float FuncManager::params_b[FUNC_PARAMS_ARENA_SIZE];
+float FuncManager::params_c[FUNC_PARAMS_ARENA_SIZE];
+float FuncManager::params_right_pos[FUNC_PARAMS_ARENA_SIZE];
+int64_t FuncManager::params_right_time[FUNC_PARAMS_ARENA_SIZE];
+
+uint8_t FuncManager::chunk_next[FUNC_PARAMS_CHUNK_COUNT];
+int32_t FuncManager::chunk_base[FUNC_PARAMS_CHUNK_COUNT];
+
+uint8_t FuncManager::chunk_free[FUNC_PARAMS_CHUNK_COUNT];
+uint8_t FuncManager::chunk_free_count = 0;
+uint8_t FuncManager::chunk_unused = FUNC_PARAMS_CHUNK_COUNT;
+uint8_t FuncManager::chunk_used = 0;
+uint8_t FuncManager::chunk_peak = 0;
+
+/*
+ The chunk pool is shared by the producer in the marlin task and the consumer,
+ which may run in the stepper ISR. Callers outside the ISR mask it first.
+*/
+uint8_t FuncManager::allocChunk() {
+    uint8_t chunk;
+    if (chunk_free_count) {
+        chunk = chunk_free[--chunk_free_count];
+    } else if (chunk_unused) {
+        chunk = FUNC_PARAMS_CHUNK_COUNT - chunk_unused--;
+    } else {
+        return FUNC_PARAMS_NO_CHUNK;
     }
-    return getPosByFuncParams(time, func_start);
-}
 
-float FuncManager::getPosByFuncParams(time_double_t time, int func_params_use) {
-    FuncParams& f_p = funcParams[func_params_use];
-    time_double_t left_time = func_params_use == func_params_tail ? 0 : funcParams[prevFuncParamsIndex(func_params_use)].right_time;
-    float t = time - left_time;
-    return f_p.a * t * t + f_p.b * t + f_p.c;
+    chunk_next[chunk] = FUNC_PARAMS_NO_CHUNK;
+    if (++chunk_used > chunk_peak) {
+        chunk_peak = chunk_used;
+    }
+    return chunk;
 }
 
-FORCE_INLINE float FuncManager::getTimeByFuncParams(FuncParams* f_p, int8_t type, float pos, int func_params_use) {
-    float a = f_p->a;
-    float b = f_p->b;
-    float c = f_p->c;
-    c = c - pos;
+void FuncManager::freeChunk(uint8_t chunk) {
+    chunk_free[chunk_free_count++] = chunk;
+    chunk_used--;
+}
 
-    if (IS_ZERO(a)) {
-        return -c / b;
+// Give back the chunks from the one holding index from up to, not including, the one holding index to
+void FuncManager::releaseChunks(int from, int to) {
+    uint8_t chunk = from >> FUNC_PARAMS_CHUNK_SHIFT;
+    const uint8_t last = to >> FUNC_PARAMS_CHUNK_SHIFT;
+    while (chunk != last) {
+        const uint8_t next = chunk_next[chunk];
+        freeChunk(chunk);
+        chunk = next;
     }
+}
 
-    float d2 = b * b - 4 * a * c;
-    if (d2 < 0) {
-        d2 = 0.0f;
+void FuncManager::reset() {
+    const bool was_enabled = stepper.suspend();
+
+    if (func_params_head >= 0) {
+        releaseChunks(func_params_tail, func_params_head);
+        freeChunk(func_params_head >> FUNC_PARAMS_CHUNK_SHIFT);
     }
+    // Every axis gave its chunks back first, so there is always one left
+    const int first = allocChunk() << FUNC_PARAMS_CHUNK_SHIFT;
+
+    if (was_enabled) stepper.wake_up();
+
+    func_params_tail = first;
+    func_params_use = first;
+    func_params_head = first;
+    func_params_last = -1;
+    func_params_added = 0;
+    func_params_released = 0;
+
+    last_time = 0;
+    last_pos = 0;
+    last_origin_e = E_START_POS;
+    last_pos_e = 0;
+    last_is_zero = false;
+
+    left_time = 0;
+    print_time = 0;
+    print_pos = 0;
+    if (E_AXIS == axis)
+      print_step = E_START_POS;
+    else
+      print_step = 0;
+
+    average_index = 0;
+    average_count = 0;
+    average_step = 0;
+    average_delta_time = 0;
+    average_print = 0;
 
-    float d = SQRT(d2);
+    solve_index = -1;
+}
 
-    if (type > 0) {
-        return (-b + d) / (2 * a);
-    } else {
-        return (-b - d) / (2 * a);
+// A function whose a * t^2 stays below this many steps is solved as a line
+#define SOLVE_LINEAR_MAX_ERROR 0.0001f
+
+/*
+ Solve a * t^2 + b * t + c = pos for the step time. The square of b and 4a are
+ cached per piecewise function, so a step costs one sqrt and one divide, all
+ in single precision. The root is taken as 2c / (-b -+ d), which stays exact
+ where -b +- d would cancel, a slow change of a fast speed.
+*/
+FORCE_INLINE float FuncManager::getTimeByFuncParams(float a, float b, float c, int8_t type, float pos, int func_params_use) {
+    if (solve_index != func_params_use) {
+        solve_index = func_params_use;
+        const float span = getRightTime(func_params_use) - left_time;
+        solve_linear = b != 0 && ABS(a) * sq(span) < SOLVE_LINEAR_MAX_ERROR;
+        if (solve_linear) {
+            solve_inv = 1.0f / b;
+        } else {
+            solve_b2 = b * b;
+            solve_4a = 4 * a;
+        }
     }
-}
 
-FORCE_INLINE double FuncManager::getTimeByFuncParamsExtend(FuncParamsExtend* f_p, int8_t type, double pos, int func_params_use) {
-    double a = f_p->a;
-    double b = f_p->b;
-    double c = f_p->c;
     c = c - pos;
 
-    if (IS_ZERO(a)) {
-        return -c / b;
+    if (solve_linear) {
+        return -c * solve_inv;
     }
 
-    double d2 = b * b - 4 * a * c;
+    float d2 = solve_b2 - solve_4a * c;
     if (d2 < 0) {
         d2 = 0.0f;
     }
 
-    double d = SQRT(d2);
+    const float d = SQRT(d2);
+    const float q = type > 0 ? -b - d : -b + d;
+    if (q == 0) {
+        return 0;
+    }
 
-    if (type > 0) {
-        return (-b + d) / (2 * a);
-    } else {
-        return (-b - d) / (2 * a);
+    return 2 * c / q;
+}
+
+/*
+ Publish the function just written at func_params_head. The head moves into a
+ new chunk when the current one is full.
+*/
+bool FuncManager::pushFuncParams(int type) {
+    int head = func_params_head;
+    int next = head + 1;
+
+    if (!(next & FUNC_PARAMS_CHUNK_MASK)) {
+        const bool was_enabled = stepper.suspend();
+        const uint8_t chunk = allocChunk();
+        if (chunk != FUNC_PARAMS_NO_CHUNK) {
+            chunk_next[head >> FUNC_PARAMS_CHUNK_SHIFT] = chunk;
+        }
+        if (was_enabled) stepper.wake_up();
+
+        if (chunk == FUNC_PARAMS_NO_CHUNK) {
+            // Not expected, the generators stop before a write when the arena
+            // is short. The slot is reused by the next function.
+            extern uint32_t statistics_funcgen_runout_cnt;
+            statistics_funcgen_runout_cnt++;
+            LOG_E("statistics_funcgen_runout_cnt on axi %d\r\n", axis);
+            return false;
+        }
+        next = chunk << FUNC_PARAMS_CHUNK_SHIFT;
     }
+
+    func_params_last = head;
+    func_params_added++;
+    func_params_head = next;
+    return true;
 }
 
 void FuncManager::addFuncParams(float a, float b, float c, int type, time_double_t right_time, float right_pos) {
@@ -108,15 +203,15 @@ void FuncManager::addFuncParams(float a, float b, float c, int type, time_double
 
     if (type == 0) {
         int func_params_use_tmp = func_params_use;
-        if (last_is_zero && func_params_use_tmp != func_params_head && func_params_use_tmp != prevFuncParamsIndex(func_params_head)) {
-            FuncParams &f_p = funcParams[prevFuncParamsIndex(func_params_head)];
+        if (last_is_zero && func_params_use_tmp != func_params_head && func_params_use_tmp != func_params_last) {
+            const int last = func_params_last;
 
-            if (!IS_ZERO(f_p.right_pos - right_pos)) {
-                LOG_I("error type: %lf, %lf, a: %d\n", f_p.right_pos, right_pos, axis);
+            if (!IS_ZERO(params_right_pos[last] - right_pos)) {
+                LOG_I("error type: %lf, %lf, a: %d\n", params_right_pos[last], right_pos, axis);
             }
 
-            f_p.right_time = right_time;
-            f_p.right_pos = right_pos;
+            setRightTime(last, right_time, 0);
+            params_right_pos[last] = right_pos;
 
             last_time = right_time;
             last_pos = right_pos;
@@ -129,16 +224,12 @@ void FuncManager::addFuncParams(float a, float b, float c, int type, time_double
         last_is_zero = false;
     }
 
-
-    FuncParams &f_p = funcParams[func_params_head];
-    funcParamsTypes[func_params_head] = type;
-
-    f_p.a = a;
-    f_p.b = b;
-    f_p.c = c;
-
-    f_p.right_time = right_time;
-    f_p.right_pos = right_pos;
+    const int head = func_params_head;
+    params_a[head] = a;
+    params_b[head] = b;
+    params_c[head] = c;
+    params_right_pos[head] = right_pos;
+    setRightTime(head, right_time, type);
 
     // if (type > 0 && right_pos <= last_pos) {
     //     LOG_I("error1 1 for right_pos: %lf, %lf\n", right_pos, last_pos);
@@ -153,16 +244,14 @@ void FuncManager::addFuncParams(float a, float b, float c, int type, time_double
     last_time = right_time;
     last_pos = right_pos;
 
-    func_params_head = nextFuncParamsIndex(func_params_head);
-
-    if (!last_is_zero && func_params_head == func_params_use) {
-      extern uint32_t statistics_funcgen_runout_cnt;
-      statistics_funcgen_runout_cnt++;
-      LOG_E("statistics_funcgen_runout_cnt on axi %d\r\n", axis);
-    }
+    pushFuncParams(type);
 }
 
-void FuncManager::addFuncParamsExtend(double a, double b, double c, int type, time_double_t right_time, double right_pos) {
+/*
+ E positions grow over a whole print, so they are stored relative to the base
+ of their chunk and the per step solver can stay in float.
+*/
+void FuncManager::addFuncParamsExtend(int32_t origin, float a, float b, float c, int type, time_double_t right_time, float right_pos) {
     if (axis != E_AXIS) {
         return;
     }
@@ -172,23 +261,25 @@ void FuncManager::addFuncParamsExtend(double a, double b, double c, int type, ti
     if (max_size < getSize()) {
         max_size = getSize();
     }
-    if (ABS(last_pos_e - right_pos) < EPSILON) {
+    if (ABS((float)(origin - last_origin_e) + right_pos - last_pos_e) < EPSILON) {
         type = 0;
     }
 
     if (type == 0) {
         int func_params_use_tmp = func_params_use;
-        if (last_is_zero && func_params_use_tmp != func_params_head && func_params_use_tmp != prevFuncParamsIndex(func_params_head)) {
-            FuncParamsExtend &f_p = funcParamsExtend[prevFuncParamsIndex(func_params_head)];
+        if (last_is_zero && func_params_use_tmp != func_params_head && func_params_use_tmp != func_params_last) {
+            const int last = func_params_last;
+            const int32_t base = chunk_base[last >> FUNC_PARAMS_CHUNK_SHIFT];
 
-            if (ABS(f_p.right_pos - right_pos)>1) {
-                LOG_I("error type: %lf, %lf, a: %d\n", f_p.right_pos, right_pos, axis);
+            if (ABS((float)(base - origin) + params_right_pos[last] - right_pos) > 1) {
+                LOG_I("error type: %lf, %lf, a: %d\n", base + params_right_pos[last], origin + right_pos, axis);
             }
 
-            f_p.right_time = right_time;
-            f_p.right_pos = right_pos;
+            setRightTime(last, right_time, 0);
+            params_right_pos[last] = (float)(origin - base) + right_pos;
 
             last_time = right_time;
+            last_origin_e = origin;
             last_pos_e = right_pos;
 
             return;
@@ -199,31 +290,23 @@ void FuncManager::addFuncParamsExtend(double a, double b, double c, int type, ti
         last_is_zero = false;
     }
 
+    const int head = func_params_head;
+    if (!(head & FUNC_PARAMS_CHUNK_MASK)) {
+        chunk_base[head >> FUNC_PARAMS_CHUNK_SHIFT] = origin + (int32_t)c;
+    }
+    const float shift = (float)(origin - chunk_base[head >> FUNC_PARAMS_CHUNK_SHIFT]);
 
-    FuncParamsExtend &f_p = funcParamsExtend[func_params_head];
-    funcParamsTypes[func_params_head] = type;
-
-    f_p.a = a;
-    f_p.b = b;
-    f_p.c = c;
-
-    f_p.right_time = right_time;
-    f_p.right_pos = right_pos;
-
-    // if (type > 0 && right_pos <= last_pos) {
-    //     LOG_I("error1 1 for right_pos: %lf, %lf\n", right_pos, last_pos);
-    // }
-    // if (type == 0 && right_pos != last_pos) {
-    //     LOG_I("error1 0 for right_pos: %lf, %lf\n", right_pos, last_pos);
-    // }
-    // if (type < 0 && right_pos >= last_pos) {
-    //     LOG_I("error1 -1 for right_pos: %lf, %lf\n", right_pos, last_pos);
-    // }
+    params_a[head] = a;
+    params_b[head] = b;
+    params_c[head] = c + shift;
+    params_right_pos[head] = right_pos + shift;
+    setRightTime(head, right_time, type);
 
     last_time = right_time;
+    last_origin_e = origin;
     last_pos_e = right_pos;
 
-    func_params_head = nextFuncParamsIndex(func_params_head);
+    pushFuncParams(type);
 }
 
 bool FuncManager::getNextPosTime(int delta_step, int8_t *dir, float& mm_to_step, float& half_step_mm) {
@@ -240,65 +323,73 @@ bool FuncManager::getNextPosTime(int delta_step, int8_t *dir, float& mm_to_step,
     average_index = 0;
     average_count = 0;
 
-    FuncParams *func_params = &funcParams[func_params_use];
-    int8_t type = funcParamsTypes[func_params_use];
+    const int use_start = func_params_use;
+    int use = use_start;
+    int prev_use = use;
+    int advanced = 0;
+    int8_t type = getType(use);
 
     int next_step = print_step;
     float next_pos = print_pos;
-    while (func_params_use != func_params_head) {
+    while (use != func_params_head) {
         if (type == 0) {
         } else if (type > 0) {
             next_step = print_step + delta_step;
             next_pos = (float)next_step - 0.5f;
-            if (next_pos <= func_params->right_pos + EPSILON) {
+            if (next_pos <= params_right_pos[use] + EPSILON) {
                 *dir = 1;
                 break;
             }
         } else {
             next_step = print_step - delta_step;
             next_pos = (float)next_step + 0.5f;
-            if (next_pos >= func_params->right_pos - EPSILON) {
+            if (next_pos >= params_right_pos[use] - EPSILON) {
                 *dir = -1;
                 break;
             }
         }
-        func_params_use = nextFuncParamsIndex(func_params_use);
+        prev_use = use;
+        use = nextFuncParamsIndex(use);
+        advanced++;
+        solve_index = -1;
 
-        left_time = func_params->right_time;
+        left_time = getRightTime(prev_use);
 
-        func_params = &funcParams[func_params_use];
-        type = funcParamsTypes[func_params_use];
+        type = getType(use);
     }
+    func_params_use = use;
 
-    if (func_params_tail != func_params_use) {
-        func_params_tail = prevFuncParamsIndex(func_params_use);
+    if (advanced) {
+        releaseChunks(func_params_tail, prev_use);
+        func_params_released += func_params_tail == use_start ? advanced - 1 : advanced;
+        func_params_tail = prev_use;
     }
 
-    if (func_params_use == func_params_head) {
+    if (use == func_params_head) {
         return false;
     }
 
-    time_double_t next_time = left_time + getTimeByFuncParams(func_params, type, next_pos, func_params_use);
+    time_double_t next_time = left_time + getTimeByFuncParams(params_a[use], params_b[use], params_c[use], type, next_pos, use);
 
     print_time = next_time;
     print_pos = next_pos;
     print_step = next_step;
 
-    if (average_count == 0 && IS_ZERO(func_params->a)) {
+    if (average_count == 0 && solve_linear) {
         if (type > 0) {
-            int count = FLOOR((func_params->right_pos + EPSILON - next_pos));
+            int count = FLOOR((params_right_pos[use] + EPSILON - next_pos));
             if (count > 0) {
                 average_count = count;
                 average_step = delta_step;
-                average_delta_time = (float) average_step / func_params->b;
+                average_delta_time = (float) average_step / params_b[use];
                 average_print = print_time;
             }
         } else if (type < 0) {
-            int count = FLOOR((next_pos - func_params->right_pos + EPSILON));
+            int count = FLOOR((next_pos - params_right_pos[use] + EPSILON));
             if (count > 0) {
                 average_count = count;
                 average_step = -delta_step;
-                average_delta_time = (float) average_step / func_params->b;
+                average_delta_time = (float) average_step / params_b[use];
                 average_print = print_time;
             }
         }
@@ -321,69 +412,77 @@ bool FuncManager::getNextPosTimeEextend(int delta_step, int8_t *dir, float& mm_t
     average_index = 0;
     average_count = 0;
 
-    FuncParamsExtend *func_params = &funcParamsExtend[func_params_use];
-    int8_t type = funcParamsTypes[func_params_use];
+    const int use_start = func_params_use;
+    int use = use_start;
+    int prev_use = use;
+    int advanced = 0;
+    int8_t type = getType(use);
 
     int next_step = print_step;
-    double next_pos = print_pos_e;
-    while (func_params_use != func_params_head) {
+    float next_pos = 0;
+    while (use != func_params_head) {
+        const int32_t base = chunk_base[use >> FUNC_PARAMS_CHUNK_SHIFT];
         if (type == 0) {
         } else if (type > 0) {
             next_step = print_step + delta_step;
-            next_pos = (float)next_step - 0.5f;
-            if (next_pos <= func_params->right_pos + EPSILON) {
+            next_pos = (float)(next_step - base) - 0.5f;
+            if (next_pos <= params_right_pos[use] + EPSILON) {
                 *dir = 1;
                 break;
             }
         } else {
             next_step = print_step - delta_step;
-            next_pos = (float)next_step + 0.5f;
-            if (next_pos >= func_params->right_pos - EPSILON) {
+            next_pos = (float)(next_step - base) + 0.5f;
+            if (next_pos >= params_right_pos[use] - EPSILON) {
                 *dir = -1;
                 break;
             }
         }
-        func_params_use = nextFuncParamsIndex(func_params_use);
+        prev_use = use;
+        use = nextFuncParamsIndex(use);
+        advanced++;
+        solve_index = -1;
 
-        left_time = func_params->right_time;
+        left_time = getRightTime(prev_use);
 
-        func_params = &funcParamsExtend[func_params_use];
-        type = funcParamsTypes[func_params_use];
+        type = getType(use);
     }
+    func_params_use = use;
 
-    if (func_params_tail != func_params_use) {
-        func_params_tail = prevFuncParamsIndex(func_params_use);
+    if (advanced) {
+        releaseChunks(func_params_tail, prev_use);
+        func_params_released += func_params_tail == use_start ? advanced - 1 : advanced;
+        func_params_tail = prev_use;
     }
 
-    if (func_params_use == func_params_head) {
+    if (use == func_params_head) {
         return false;
     }
 
-    time_double_t next_time = left_time + getTimeByFuncParamsExtend(func_params, type, next_pos, func_params_use);
+    time_double_t next_time = left_time + getTimeByFuncParams(params_a[use], params_b[use], params_c[use], type, next_pos, use);
 
     print_time = next_time;
-    print_pos_e = next_pos;
     print_step = next_step;
 
-    if (average_count == 0 && IS_ZERO(func_params->a)) {
+    if (average_count == 0 && solve_linear) {
         if (type > 0) {
-            int count = FLOOR((func_params->right_pos + EPSILON - next_pos));
+            int count = FLOOR((params_right_pos[use] + EPSILON - next_pos));
             if (count > 0) {
                 average_count = count;
                 average_step = delta_step;
-                average_delta_time = average_step / func_params->b;
+                average_delta_time = (float) average_step / params_b[use];
                 average_print = print_time;
             }
         } else if (type < 0) {
-            int count = FLOOR((next_pos - func_params->right_pos + EPSILON));
+            int count = FLOOR((next_pos - params_right_pos[use] + EPSILON));
             if (count > 0) {
                 average_count = count;
                 average_step = -delta_step;
-                average_delta_time = average_step / func_params->b;
+                average_delta_time = (float) average_step / params_b[use];
                 average_print = print_time;
             }
         }
     }
 
     return true;
-}
\ No newline at end of file
+}
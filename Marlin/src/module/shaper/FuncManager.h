@@ -28,8 +28,6 @@
 
 #define E_START_POS     (0.0)
 // #define E_START_POS     ((16.0 * 4157 * 138))
-#define FUNC_PARAMS_SIZE 512
-#define FUNC_PARAMS_MOD(n, size) ((n + size) % size)
 
 class FuncParams {
   public:
@@ -43,18 +41,6 @@ class FuncParams {
     }
 };
 
-class FuncParamsExtend {
-  public:
-    double a, b, c, right_pos;
-    time_double_t right_time = 0;
-
-    void update(double a, double b, double c) {
-        this->a = a;
-        this->b = b;
-        this->c = c;
-    }
-};
-
 //class Func {
 //  public:
 //    float a, b, c;
@@ -70,16 +56,18 @@ class FuncParamsExtend {
 //    static float getX(float y, float a, float b, float c, float left_time, int8_t type);
 //};
 
-#define FUNC_PARAMS_X_SIZE 300
-#define FUNC_PARAMS_Y_SIZE 300
-#define FUNC_PARAMS_Z_SIZE 64
-#define FUNC_PARAMS_E_SIZE 64
-#define FUNC_PARAMS_T_SIZE 8
+// All axes share one arena of piecewise functions. It is handed out in
+// chunks, so an axis running dense curves borrows what the idle axes leave.
+// A function index is chunk * FUNC_PARAMS_CHUNK_SIZE + offset.
+#define FUNC_PARAMS_CHUNK_SHIFT 4
+#define FUNC_PARAMS_CHUNK_SIZE  (1 << FUNC_PARAMS_CHUNK_SHIFT)
+#define FUNC_PARAMS_CHUNK_MASK  (FUNC_PARAMS_CHUNK_SIZE - 1)
+#define FUNC_PARAMS_CHUNK_COUNT 48
+#define FUNC_PARAMS_ARENA_SIZE  (FUNC_PARAMS_CHUNK_COUNT * FUNC_PARAMS_CHUNK_SIZE)
+#define FUNC_PARAMS_NO_CHUNK    0xFF
 
-// static FuncParams FUNC_PARAMS_X[FUNC_PARAMS_X_SIZE];
-// static FuncParams FUNC_PARAMS_Y[FUNC_PARAMS_Y_SIZE];
-// static FuncParams FUNC_PARAMS_Z[FUNC_PARAMS_Z_SIZE];
-// static FuncParams FUNC_PARAMS_E[FUNC_PARAMS_E_SIZE];
+// The function type (-1, 0, 1) lives in the low bits of right_time
+#define FUNC_PARAMS_TYPE_MASK   ((int64_t)3)
 
 class FuncManager {
   private:
@@ -90,130 +78,107 @@ class FuncManager {
     float average_delta_time = 0;
     time_double_t average_print = 0;
 
+    // Step solver coefficients, computed once per piecewise function
+    int solve_index = -1;
+    bool solve_linear = false;
+    float solve_b2 = 0;
+    float solve_4a = 0;
+    float solve_inv = 0;
+
+    // Arena, structure of arrays
+    static float params_a[FUNC_PARAMS_ARENA_SIZE];
+    static float params_b[FUNC_PARAMS_ARENA_SIZE];
+    static float params_c[FUNC_PARAMS_ARENA_SIZE];
+    static float params_right_pos[FUNC_PARAMS_ARENA_SIZE];
+    static int64_t params_right_time[FUNC_PARAMS_ARENA_SIZE];
+
+    // Chunk links of every axis ring, and the E position each chunk is relative to
+    static uint8_t chunk_next[FUNC_PARAMS_CHUNK_COUNT];
+    static int32_t chunk_base[FUNC_PARAMS_CHUNK_COUNT];
+
+    static uint8_t chunk_free[FUNC_PARAMS_CHUNK_COUNT];
+    static uint8_t chunk_free_count;
+    static uint8_t chunk_unused;
+
+    static uint8_t allocChunk();
+    static void freeChunk(uint8_t chunk);
+    void releaseChunks(int from, int to);
+
   public:
-    static FuncParams FUNC_PARAMS_X[FUNC_PARAMS_X_SIZE];
-    static FuncParams FUNC_PARAMS_Y[FUNC_PARAMS_Y_SIZE];
-    static FuncParams FUNC_PARAMS_Z[FUNC_PARAMS_Z_SIZE];
-    static FuncParamsExtend FUNC_PARAMS_E[FUNC_PARAMS_E_SIZE];
-    static FuncParams FUNC_PARAMS_T[FUNC_PARAMS_T_SIZE];
-
-    static int8_t FUNC_PARAMS_TYPE_X[FUNC_PARAMS_X_SIZE];
-    static int8_t FUNC_PARAMS_TYPE_Y[FUNC_PARAMS_Y_SIZE];
-    static int8_t FUNC_PARAMS_TYPE_Z[FUNC_PARAMS_Z_SIZE];
-    static int8_t FUNC_PARAMS_TYPE_E[FUNC_PARAMS_E_SIZE];
-    static int8_t FUNC_PARAMS_TYPE_T[FUNC_PARAMS_T_SIZE];
-
-    FuncParams* funcParams;
-    FuncParamsExtend *funcParamsExtend;
-    int8_t* funcParamsTypes;
-
-    volatile int func_params_tail = 0;
-    volatile int func_params_use = 0;
-    volatile int func_params_head = 0;
+    static uint8_t chunk_used;
+    static uint8_t chunk_peak;
+
+    volatile int func_params_tail = -1;
+    volatile int func_params_use = -1;
+    volatile int func_params_head = -1;
+    int func_params_last = -1;
+
+    // Written by the producer and the consumer only
+    volatile uint32_t func_params_added = 0;
+    volatile uint32_t func_params_released = 0;
 
     // Axis index
     int axis;
-    // Piecewise function length
-    int size;
     // Short time maximum length of piecewise function
     int max_size = 0;
 
     time_double_t last_time = 0;
     float last_pos = 0;
-    double last_pos_e = 0;
+    int32_t last_origin_e = 0;
+    float last_pos_e = 0;
     bool last_is_zero = false;
 
     // Consume
     time_double_t left_time = 0;
     time_double_t print_time = 0;
     float print_pos = 0;
-    double print_pos_e = 0;
     int print_step = 0;
 
     FuncManager(){};
 
     void init(int8_t axis) {
         this->axis = axis;
-        switch (axis) {
-            case 0:
-                size = FUNC_PARAMS_X_SIZE;
-                funcParams = FUNC_PARAMS_X;
-                funcParamsTypes = FUNC_PARAMS_TYPE_X;
-                break;
-            case 1:
-                size = FUNC_PARAMS_Y_SIZE;
-                funcParams = FUNC_PARAMS_Y;
-                funcParamsTypes = FUNC_PARAMS_TYPE_Y;
-                break;
-            case 2:
-                size = FUNC_PARAMS_Z_SIZE;
-                funcParams = FUNC_PARAMS_Z;
-                funcParamsTypes = FUNC_PARAMS_TYPE_Z;
-                break;
-            case 3:
-                size = FUNC_PARAMS_E_SIZE;
-                funcParamsExtend = FUNC_PARAMS_E;
-                funcParamsTypes = FUNC_PARAMS_TYPE_E;
-                break;
-            case 4:
-                size = FUNC_PARAMS_T_SIZE;
-                funcParams = FUNC_PARAMS_T;
-                funcParamsTypes = FUNC_PARAMS_TYPE_T;
-                break;
-        }
     }
 
-    void reset() {
-        func_params_tail = 0;
-        func_params_use = 0;
-        func_params_head = 0;
-
-        last_time = 0;
-        last_pos = 0;
-        last_pos_e = E_START_POS;
-        last_is_zero = false;
-
-        left_time = 0;
-        print_time = 0;
-        print_pos = 0;
-        print_pos_e = E_START_POS;
-        if (E_AXIS == axis)
-          print_step = E_START_POS;
-        else
-          print_step = 0;
-
-        average_index = 0;
-        average_count = 0;
-        average_step = 0;
-        average_delta_time = 0;
-        average_print = 0;
+    void reset();
+
+    int getSize() {
+      return func_params_added - func_params_released;
     }
 
-    constexpr int getSize() {
-      return FUNC_PARAMS_MOD(func_params_head - func_params_tail, size);
+    // Free room of this axis, the rest of its head chunk plus the shared chunks
+    int getFreeSize() {
+        return FUNC_PARAMS_CHUNK_MASK - (func_params_head & FUNC_PARAMS_CHUNK_MASK)
+             + (chunk_free_count + chunk_unused) * FUNC_PARAMS_CHUNK_SIZE;
     }
 
-    constexpr int getFreeSize() {
-        return size - 1 - getSize();
+    FORCE_INLINE static int nextFuncParamsIndex(const int func_params_index) {
+        if ((func_params_index + 1) & FUNC_PARAMS_CHUNK_MASK) {
+            return func_params_index + 1;
+        }
+        return chunk_next[func_params_index >> FUNC_PARAMS_CHUNK_SHIFT] << FUNC_PARAMS_CHUNK_SHIFT;
+    };
+
+    FORCE_INLINE static int8_t getType(const int func_params_index) {
+        return (int8_t)((params_right_time[func_params_index] & FUNC_PARAMS_TYPE_MASK) << 6) >> 6;
     }
 
-    FORCE_INLINE constexpr int nextFuncParamsIndex(const int func_params_index) { return FUNC_PARAMS_MOD(func_params_index + 1, size); };
-    FORCE_INLINE constexpr int prevFuncParamsIndex(const int func_params_index) { return FUNC_PARAMS_MOD(func_params_index - 1, size); };
-    // static constexpr int nextFuncParamsIndex(const int func_params_index, int s) { return FUNC_PARAMS_MOD(func_params_index + 1, s); };
-    // static constexpr int prevFuncParamsIndex(const int func_params_index, int s) { return FUNC_PARAMS_MOD(func_params_index - 1, s); };
+    FORCE_INLINE static time_double_t getRightTime(const int func_params_index) {
+        time_double_t right_time;
+        right_time.t = params_right_time[func_params_index] & ~FUNC_PARAMS_TYPE_MASK;
+        return right_time;
+    }
 
-    constexpr bool isBetween(const int func_params_start, const int func_params_end, const int func_params_middle) {
-        return (FUNC_PARAMS_MOD(func_params_middle - func_params_start, size) + FUNC_PARAMS_MOD(func_params_end - func_params_middle, size)) == FUNC_PARAMS_MOD(func_params_end - func_params_start, size);
-    };
+    FORCE_INLINE static void setRightTime(const int func_params_index, const time_double_t &right_time, int8_t type) {
+        params_right_time[func_params_index] = (right_time.t & ~FUNC_PARAMS_TYPE_MASK) | (type & FUNC_PARAMS_TYPE_MASK);
+    }
 
     // void addMonotoneDeltaTimeFuncParams(float a, float b, float c, float delta_left_time, int8_t type, time_double_t right_time, float right_pos);
 
     // void addDeltaTimeFuncParams(float a, float b, float c, time_double_t left_time, time_double_t right_time, float right_pos);
 
     void addFuncParams(float a, float b, float c,int type, time_double_t right_time, float right_pos);
-    void addFuncParamsExtend(double a, double b, double c, int type, time_double_t right_time, double right_pos);
-
-    float getPos(time_double_t time);
+    void addFuncParamsExtend(int32_t origin, float a, float b, float c, int type, time_double_t right_time, float right_pos);
 
     float getY(float x, float a, float b, float c) {
         return a * sq(x) + b * x + c;
@@ -226,8 +191,7 @@ class FuncManager {
 
   private:
 
-    float getPosByFuncParams(time_double_t time, int func_params_use);
+    bool pushFuncParams(int type);
 
-    FORCE_INLINE float getTimeByFuncParams(FuncParams* f_p, int8_t type, float pos, int func_params_use);
-    FORCE_INLINE double getTimeByFuncParamsExtend(FuncParamsExtend* f_p, int8_t type, double pos, int func_params_use);
+    FORCE_INLINE float getTimeByFuncParams(float a, float b, float c, int8_t type, float pos, int func_params_use);
 };
\ No newline at end of file
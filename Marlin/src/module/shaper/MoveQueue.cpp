@@ -140,8 +140,8 @@ void MoveQueue::calculateMoves(block_t* block) {
     }
 
     {
-        double p1 = end_move.end_pos_e;
-        end_move.end_pos_e = (int64_t)(end_move.end_pos_e + 0.5);
+        float p1 = end_move.end_pos_e;
+        end_move.end_pos_e = floorf(end_move.end_pos_e + 0.5f);
         if (ABS(p1 - end_move.end_pos_e) > 1) {
             LOG_I("error E LROUND: %lf, %lf\n", p1, end_move.end_pos_e);
         }
@@ -196,7 +196,14 @@ void MoveQueue::setMove(uint8_t move_index, float start_v, float end_v, float ac
             // LOG_I("debug: %d, %lf, %lf\n", i, move.distance, move.end_pos[i]);
         }
     }
-    move.start_pos_e = is_first ? E_START_POS : last_move.end_pos_e;
+    if (is_first) {
+        move.e_origin = E_START_POS;
+        move.start_pos_e = 0;
+    } else {
+        const float whole = floorf(last_move.end_pos_e);
+        move.e_origin = last_move.e_origin + (int32_t)whole;
+        move.start_pos_e = last_move.end_pos_e - whole;
+    }
     move.end_pos_e = move.start_pos_e + move.distance * move.axis_r[E_AXIS];
 
     is_first = false;
@@ -46,8 +46,10 @@ class Move {
     float end_pos[AXIS_SIZE + 1];
     float axis_r[AXIS_SIZE + 1];
 
-    double start_pos_e;
-    double end_pos_e;
+    // E positions are relative to e_origin, a whole step count, so they stay exact in single precision
+    int32_t e_origin;
+    float start_pos_e;
+    float end_pos_e;
 
     time_double_t start_t = 0;
     time_double_t end_t = 0;
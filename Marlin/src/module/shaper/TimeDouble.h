@@ -26,118 +26,87 @@
 #define EPSILON 0.000001f
 #define IS_ZERO(x) (ABS(x) < EPSILON)
 
-class TimeDouble {
-  // private:
-  public:
-    int i = 0;
-    float d = 0;
+// Print time in ms as Q32.32 fixed point. Adds and compares are plain 64 bit
+// integer ops, and the resolution stays the same however long the print runs.
+#define TIME_FRAC_BITS  32
+#define TIME_ONE        4294967296.0f
+#define TIME_ONE_INV    (1.0f / TIME_ONE)
 
+class TimeFixed {
   public:
-    TimeDouble(){};
+    int64_t t = 0;
 
-    TimeDouble(int i) : i(i) {
-        this->d = 0;
+  private:
+    FORCE_INLINE static int64_t fromFloat(float d) {
+        return (int64_t)(d * TIME_ONE);
     }
 
-    TimeDouble(float d) : d(d) {
-        this->i = 0;
-        checkCarry();
-    }
+  public:
+    TimeFixed(){};
 
-    FORCE_INLINE void checkCarry() {
-        if (d >= 1) {
-            int c = d;
-            d = d - c;
-            i += c;
-        }
-        if (this->d <= -1) {
-            int c = d;
-            d = d - c + 1;
-            i += c - 1;
-        }
-    }
+    TimeFixed(int i) : t((int64_t)i << TIME_FRAC_BITS) {}
+
+    TimeFixed(float d) : t(fromFloat(d)) {}
 
-    TimeDouble& operator= (int n) {
-        i = n;
-        d = 0;
+    TimeFixed& operator= (int n) {
+        t = (int64_t)n << TIME_FRAC_BITS;
         return *this;
     }
 
-    TimeDouble& operator= (float d) {
-        this->i = 0;
-        this->d = d;
-        checkCarry();
+    TimeFixed& operator= (float d) {
+        t = fromFloat(d);
         return *this;
     }
 
-    float operator-(TimeDouble& time_double) const {
-        int res_i = (i - time_double.i);
-        float res_d = d - time_double.d;
-        return res_i + res_d;
+    float operator-(const TimeFixed& time_fixed) const {
+        return (float)(t - time_fixed.t) * TIME_ONE_INV;
     }
 
-    TimeDouble& operator+=(int i) {
-        this->i += i;
+    TimeFixed& operator+=(int i) {
+        t += (int64_t)i << TIME_FRAC_BITS;
         return *this;
     }
 
-    TimeDouble& operator+=(TimeDouble& time_double) {
-        this->i += time_double.i;
-        this->d += time_double.d;
-        checkCarry();
+    TimeFixed& operator+=(const TimeFixed& time_fixed) {
+        t += time_fixed.t;
         return *this;
     }
 
-    TimeDouble& operator+=(float d) {
-        this->d += d;
-        checkCarry();
+    TimeFixed& operator+=(float d) {
+        t += fromFloat(d);
         return *this;
     }
 
-    TimeDouble operator- (float d) const {
-        TimeDouble res;
-        res.i = this->i;
-        res.d = this->d - d;
-        res.checkCarry();
+    TimeFixed operator- (float d) const {
+        TimeFixed res;
+        res.t = t - fromFloat(d);
         return res;
     }
 
-    TimeDouble operator+(float d) const {
-        TimeDouble res;
-        res.i = this->i;
-        res.d = this->d + d;
-        res.checkCarry();
+    TimeFixed operator+(float d) const {
+        TimeFixed res;
+        res.t = t + fromFloat(d);
         return res;
     }
 
-    bool operator>(TimeDouble& time_double) const {
-        return i != time_double.i ? i > time_double.i : d > time_double.d;
-    }
+    bool operator>(const TimeFixed& time_fixed) const { return t > time_fixed.t; }
 
-    bool operator>=(TimeDouble& time_double) const {
-        return i != time_double.i ? i > time_double.i : d >= time_double.d;
-    }
+    bool operator>=(const TimeFixed& time_fixed) const { return t >= time_fixed.t; }
 
-    bool operator<(TimeDouble& time_double) const {
-        return i != time_double.i ? i < time_double.i : d < time_double.d;
-    }
+    bool operator<(const TimeFixed& time_fixed) const { return t < time_fixed.t; }
 
-    bool operator<=(TimeDouble& time_double) const {
-        return i != time_double.i ? i < time_double.i : d <= time_double.d;
-    }
+    bool operator<=(const TimeFixed& time_fixed) const { return t <= time_fixed.t; }
 
-    bool operator==(TimeDouble& time_double) const {
-        return i == time_double.i && d == time_double.d;
-    }
+    bool operator==(const TimeFixed& time_fixed) const { return t == time_fixed.t; }
 
     double toDouble() {
-        return i + d;
+        return (double)t / TIME_ONE;
     }
 
     float toFloat() {
-        return i + d;
+        return (float)t * TIME_ONE_INV;
     }
 };
 
-typedef TimeDouble time_double_t;
-// typedef double time_double_t;
\ No newline at end of file
+// The pipeline still calls it time_double_t
+typedef TimeFixed time_double_t;
@@ -1815,6 +1815,7 @@ void Stepper::pulse_phase_isr() {
       _APPLY_STEP(AXIS, _INVERT_STEP_PIN(AXIS), 0); \
   }while(0)
 
+  int8_t last_pulse_axis = -1;
   do {
       if (axis_stepper.dir > 0) {
         CBI(current_direction_bits, axis_stepper.axis);
@@ -1839,6 +1840,12 @@ void Stepper::pulse_phase_isr() {
         set_directions(current_direction_bits);
       }
 
+      // A batched step repeats the last pulse, give the driver its low time first
+      if (axis_stepper.axis == last_pulse_axis) {
+        DELAY_NS(_MIN_PULSE_LOW_NS);
+      }
+      last_pulse_axis = axis_stepper.axis;
+
       if (axis_stepper.axis == 0) {
         PULSE_START(X);
         PULSE_PREP(X);
@@ -1859,6 +1866,10 @@ void Stepper::pulse_phase_isr() {
         PULSE_STOP(E);
       }
 
+      #if ENABLED(DEBUG_STEP_JITTER)
+        axisManager.step_jitter.record(axis_stepper.axis, axis_stepper.print_time, HAL_cycle_count());
+      #endif
+
       axis_stepper.axis = -1;
   } while (axisManager.getNextZeroAxisStepper(&axis_stepper));
 
@@ -1962,23 +1973,16 @@ uint32_t Stepper::block_phase_isr() {
     // #ifdef DEBUG_IO
     //   WRITE(DEBUG_IO, 1);
     // #endif
+    hal_timer_t st = HAL_timer_get_count(STEP_TIMER_NUM);
     if (axisManager.getNextAxisStepper(&axis_stepper)) {
     // #ifdef DEBUG_IO
     //   WRITE(DEBUG_IO, 0);
     // #endif
+      hal_timer_t et = HAL_timer_get_count(STEP_TIMER_NUM);
       if (axis_stepper.delta_time < 0) {
         axis_stepper.delta_time = 0;
       }
 
-      hal_timer_t st = HAL_timer_get_count(STEP_TIMER_NUM);
-      if (axis_stepper.delta_time > 0.02) {
-        axisManager.calcNextAxisStepper();
-        axisManager.calcNextAxisStepper();
-      } else if (axis_stepper.delta_time > 0.01) {
-        axisManager.calcNextAxisStepper();
-      }
-      hal_timer_t et = HAL_timer_get_count(STEP_TIMER_NUM);
-
       interval = (uint32_t)(axis_stepper.delta_time * STEPPER_TIMER_TICKS_PER_MS);
 
       hal_timer_t dt = et - st;
@@ -1996,13 +2000,17 @@ uint32_t Stepper::block_phase_isr() {
 
       done_count = 0;
     }
+    else if (axisManager.calc_busy) {
+      // The ring ran dry while the task computes the next step, look again shortly
+      return AXIS_STEPPER_RETRY_TIME * STEPPER_TIMER_TICKS_PER_US;
+    }
     else {
 
       done_count++;
       bool is_done = true;
       for (size_t i = 0; i < AXIS_SIZE; i++) {
         if (i == 3) {
-          if (fabs(axisManager.current_steps[i] - block_move_target_steps[i] - LROUND(axisManager.axis[i].delta_e)) > 2.0) {
+          if (fabs(axisManager.current_steps[i] - block_move_target_steps[i] - LROUND(current_block->shaper_data.e_advance)) > 2.0) {
               is_done = false;
           }
         } else {
@@ -2212,7 +2220,7 @@ uint32_t Stepper::block_phase_isr() {
       for (int i = 0; i < AXIS_SIZE; ++i) {
           block_move_target_steps[i] = LROUND(end_move.end_pos[i]);
       }
-      block_move_target_steps[E_AXIS] = (int)(end_move.end_pos_e + 0.5);
+      block_move_target_steps[E_AXIS] = end_move.e_origin + LROUND(end_move.end_pos_e);
 
       // Initialize Bresenham delta errors to 1/2
       // delta_error = -int32_t(step_event_count);
@@ -2306,9 +2314,11 @@ uint32_t Stepper::block_phase_isr() {
 
       if (is_start) {
         is_start = false;
-        while (axisManager.calcNextAxisStepper()) {
+        for (uint8_t i = 0; i < AXIS_STEPPER_ISR_PREFILL && !axisManager.calc_busy && axisManager.calcNextAxisStepper(); i++) {
+        }
+        if (!axisManager.getNextAxisStepper(&axis_stepper) && axisManager.calc_busy) {
+          interval = AXIS_STEPPER_RETRY_TIME * STEPPER_TIMER_TICKS_PER_US;
         }
-        axisManager.getNextAxisStepper(&axis_stepper);
       }
 
       // interval = CEIL(axis_stepper.delta_time * STEPPER_TIMER_TICKS_PER_MS);
@@ -2357,6 +2367,11 @@ uint32_t Stepper::block_phase_isr() {
     set_directions(current_direction_bits);
   }
 
+  // The smoothed advance can leave E steps after the last block was discarded
+  if (!current_block) {
+    return interval;
+  }
+
   uint8_t axis_bits = 0;
   LINEAR_AXIS_CODE(
     if (X_MOVE_TEST)            SBI(axis_bits, A_AXIS),
@@ -1314,6 +1314,9 @@ void tool_change(const uint8_t new_tool, bool no_move/*=false*/) {
 
     planner.synchronize();
 
+    // The planner is drained here, switch to the shaper of the new tool
+    axisManager.input_shaper_select(axisManager.input_shaper_tool_profile());
+
     #if ENABLED(EXT_SOLENOID) && DISABLED(PARKING_EXTRUDER)
       disable_all_solenoids();
       enable_solenoid_on_active_extruder();
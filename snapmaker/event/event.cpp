@@ -20,6 +20,7 @@
  */
 
 #include "event.h"
+#include "event_cb_index.h"
 #include "../J1/common_type.h"
 #include "event_system.h"
 #include "event_fdm.h"
@@ -36,32 +37,43 @@ EventHandler event_handler;
 static QueueHandle_t event_queue = NULL;
 static local_event_t local_event = LE_NONE;
 static SemaphoreHandle_t le_event_lock = NULL;
+static TaskHandle_t thandle_event_recv = NULL;
+static SACP_param_t frame_pool[EVENT_FRAME_POOL_COUNT];
+static QueueHandle_t frame_pool_free = NULL;
 
-event_cb_info_t * get_event_info(uint8_t cmd_set, uint8_t cmd_id) {
-  switch (cmd_set) {
-    case COMMAND_SET_SYS:
-      return get_evevt_info_by_id(cmd_id, system_cb_info, SYS_ID_CB_COUNT);
-    case COMMAND_SET_FDM:
-      return get_evevt_info_by_id(cmd_id, fdm_cb_info, FDM_ID_CB_COUNT);
-    case COMMAND_SET_BED:
-      return get_evevt_info_by_id(cmd_id, bed_cb_info, BED_ID_CB_COUNT);
-    case COMMAND_SET_CAlIBRATION:
-      return get_evevt_info_by_id(cmd_id, calibtration_cb_info, CAlIBRATION_ID_CB_COUNT);
-    case COMMAND_SET_PRINTER:
-      return get_evevt_info_by_id(cmd_id, printer_cb_info, PRINTER_ID_CB_COUNT);
-    case COMMAND_SET_ENCLOUSER:
-      return get_evevt_info_by_id(cmd_id, enclouser_cb_info, ENCLOUSER_ID_CB_COUNT);
-    case COMMAND_SET_UPDATE:
-      return get_evevt_info_by_id(cmd_id, update_cb_info, UPDATE_ID_CB_COUNT);
-    case COMMAND_SET_EXCEPTION:
-      return get_evevt_info_by_id(cmd_id,  exception_cb_info, EXCEPTION_ID_CB_COUNT);
+static SACP_param_t * frame_pool_get() {
+  SACP_param_t *frame = NULL;
+  if (xQueueReceive(frame_pool_free, &frame, 0) != pdPASS) {
+    return NULL;
   }
-  return NULL;
+  frame->lenght = 0;
+  return frame;
+}
+
+static void frame_pool_put(SACP_param_t *frame) {
+  xQueueSend(frame_pool_free, &frame, 0);
+}
+
+// Callbacks are found through a per command set index, built at init
+static event_cb_set_t event_cb_sets[] = {
+  {COMMAND_SET_SYS, system_cb_info, SYS_ID_CB_COUNT},
+  {COMMAND_SET_FDM, fdm_cb_info, FDM_ID_CB_COUNT},
+  {COMMAND_SET_BED, bed_cb_info, BED_ID_CB_COUNT},
+  {COMMAND_SET_CAlIBRATION, calibtration_cb_info, CAlIBRATION_ID_CB_COUNT},
+  {COMMAND_SET_PRINTER, printer_cb_info, PRINTER_ID_CB_COUNT},
+  {COMMAND_SET_ENCLOUSER, enclouser_cb_info, ENCLOUSER_ID_CB_COUNT},
+  {COMMAND_SET_UPDATE, update_cb_info, UPDATE_ID_CB_COUNT},
+  {COMMAND_SET_EXCEPTION, exception_cb_info, EXCEPTION_ID_CB_COUNT},
+};
+#define EVENT_CB_SET_COUNT (sizeof(event_cb_sets) / sizeof(event_cb_sets[0]))
+
+event_cb_info_t * get_event_info(uint8_t cmd_set, uint8_t cmd_id) {
+  return event_cb_index_find(cmd_set, cmd_id);
 }
 
 void EventHandler::parse_event_info(recv_data_info_t *recv_info, event_cache_node_t *event) {
   event_param_t *param = &event->param;
-  SACP_struct_t *info = &recv_info->sacp_params.sacp;
+  SACP_struct_t *info = &recv_info->sacp_params->sacp;
   param->info.attribute = SACP_ATTR_ACK;
   param->info.command_set = info->command_set;
   param->info.command_id = info->command_id;
@@ -71,9 +83,11 @@ void EventHandler::parse_event_info(recv_data_info_t *recv_info, event_cache_nod
   param->length = info->length;
   param->length -= 8;  // Effective data length
   // SERIAL_ECHOLNPAIR("event data len:", param->length);
-  for (uint32_t i = 0; i < param->length; i++) {
-    param->data[i] = info->data[i];
-  }
+  // The payload stays in the received frame, the reply is built there too
+  param->frame = recv_info->sacp_params->buff;
+  param->data = info->data;
+  param->filter = NULL;
+  event->frame = recv_info->sacp_params;
 }
 
 event_cache_node_t * EventHandler::get_event_cache() {
@@ -108,17 +122,30 @@ ErrCode EventHandler::parse(recv_data_info_t *recv_info) {
 
   event->cb = cb_info->cb;
   if (cb_info->type == EVENT_CB_DIRECT_RUN) {
+    // Runs before the next byte is parsed, the frame can stay with the parser
     (event->cb)(event->param);
     event->block_status = EVENT_CACHT_STATUS_IDLE;
     return E_SUCCESS;
+  }
+
+  // Hand the frame to the event task and give the parser a fresh one
+  SACP_param_t *next_frame = frame_pool_get();
+  if (!next_frame) {
+    SERIAL_ECHOLN("event frame pool empty!!!");
+    send_result(event->param, E_NO_MEM);
+    event->block_status = EVENT_CACHT_STATUS_IDLE;
+    return E_NO_MEM;
+  }
+  recv_info->sacp_params = next_frame;
+
+  event->block_status = EVENT_CACHT_STATUS_WAIT;
+  if (xQueueSend(event_queue, (void *)&event, (TickType_t)0) != pdPASS ) {
+    SERIAL_ECHOLN("event cacne full!!!");
+    send_result(event->param, E_NO_MEM);
+    frame_pool_put(event->frame);
+    event->block_status = EVENT_CACHT_STATUS_IDLE;
   } else {
-    event->block_status = EVENT_CACHT_STATUS_WAIT;
-    if (xQueueSend(event_queue, (void *)&event, (TickType_t)0) != pdPASS ) {
-      SERIAL_ECHOLN("event cacne full!!!");
-      send_result(event->param, E_NO_MEM);
-    } else {
-      // LOG_I(">>> send event\r\n");
-    }
+    // LOG_I(">>> send event\r\n");
   }
   return E_PARAM;
 }
@@ -144,24 +171,41 @@ void local_event_loop() {
   xSemaphoreGive(le_event_lock);
 }
 
-void EventHandler::loop_task() {
+bool EventHandler::dispatch(TickType_t wait) {
   event_cache_node_t *event = NULL;
+  if (xQueueReceive(event_queue, &event, wait) != pdPASS) {
+    return false;
+  }
+  if (event->block_status == EVENT_CACHT_STATUS_WAIT) {
+    event->block_status = EVENT_CACHT_STATUS_BUSY;
+    (event->cb)(event->param);
+    frame_pool_put(event->frame);
+    event->block_status = EVENT_CACHT_STATUS_IDLE;
+  }
+  return true;
+}
+
+void EventHandler::loop_task() {
   while (true) {
-    if (xQueueReceive(event_queue, &event, 1 ) == pdPASS) {
-      if (event->block_status == EVENT_CACHT_STATUS_WAIT) {
-        event->block_status = EVENT_CACHT_STATUS_BUSY;
-        (event->cb)(event->param);
-        event->block_status = EVENT_CACHT_STATUS_IDLE;
-      }
-    }
+    dispatch(1);
     // printer_event_loop();
     // exception_event_loop();
     // local_event_loop();
   }
 }
 
+// Runs in the USART IRQ when a burst of bytes has been received
+static void event_recv_notify() {
+  BaseType_t woken = pdFALSE;
+  if (thandle_event_recv) {
+    vTaskNotifyGiveFromISR(thandle_event_recv, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
 void EventHandler::recv_enable(event_source_e source, bool enable) {
   event_serial[source]->enable_sacp(enable);
+  event_serial[source]->rx_notify(enable ? event_recv_notify : NULL);
   if (enable) {
     event_serial[source]->begin(115200);
   }
@@ -171,30 +215,57 @@ void EventHandler::recv_enable(event_source_e source) {
   recv_enable(source, true);
 }
 
-void EventHandler::recv_task() {
+void EventHandler::recv_init() {
+  for (uint8_t i = 0; i < EVENT_SOURCE_ALL; i++) {
+    recv_data_info[i].sacp_params = frame_pool_get();
+  }
+}
+
+bool EventHandler::recv_poll() {
   recv_data_info_t *recv_info;
-  while (true) {
-    bool need_wait = true;
-    for (uint8_t i = 0; i < EVENT_SOURCE_ALL; i++) {
-      recv_info = &recv_data_info[i];
-      if (event_serial[i]->enable_sacp()) {
-        int ch = event_read_byte[i]();
-        if (ch != -1) {
-          uint8_t data = ch&0xFF;
-          if (protocol_sacp.parse(&data, 1, recv_info->sacp_params) == E_SUCCESS) {
-            recv_info->recv_source = (event_source_e)i;
-            event_handler.parse(recv_info);
-          }
-          need_wait = false;
+  uint8_t recv_buf[64];
+  bool got_data = false;
+  for (uint8_t i = 0; i < EVENT_SOURCE_ALL; i++) {
+    recv_info = &recv_data_info[i];
+    if (event_serial[i]->enable_sacp()) {
+      uint16_t len = event_serial[i]->read(recv_buf, sizeof(recv_buf));
+      uint16_t offset = 0;
+      while (offset < len) {
+        uint16_t used = 0;
+        if (protocol_sacp.parse(recv_buf + offset, len - offset, *recv_info->sacp_params, used) == E_SUCCESS) {
+          recv_info->recv_source = (event_source_e)i;
+          event_handler.parse(recv_info);
         }
+        offset += used;
+      }
+      if (len) {
+        got_data = true;
       }
     }
+  }
+  return got_data;
+}
+
+void EventHandler::recv_task() {
+  bool got_data = false;
+  recv_init();
+  while (true) {
+    bool need_wait = !recv_poll();
     if (need_wait) {
-      vTaskDelay(pdMS_TO_TICKS(5));
+      // Woken by the RX interrupt when the line goes idle or 64 bytes are
+      // waiting. While bytes keep coming it also looks every 5ms, frames
+      // inside a burst do not wait for its end. A notify given while
+      // reading is kept, so nothing that came in meanwhile waits
+      ulTaskNotifyTake(pdTRUE, got_data ? pdMS_TO_TICKS(5) : portMAX_DELAY);
     }
+    got_data = !need_wait;
   }
 }
 
+uint8_t event_frame_pool_free() {
+  return uxQueueMessagesWaiting(frame_pool_free);
+}
+
 void event_task(void * arg) {
   event_handler.loop_task();
 }
@@ -204,9 +275,15 @@ static void event_recv_task(void * arg) {
 }
 void event_init() {
   BaseType_t ret;
+  event_cb_index_build(event_cb_sets, EVENT_CB_SET_COUNT);
   event_base_init();
   printer_event_init();
   event_queue = xQueueCreate(EVENT_CACHE_COUNT, sizeof(event_cache_node_t *));
+  frame_pool_free = xQueueCreate(EVENT_FRAME_POOL_COUNT, sizeof(SACP_param_t *));
+  configASSERT(frame_pool_free);
+  for (uint8_t i = 0; i < EVENT_FRAME_POOL_COUNT; i++) {
+    frame_pool_put(&frame_pool[i]);
+  }
 
   le_event_lock = xSemaphoreCreateMutex();
   configASSERT(le_event_lock);
@@ -222,7 +299,6 @@ void event_init() {
   }
 
 
-  TaskHandle_t thandle_event_recv;
   ret = xTaskCreate(event_recv_task, "event_recv_task", 1024, NULL, 5, &thandle_event_recv);
   if (ret != pdPASS) {
     SERIAL_ECHO("Failed to create event_recv_task!\n");
@@ -25,7 +25,9 @@
 #include "../J1/common_type.h"
 #include "../protocol/protocol_sacp.h"
 
-#define EVENT_CACHE_COUNT 6
+#define EVENT_CACHE_COUNT 7
+// Every queued event keeps its frame, plus one frame being parsed per source
+#define EVENT_FRAME_POOL_COUNT (EVENT_CACHE_COUNT + EVENT_SOURCE_ALL)
 
 typedef enum {
   EVENT_CACHT_STATUS_IDLE,
@@ -38,11 +40,12 @@ typedef struct {
   event_cache_node_status_e block_status;  // idle, wait, busy
   event_param_t param;  // Parameters to be passed into the callback function
   evevnt_cb_f cb;  // event callback
+  SACP_param_t *frame;  // Pool frame owned until the callback returns
 } event_cache_node_t;
 
 typedef struct {
   bool enable;
-  SACP_param_t sacp_params;
+  SACP_param_t *sacp_params;  // Frame being parsed, taken from the frame pool
   event_source_e recv_source;  // Event source
 } recv_data_info_t;
 
@@ -56,6 +59,11 @@ class EventHandler {
 
     void loop_task();
     void recv_task();
+    // One pass of each task: run the next queued event, waiting up to wait
+    // ticks for one, and parse what the ports received
+    bool dispatch(TickType_t wait);
+    void recv_init();
+    bool recv_poll();
     void recv_enable(event_source_e source, bool enable);
     void recv_enable(event_source_e source);
 
@@ -80,6 +88,8 @@ void event_init();
 void event_port_init();
 void local_event_loop();
 void gen_local_event(local_event_t event);
+// Frames left in the pool, neither queued with an event nor being parsed
+uint8_t event_frame_pool_free();
 
 extern EventHandler event_handler;
 #endif
@@ -20,7 +20,9 @@
  */
 
 #include "event_base.h"
+#include "event_tx.h"
 #include "../protocol/protocol_sacp.h"
+#include "../lib/GD32F1/cores/maple/wirish_time.h"
 
 HardwareSerial *event_serial[EVENT_SOURCE_ALL] = {&MSerial1, &MSerial2};
 
@@ -29,17 +31,18 @@ write_byte_f event_write_byte[EVENT_SOURCE_ALL] = {
   [](unsigned char ch)->size_t{return event_serial[EVENT_SOURCE_HMI]->write_byte(ch);},
 };
 
-static SemaphoreHandle_t event_write_lock[EVENT_SOURCE_ALL] {NULL};
+// Frames wait here until the USART TXE interrupt sends them
+static event_tx_queue_t event_tx_queue[EVENT_SOURCE_ALL];
+event_tx_stats_t event_tx_stats[EVENT_SOURCE_ALL];
 
-read_byte_f event_read_byte[EVENT_SOURCE_ALL] = {
-  []()->size_t{return event_serial[EVENT_SOURCE_MARLIN]->read();},
-  []()->size_t{return event_serial[EVENT_SOURCE_HMI]->read();},
+static int16_t (*const event_tx_pull_cb[EVENT_SOURCE_ALL])(uint8_t) = {
+  [](uint8_t start)->int16_t{return event_tx_pull(event_tx_queue[EVENT_SOURCE_MARLIN], start);},
+  [](uint8_t start)->int16_t{return event_tx_pull(event_tx_queue[EVENT_SOURCE_HMI], start);},
 };
 
 void event_base_init() {
-  for (auto &lock : event_write_lock) {
-    lock = xSemaphoreCreateMutex();
-    configASSERT(lock);
+  for (uint8_t s = 0; s < EVENT_SOURCE_ALL; s++) {
+    event_serial[s]->tx_pull(event_tx_pull_cb[s]);
   }
 }
 
@@ -54,19 +57,27 @@ event_cb_info_t * get_evevt_info_by_id(uint8_t id, event_cb_info_t *array, uint8
 }
 
 
-static bool send_to(event_source_e source, uint8_t *data, uint16_t len) {
-  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
-    if (xSemaphoreTake(event_write_lock[source], portMAX_DELAY) == pdPASS) {
-      for (int i = 0; i < len; i++) {
-        event_write_byte[source](data[i]);
-      }
-      xSemaphoreGive(event_write_lock[source]);
-
-      return true;
-    }
+// Queue the whole frame or nothing and return at once, a frame that does not
+// fit is dropped and counted. Frames of different senders never interleave
+static bool queue_frame(event_source_e source, uint8_t *data, uint16_t len) {
+  event_tx_stats_t &stats = event_tx_stats[source];
 
+  if (!event_tx_push(event_tx_queue[source], data, len)) {
+    __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
     return false;
   }
+  __atomic_fetch_add(&stats.frames, 1, __ATOMIC_RELAXED);
+  event_serial[source]->tx_kick();
+
+  uint16_t used = event_tx_used(event_tx_queue[source]);
+  NOLESS(stats.high_watermark, used);
+  return true;
+}
+
+static bool send_to(event_source_e source, uint8_t *data, uint16_t len) {
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+    return queue_frame(source, data, len);
+  }
   else {
     for (int i = 0; i < len; i++) {
       event_write_byte[source](data[i]);
@@ -88,12 +99,77 @@ bool send_data(event_source_e source, uint8_t *data, uint16_t len) {
   return true;
 }
 
-ErrCode send_event(event_param_t &event) {
-  send_event(event.source, event.info, event.data, event.length);
+// FNV-1a, only used to notice that a report changed
+static uint32_t payload_hash(uint8_t *data, uint16_t length) {
+  uint32_t hash = 2166136261u;
+  for (uint16_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash ^ length;
+}
+
+void event_filter_select(event_param_t &event, uint8_t report) {
+  if (event.filter) {
+    event.filter->report = report % EVENT_FILTER_REPORTS;
+  }
+}
+
+// Returns false when an on-change subscription report should be skipped
+static bool filter_pass(event_param_t &event, uint8_t *data, uint16_t length) {
+  event_filter_t *filter = event.filter;
+  if (!filter) {
+    return true;
+  }
+
+  uint8_t r = filter->report;
+  uint32_t hash = payload_hash(data, length);
+  uint32_t now = millis();
+  if (TEST(filter->sent, r) && hash == filter->last_hash[r] &&
+      PENDING(now, filter->last_send[r] + filter->keepalive_ms)) {
+    if (event.source < EVENT_SOURCE_ALL) {
+      event_tx_stats[event.source].suppressed++;
+      event_tx_stats[event.source].suppressed_bytes += length;
+    }
+    return false;
+  }
+
+  SBI(filter->sent, r);
+  filter->last_hash[r] = hash;
+  filter->last_send[r] = now;
+  return true;
+}
+
+// The reply is packaged around the payload already in the event frame
+static ErrCode send_frame(event_param_t &event, uint16_t length) {
+  if ((event.source < EVENT_SOURCE_ALL) && !event_serial[event.source]->enable_sacp()) {
+    return E_PARAM;
+  }
+
+  if (length > EVENT_DATA_MAX_SIZE) {
+    send_data(EVENT_SOURCE_ALL, (uint8_t *)STR_PACK_TOO_LARGE, sizeof(STR_PACK_TOO_LARGE));
+    return E_PARAM;
+  }
+
+  if (!filter_pass(event, event.data, length)) {
+    return E_SUCCESS;
+  }
+
+  uint16_t pack_len = protocol_sacp.package(event.info, length, event.frame);
+  send_data(event.source, event.frame, pack_len);
   return E_SUCCESS;
 }
 
+ErrCode send_event(event_param_t &event) {
+  return send_frame(event, event.length);
+}
+
 ErrCode send_event(event_param_t &event, uint8_t *data, uint16_t length) {
+  if (data == event.data) {
+    return send_frame(event, length);
+  }
+  if (!filter_pass(event, data, length)) {
+    return E_SUCCESS;
+  }
   send_event(event.source, event.info, data, length);
   return E_SUCCESS;
 }
@@ -108,6 +184,7 @@ ErrCode send_event(event_source_e source, SACP_head_base_t &sacp, uint8_t *data,
 
   if (length + SACP_HEADER_LEN > PACK_PARSE_MAX_SIZE) {
     send_data(EVENT_SOURCE_ALL, (uint8_t *)STR_PACK_TOO_LARGE, sizeof(STR_PACK_TOO_LARGE));
+    return E_PARAM;
   }
 
   // Package the data and call write_byte to emit the information
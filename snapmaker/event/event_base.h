@@ -29,7 +29,6 @@
 #include "MapleFreeRTOS1030.h"
 
 typedef std::function<size_t(unsigned char ch)> write_byte_f;
-typedef std::function<int(void)> read_byte_f;
 
 // System control command
 #define COMMAND_SET_SYS 0x01
@@ -59,13 +58,30 @@ typedef enum {
   EVENT_SOURCE_ALL,
 } event_source_e;
 
+// Payload room left in a frame buffer once the header and checksum are reserved
+#define EVENT_DATA_MAX_SIZE (PACK_PARSE_MAX_SIZE - SACP_HEADER_LEN)
+
+// Reports one subscription callback can send per run, one per hotend
+#define EVENT_FILTER_REPORTS 2
+
+// Lets a subscription skip reports whose payload did not change
+typedef struct {
+  uint8_t sent;  // Bit per report that went out since the subscription was set
+  uint8_t report;  // Report being sent, callbacks sending several select it
+  uint16_t keepalive_ms;  // Send even an unchanged report after this long
+  uint32_t last_hash[EVENT_FILTER_REPORTS];
+  uint32_t last_send[EVENT_FILTER_REPORTS];
+} event_filter_t;
+
 // Callback function parameters
 typedef struct {
   SACP_head_base_t info;  // Contains basic information about the SACP for replying to messages
   event_source_e source;  // hmi or marlin, used to distinguish event trigger sources
   write_byte_f write_byte;  // Callback of the send data function of the event source
   uint16_t length;  // Length of data
-  uint8_t data[PACK_PARSE_MAX_SIZE];
+  uint8_t *frame;  // Frame buffer holding data, replies are packaged in it
+  uint8_t *data;  // Payload inside frame, at most EVENT_DATA_MAX_SIZE bytes
+  event_filter_t *filter;  // Set for on-change subscriptions, NULL otherwise
 } event_param_t;
 
 //Types of event function callbacks
@@ -91,9 +107,17 @@ typedef struct {
 } event_result_t;
 #pragma pack(0)
 
+typedef struct {
+  uint32_t frames;  // Frames queued for the TX interrupt
+  uint32_t dropped;  // Frames dropped because the queue was full
+  uint16_t high_watermark;  // Most bytes seen waiting in the TX queue
+  uint32_t suppressed;  // Unchanged subscription reports not sent
+  uint32_t suppressed_bytes;  // Payload bytes of those reports
+} event_tx_stats_t;
+
 extern HardwareSerial *event_serial[EVENT_SOURCE_ALL];
+extern event_tx_stats_t event_tx_stats[EVENT_SOURCE_ALL];
 extern write_byte_f event_write_byte[EVENT_SOURCE_ALL];
-extern read_byte_f event_read_byte[EVENT_SOURCE_ALL];
 
 void event_base_init();
 // Find the corresponding event callback by id
@@ -105,6 +129,8 @@ ErrCode send_event(event_source_e source, SACP_head_base_t &sacp, uint8_t *data,
 ErrCode send_event(event_source_e source, uint8_t recever_id, uint8_t attribute, uint8_t command_set,
                    uint8_t command_id, uint8_t *data, uint16_t length, uint16_t sequence=0);
 ErrCode send_result(event_param_t &event, ErrCode result);
+// Callbacks sending one report per hotend compare each against its own last payload
+void event_filter_select(event_param_t &event, uint8_t report);
 ErrCode write_fun_register(event_source_e source, write_byte_f cb);
 bool send_data(event_source_e source, uint8_t *data, uint16_t len);
 #endif // EVENT_BASE_H
@@ -0,0 +1,114 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "event_cb_index.h"
+#include "../debug/debug.h"
+
+#define EVENT_CB_INDEX_POOL_SIZE 256
+#define EVENT_CB_INDEX_NONE 0xFF
+
+static event_cb_set_t *event_cb_sets = NULL;
+static uint8_t event_cb_set_slot[256];  // command_set -> position in event_cb_sets + 1
+static uint8_t event_cb_index_pool[EVENT_CB_INDEX_POOL_SIZE];
+
+static bool event_cb_index_fill(event_cb_set_t &set, uint8_t modulo, uint8_t *index) {
+  memset(index, EVENT_CB_INDEX_NONE, modulo);
+  for (uint8_t i = 0; i < set.count; i++) {
+    if (!set.array[i].cb) {
+      continue;  // unused tail of the array
+    }
+    uint8_t pos = set.array[i].command_id % modulo;
+    if (index[pos] != EVENT_CB_INDEX_NONE) {
+      return false;
+    }
+    index[pos] = i;
+  }
+  return true;
+}
+
+static bool event_cb_has_duplicate(event_cb_set_t &set) {
+  bool ret = false;
+  for (uint8_t i = 0; i < set.count; i++) {
+    for (uint8_t j = i + 1; j < set.count; j++) {
+      if (set.array[i].cb && set.array[j].cb && set.array[i].command_id == set.array[j].command_id) {
+        LOG_E("SNMK_ERROR: duplicate event cb: cmd_set[0x%x] cmd_id[0x%x]\n", set.command_set, set.array[i].command_id);
+        ret = true;
+      }
+    }
+  }
+  return ret;
+}
+
+void event_cb_index_build(event_cb_set_t *sets, uint8_t count) {
+  uint16_t pool_used = 0;
+  event_cb_sets = sets;
+  memset(event_cb_set_slot, 0, sizeof(event_cb_set_slot));
+  for (uint8_t s = 0; s < count; s++) {
+    event_cb_set_t &set = sets[s];
+    set.modulo = 0;
+    set.index = NULL;
+    if (event_cb_set_slot[set.command_set]) {
+      LOG_E("SNMK_ERROR: duplicate event cmd_set[0x%x]\n", set.command_set);
+      continue;
+    }
+    event_cb_set_slot[set.command_set] = s + 1;
+
+    // With duplicates the set keeps the first match of the array scan
+    if (event_cb_has_duplicate(set)) {
+      continue;
+    }
+    for (uint16_t m = set.count ? set.count : 1; m <= 0xFF && pool_used + m <= EVENT_CB_INDEX_POOL_SIZE; m++) {
+      if (event_cb_index_fill(set, m, &event_cb_index_pool[pool_used])) {
+        set.modulo = m;
+        set.index = &event_cb_index_pool[pool_used];
+        pool_used += m;
+        break;
+      }
+    }
+    if (!set.modulo) {
+      LOG_E("SNMK_ERROR: no event index for cmd_set[0x%x]\n", set.command_set);
+    }
+  }
+}
+
+event_cb_info_t * event_cb_index_find(uint8_t cmd_set, uint8_t cmd_id) {
+  uint8_t slot = event_cb_set_slot[cmd_set];
+  if (!slot) {
+    return NULL;
+  }
+
+  event_cb_set_t &set = event_cb_sets[slot - 1];
+  if (!set.modulo) {
+    for (uint8_t i = 0; i < set.count; i++) {
+      if (set.array[i].cb && set.array[i].command_id == cmd_id) {
+        return &set.array[i];
+      }
+    }
+    return NULL;
+  }
+
+  uint8_t i = set.index[cmd_id % set.modulo];
+  if (i == EVENT_CB_INDEX_NONE || set.array[i].command_id != cmd_id) {
+    return NULL;
+  }
+  return &set.array[i];
+}
@@ -0,0 +1,45 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef EVENT_CB_INDEX_H
+#define EVENT_CB_INDEX_H
+
+#include "event_base.h"
+
+// The cb_info array of a command set. The index is filled in by
+// event_cb_index_build(): index[command_id % modulo] is the position of
+// the callback in the array, modulo is the smallest size with no collision
+// for the ids of the set
+typedef struct {
+  uint8_t command_set;
+  event_cb_info_t *array;
+  uint8_t count;
+  uint8_t modulo;  // 0: no index, scan the array
+  uint8_t *index;
+} event_cb_set_t;
+
+// Build the index of every set, sets must live as long as the lookups
+void event_cb_index_build(event_cb_set_t *sets, uint8_t count);
+// Constant time lookup of a callback, NULL if there is none
+event_cb_info_t * event_cb_index_find(uint8_t cmd_set, uint8_t cmd_id);
+
+#endif // EVENT_CB_INDEX_H
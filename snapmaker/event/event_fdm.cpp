@@ -66,6 +66,7 @@ typedef struct {
 
 static ErrCode fdm_get_info(event_param_t& event) {
   uint8_t e = MODULE_INDEX(event.data[0]);
+  event_filter_select(event, e);
   event.data[0] = E_SUCCESS;
   FDM_info * info = (FDM_info *)(event.data + 1);
   fdm_head.get_fdm_info(e, info);
@@ -79,6 +80,7 @@ static ErrCode fdm_report_fan_info(event_param_t& event) {
   event.data[2] = 1;  // fan count
   extruder_fan_info_t *info = (extruder_fan_info_t *)(event.data + 3);
   HOTEND_LOOP() {
+    event_filter_select(event, e);
     event.data[1] = fdm_head.get_key(e);
     uint8_t speed;
     fdm_head.get_fan_speed(e, 0, speed);
@@ -200,6 +202,7 @@ static ErrCode fdm_subscribe_extruder_info(event_param_t& event) {
   event.data[2] = 1;  // extruder count
   extruder_info_t *info = (extruder_info_t *)(event.data + 3);
   HOTEND_LOOP() {
+    event_filter_select(event, e);
     event.data[1] = fdm_head.get_key(e);
     fdm_head.get_extruder_info(e, info);
     event.length = sizeof(extruder_info_t) + 3;
@@ -224,6 +227,7 @@ static ErrCode fdm_subscribe_extrusion_status(event_param_t& event) {
 
 static ErrCode subscribe_fdm_info(event_param_t& event) {
   HOTEND_LOOP() {
+    event_filter_select(event, e);
     event.data[0] = E_SUCCESS;
     FDM_info * info = (FDM_info *)(event.data + 1);
     fdm_head.get_fdm_info(e, info);
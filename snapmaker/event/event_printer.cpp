@@ -29,12 +29,26 @@
 #include "../module/motion_control.h"
 #include "../../../src/module/AxisManager.h"
 #include "../../Marlin/src/module/temperature.h"
+#if ENABLED(HMI_GCODE_COMPRESSION)
+  #include "../../Marlin/src/libs/heatshrink/heatshrink_config.h"
+#endif
 
 
 #define GCODE_MAX_PACK_SIZE     (450)
 #define GCODE_REQ_TIMEOUT_MS    (200)
 #define GCODE_TIMEOUT_MAX_CNT   (8)  // 25.6 second
 
+// Sliding window mode, negotiated by PRINTER_ID_SET_GCODE_WINDOW.
+// Old HMI firmware never sends it and keeps the single request mode
+#define GCODE_WINDOW_MAX_SIZE     (4)
+#define GCODE_WINDOW_MAX_LINES    (64)
+#define GCODE_WINDOW_LINE_BYTES   (24)  // initial guess of the average line length
+
+// Encoded packets, negotiated by PRINTER_ID_SET_GCODE_ENCODING. The packet on
+// the wire is still limited to GCODE_MAX_PACK_SIZE, buf_max_size of a request
+// is then the room for the decoded text
+#define GCODE_MAX_UNPACK_SIZE     (GCODE_MAX_PACK_SIZE * 3)
+
 #pragma pack(1)
 
 typedef struct {
@@ -49,6 +63,13 @@ typedef struct {
   uint16_t buf_max_size;
 } batch_gcode_req_info_t;
 
+typedef struct {
+  uint32_t line_number;
+  uint16_t buf_max_size;
+  uint16_t line_count;  // lines wanted by this request
+  uint32_t ack_line;    // every line before it has been received
+} batch_gcode_window_req_t;
+
 typedef struct {
   uint8_t flag;
   uint32_t start_line;
@@ -57,6 +78,18 @@ typedef struct {
   uint8_t data[];
 } batch_gcode_t;
 
+// batch_gcode_t once an encoding is negotiated, each packet tells how its
+// data is encoded so the HMI may still send plain text
+typedef struct {
+  uint8_t flag;
+  uint8_t encoding;
+  uint32_t start_line;
+  uint32_t end_line;
+  uint16_t data_len;
+  uint16_t raw_len;  // data_len after decoding
+  uint8_t data[];
+} batch_gcode_ext_t;
+
 typedef struct {
   uint8_t key;
   uint8_t e_count;
@@ -89,6 +122,28 @@ typedef enum {
   STATUS_PAUSE_BE_EXCEPTION = 20,
 } report_status_e;
 
+// A received packet, whatever its header
+typedef struct {
+  uint8_t flag;
+  uint8_t encoding;
+  uint32_t start_line;
+  uint32_t end_line;
+  uint16_t data_len;
+  uint16_t raw_len;
+  uint8_t *data;
+} gcode_pack_t;
+
+typedef struct {
+  bool busy;
+  bool dropped;  // answered out of order, request it again once the gap is filled
+  bool wait_room;  // the rest of a partly answered request, asked for once there is room
+  uint8_t retry;
+  uint16_t line_count;
+  uint16_t buf_size;  // decoded bytes reserved in the gcode buffer
+  uint32_t start_line;
+  uint32_t timeout;
+} gcode_window_slot_t;
+
 
 // 这里的变量应该统一结构体管理
 event_source_e print_source = EVENT_SOURCE_HMI;
@@ -101,12 +156,21 @@ uint32_t gcode_req_timeout = 0;
 uint32_t gcode_req_timeout_times = 0;
 uint32_t gcode_req_base_wait_ms = 0;
 
+uint8_t gcode_window_size = 0;  // 0: single request mode
+uint32_t gcode_window_next_line = 0;  // first line not requested yet
+uint16_t gcode_window_line_bytes = GCODE_WINDOW_LINE_BYTES;  // decoded
+uint16_t gcode_window_wire_bytes = GCODE_WINDOW_LINE_BYTES;  // as sent, encoded
+gcode_window_slot_t gcode_window[GCODE_WINDOW_MAX_SIZE];
+gcode_encoding_e gcode_encoding = GCODE_ENCODING_RAW;  // GCODE_ENCODING_RAW: batch_gcode_t packets
+
 bool start_pause_record = false;
 uint32_t start_pause_time_ms = 0;
 bool pause_hotend_tmp_down = 0;
 
 
 static void req_gcode_pack();
+static void gcode_window_fill();
+static void gcode_window_send(gcode_window_slot_t &slot);
 static void report_status_info(ErrCode status);
 static void save_event_suorce_info(event_param_t& event, bool update_get_gcode_info=false);
 
@@ -160,10 +224,148 @@ static ErrCode request_file_info(event_param_t& event) {
   return send_event(event);
 }
 
+static gcode_window_slot_t * gcode_window_find(uint32_t start_line) {
+  for (uint8_t i = 0; i < gcode_window_size; i++) {
+    if (gcode_window[i].busy && !gcode_window[i].wait_room && gcode_window[i].start_line == start_line) {
+      return &gcode_window[i];
+    }
+  }
+  return NULL;
+}
+
+static uint16_t gcode_pack_size() {
+  return gcode_encoding == GCODE_ENCODING_RAW ? GCODE_MAX_PACK_SIZE : GCODE_MAX_UNPACK_SIZE;
+}
+
+static void gcode_pack_parse(event_param_t& event, gcode_pack_t &pack) {
+  if (gcode_encoding == GCODE_ENCODING_RAW) {
+    batch_gcode_t *gcode = (batch_gcode_t *)event.data;
+    pack.flag = gcode->flag;
+    pack.encoding = GCODE_ENCODING_RAW;
+    pack.start_line = gcode->start_line;
+    pack.end_line = gcode->end_line;
+    pack.data_len = pack.raw_len = gcode->data_len;
+    pack.data = gcode->data;
+  } else {
+    batch_gcode_ext_t *gcode = (batch_gcode_ext_t *)event.data;
+    pack.flag = gcode->flag;
+    pack.encoding = gcode->encoding;
+    pack.start_line = gcode->start_line;
+    pack.end_line = gcode->end_line;
+    pack.data_len = gcode->data_len;
+    pack.raw_len = gcode->encoding == GCODE_ENCODING_RAW ? gcode->data_len : gcode->raw_len;
+    pack.data = gcode->data;
+  }
+}
+
+static ErrCode gcode_pack_push(gcode_pack_t *gcode) {
+  switch (gcode->encoding) {
+    case GCODE_ENCODING_RAW:
+      return print_control.push_gcode(gcode->start_line, gcode->end_line, gcode->data, gcode->data_len);
+    default:
+      #if ANY(HMI_GCODE_COMPRESSION, HMI_GCODE_MEATPACK, HMI_GCODE_MOTION)
+        return print_control.push_encoded_gcode((gcode_encoding_e)gcode->encoding, gcode->start_line, gcode->end_line, gcode->data, gcode->data_len, gcode->raw_len);
+      #else
+        LOG_E("unknown gcode encoding:%d\n", gcode->encoding);
+        return E_PARAM;
+      #endif
+  }
+}
+
+static ErrCode gcode_window_pack_deal(gcode_pack_t *gcode) {
+  if (gcode_req_status == GCODE_PACK_REQ_IDLE || gcode_req_status == GCODE_PACK_REQ_DONE) {
+    // paused or stopped, the lines in flight will be requested again on resume
+    return E_SUCCESS;
+  }
+
+  gcode_window_slot_t *slot = gcode_window_find(gcode->start_line);
+  if (!slot) {
+    // a late answer of a request which has been served already
+    LOG_V("gcode window drop stale line:%u\n", gcode->start_line);
+    return E_SUCCESS;
+  }
+
+  if (gcode->start_line != print_control.next_req_line()) {
+    // an earlier request is still missing, keep the slot and ask again later
+    slot->dropped = true;
+    return E_SUCCESS;
+  }
+
+  if (gcode->flag != PRINT_RESULT_GCODE_RECV_DONE_E && gcode->end_line < gcode->start_line) {
+    LOG_E("gcode window bad lines start:%u end:%u\n", gcode->start_line, gcode->end_line);
+    gcode_window_send(*slot);
+    return E_PARAM;
+  }
+
+  ErrCode ret = gcode_pack_push(gcode);
+  if (gcode->flag == PRINT_RESULT_GCODE_RECV_DONE_E) {
+    for (uint8_t i = 0; i < gcode_window_size; i++) {
+      gcode_window[i].busy = false;
+    }
+    gcode_req_status = GCODE_PACK_REQ_DONE;
+    SERIAL_ECHOLN("SC gcoce pack recv done");
+    return E_SUCCESS;
+  }
+
+  if (E_SUCCESS != ret) {
+    gcode_window_send(*slot);
+    return ret;
+  }
+
+  uint32_t lines = gcode->end_line - gcode->start_line + 1;
+  gcode_window_line_bytes = (gcode_window_line_bytes * 3 + gcode->raw_len / lines + 3) / 4;
+  NOLESS(gcode_window_line_bytes, 1);
+  gcode_window_wire_bytes = (gcode_window_wire_bytes * 3 + gcode->data_len / lines + 3) / 4;
+  NOLESS(gcode_window_wire_bytes, 1);
+  gcode_req_base_wait_ms = 0;
+
+  // Whatever the packet covered is done, also in the slots after this one
+  // when the HMI sent past the requested end line. A slot only partly
+  // covered asks for the rest of its range.
+  uint32_t next_line = gcode->end_line + 1;
+  for (uint8_t i = 0; i < gcode_window_size; i++) {
+    gcode_window_slot_t &s = gcode_window[i];
+    uint32_t slot_end = s.start_line + s.line_count;
+    if (!s.busy || s.start_line >= next_line) {
+      continue;
+    }
+    if (slot_end <= next_line) {
+      s.busy = false;
+    } else {
+      s.start_line = next_line;
+      s.line_count = slot_end - next_line;
+      s.retry = 0;
+      if (&s == slot) {
+        // the packet was written into the room of this slot
+        s.buf_size = 0;
+        s.dropped = false;
+        s.wait_room = true;
+      } else {
+        gcode_window_send(s);
+      }
+    }
+  }
+  NOLESS(gcode_window_next_line, next_line);
+
+  for (uint8_t i = 0; i < gcode_window_size; i++) {
+    if (gcode_window[i].busy && gcode_window[i].dropped &&
+        gcode_window[i].start_line == print_control.next_req_line()) {
+      gcode_window_send(gcode_window[i]);
+    }
+  }
+  gcode_window_fill();
+  return E_SUCCESS;
+}
+
 static ErrCode gcode_pack_deal(event_param_t& event) {
   ErrCode ret;
-  batch_gcode_t *gcode = (batch_gcode_t *)event.data;
-  ret = print_control.push_gcode(gcode->start_line, gcode->end_line, gcode->data, gcode->data_len);
+  gcode_pack_t pack;
+  gcode_pack_t *gcode = &pack;
+  gcode_pack_parse(event, pack);
+  if (gcode_window_size) {
+    return gcode_window_pack_deal(gcode);
+  }
+  ret = gcode_pack_push(gcode);
   if (gcode->flag == PRINT_RESULT_GCODE_RECV_DONE_E) {
     gcode_req_status = GCODE_PACK_REQ_DONE;
     SERIAL_ECHOLN("SC gcoce pack recv done");
@@ -386,6 +588,7 @@ static ErrCode set_temperature_lock(event_param_t& event) {
 static ErrCode get_temperature_lock(event_param_t& event) {
   uint8_t key = event.data[0];
   uint8_t e = MODULE_INDEX(key);
+  event_filter_select(event, e);
   uint8_t lock = print_control.temperature_lock(e);
   uint8_t index = 0;
   SERIAL_ECHOLNPAIR("SC get temp lock T:", e," statue:", lock);
@@ -428,6 +631,67 @@ static ErrCode get_noise_mode(event_param_t& event) {
   return send_event(event);
 }
 
+static ErrCode set_gcode_window(event_param_t& event) {
+  if (system_service.is_working()) {
+    event.data[0] = E_INVALID_STATE;
+    event.length = 1;
+    return send_event(event);
+  }
+  gcode_window_size = event.data[0];
+  NOMORE(gcode_window_size, GCODE_WINDOW_MAX_SIZE);
+  LOG_I("SC set gcode window:%d\n", gcode_window_size);
+  event.data[0] = E_SUCCESS;
+  event.data[1] = gcode_window_size;
+  event.length = 2;
+  return send_event(event);
+}
+
+static ErrCode set_gcode_encoding(event_param_t& event) {
+  if (system_service.is_working()) {
+    event.data[0] = E_INVALID_STATE;
+    event.length = 1;
+    return send_event(event);
+  }
+  switch (event.data[0]) {
+    #if ENABLED(HMI_GCODE_COMPRESSION)
+      case GCODE_ENCODING_HEATSHRINK:
+    #endif
+    #if ENABLED(HMI_GCODE_MEATPACK)
+      case GCODE_ENCODING_MEATPACK:
+      case GCODE_ENCODING_MEATPACK_NSP:
+    #endif
+    case GCODE_ENCODING_RAW:
+      gcode_encoding = (gcode_encoding_e)event.data[0];
+      break;
+    #if ENABLED(HMI_GCODE_MOTION)
+      case GCODE_ENCODING_MOTION:
+        // followed by the decimal digits of the XYZ, E and F record values of the file
+        if (event.length >= 4 && print_control.set_motion_scale(event.data[1], event.data[2], event.data[3])) {
+          gcode_encoding = GCODE_ENCODING_MOTION;
+        } else {
+          gcode_encoding = GCODE_ENCODING_RAW;
+        }
+        break;
+    #endif
+    default:
+      // not supported, the HMI falls back to plain text
+      gcode_encoding = GCODE_ENCODING_RAW;
+      break;
+  }
+  LOG_I("SC set gcode encoding:%d\n", gcode_encoding);
+  event.data[0] = E_SUCCESS;
+  event.data[1] = gcode_encoding;
+  #if ENABLED(HMI_GCODE_COMPRESSION)
+    // the HMI must compress with the decoder's window and lookahead
+    event.data[2] = HEATSHRINK_STATIC_WINDOW_BITS;
+    event.data[3] = HEATSHRINK_STATIC_LOOKAHEAD_BITS;
+  #else
+    event.data[2] = event.data[3] = 0;
+  #endif
+  event.length = 4;
+  return send_event(event);
+}
+
 static ErrCode get_work_feedrate(event_param_t& event) {
   event.data[0] = E_SUCCESS;
   uint16_t *fr = (uint16_t *)&event.data[1];
@@ -471,6 +735,7 @@ static ErrCode set_work_flow_percentage(event_param_t& event) {
 static ErrCode get_work_flow_percentage(event_param_t& event) {
   uint8_t key = event.data[0];
   uint8_t e = MODULE_INDEX(key);
+  event_filter_select(event, e);
   flow_percentage_t *info = (flow_percentage_t *)(event.data + 1);
   info->key = key;
   info->e_index = 1;  //  extruder count
@@ -483,6 +748,7 @@ static ErrCode get_work_flow_percentage(event_param_t& event) {
 
 static ErrCode subscribe_flow_percentage(event_param_t& event) {
   HOTEND_LOOP() {
+    event_filter_select(event, e);
     flow_percentage_t *info = (flow_percentage_t *)(event.data + 1);
     info->key = fdm_head.get_key(e);
     info->e_index = 1;  //  extruder count
@@ -537,6 +803,8 @@ event_cb_info_t printer_cb_info[PRINTER_ID_CB_COUNT] = {
   {PRINTER_ID_GET_FDM_ENABLE          , EVENT_CB_DIRECT_RUN, get_fdm_enable},
   {PRINTER_ID_SET_NOISE_MODE          , EVENT_CB_DIRECT_RUN, set_noise_mode},
   {PRINTER_ID_GET_NOISE_MODE          , EVENT_CB_DIRECT_RUN, get_noise_mode},
+  {PRINTER_ID_SET_GCODE_WINDOW        , EVENT_CB_TASK_RUN,   set_gcode_window},
+  {PRINTER_ID_SET_GCODE_ENCODING      , EVENT_CB_TASK_RUN,   set_gcode_encoding},
   {PRINTER_ID_REQ_LINE                , EVENT_CB_DIRECT_RUN, request_cur_line},
   {PRINTER_ID_SUBSCRIBE_PRINT_MODE    , EVENT_CB_DIRECT_RUN, subscribe_print_mode},
   {PRINTER_ID_GET_WORK_FEEDRATE       , EVENT_CB_DIRECT_RUN, get_work_feedrate},
@@ -545,13 +813,116 @@ event_cb_info_t printer_cb_info[PRINTER_ID_CB_COUNT] = {
   {PRINTER_ID_SUBSCRIBE_WORK_TIME    , EVENT_CB_DIRECT_RUN, subscribe_work_time},
 };
 
+static void gcode_window_send(gcode_window_slot_t &slot) {
+  batch_gcode_window_req_t info;
+  info.line_number = slot.start_line;
+  info.buf_max_size = slot.buf_size;
+  info.line_count = slot.line_count;
+  info.ack_line = print_control.next_req_line();
+  send_event(rep_gcode_source, rep_gcode_recever_id, SACP_ATTR_REQ,
+      COMMAND_SET_PRINTER, PRINTER_ID_REQ_GCODE, (uint8_t *)&info, sizeof(info));
+  slot.busy = true;
+  slot.dropped = false;
+  slot.wait_room = false;
+  slot.timeout = millis() + (GCODE_REQ_TIMEOUT_MS<<slot.retry) + gcode_req_base_wait_ms;
+  LOG_V("gcode window requst line:%u, count:%u, try: %d count\n", info.line_number, info.line_count, slot.retry);
+}
+
+// Decoded bytes reserved for a request of lines, at least a whole line
+static uint16_t gcode_window_buf_size(uint16_t lines) {
+  uint32_t buf_size = (uint32_t)gcode_window_line_bytes * lines * 5 / 4;
+  LIMIT(buf_size, (uint32_t)MAX_CMD_SIZE, (uint32_t)gcode_pack_size());
+  return buf_size;
+}
+
+// Keep up to gcode_window_size requests in flight, each one has its
+// own room reserved in the gcode buffer. A request asks for the lines
+// that fill about 3/4 of a packet on the wire, and reserves what they
+// are measured to decode to, with a quarter more as margin.
+static void gcode_window_fill() {
+  uint8_t in_flight = 0;
+  uint32_t reserved = 0;
+  for (uint8_t i = 0; i < gcode_window_size; i++) {
+    if (gcode_window[i].busy) {
+      in_flight++;
+      reserved += gcode_window[i].buf_size;
+    }
+  }
+
+  // The rest of a partly answered request comes first, new lines wait for it
+  for (uint8_t i = 0; i < gcode_window_size; i++) {
+    gcode_window_slot_t &slot = gcode_window[i];
+    if (!slot.busy || !slot.wait_room) {
+      continue;
+    }
+    uint16_t buf_size = gcode_window_buf_size(slot.line_count);
+    if (print_control.get_buf_free() < reserved + buf_size) {
+      gcode_req_status = GCODE_PACK_REQ_WAIT_RECV;
+      return;
+    }
+    slot.buf_size = buf_size;
+    reserved += buf_size;
+    gcode_window_send(slot);
+  }
+
+  for (uint8_t i = 0; i < gcode_window_size; i++) {
+    gcode_window_slot_t &slot = gcode_window[i];
+    if (slot.busy) {
+      continue;
+    }
+    uint16_t lines = (GCODE_MAX_PACK_SIZE * 3 / 4) / gcode_window_wire_bytes;
+    LIMIT(lines, 1, GCODE_WINDOW_MAX_LINES);
+    uint16_t buf_size = gcode_window_buf_size(lines);
+    if (print_control.get_buf_free() < reserved + buf_size) {
+      break;
+    }
+    slot.start_line = gcode_window_next_line;
+    slot.line_count = lines;
+    slot.buf_size = buf_size;
+    slot.retry = 0;
+    gcode_window_next_line += lines;
+    gcode_window_send(slot);
+    in_flight++;
+    reserved += buf_size;
+  }
+
+  gcode_req_status = in_flight ? GCODE_PACK_REQ_WAIT_RECV : GCODE_PACK_REQ_WAIT_CACHE;
+}
+
+static void gcode_window_timeout_deal() {
+  for (uint8_t i = 0; i < gcode_window_size; i++) {
+    gcode_window_slot_t &slot = gcode_window[i];
+    if (!slot.busy || slot.wait_room || !ELAPSED(millis(), slot.timeout)) {
+      continue;
+    }
+    extern uint32_t statistics_gcode_timeout_cnt;
+    statistics_gcode_timeout_cnt++;
+    LOG_E("requst gcode line %u timeout!\n", slot.start_line);
+    if (++slot.retry > GCODE_TIMEOUT_MAX_CNT) {
+      print_control.error_and_stop();
+      return;
+    }
+    gcode_window_send(slot);
+  }
+}
+
 static void req_gcode_pack() {
   batch_gcode_req_info_t info;
+  if (gcode_window_size) {
+    // (re)start streaming from the line the buffer is expecting
+    for (uint8_t i = 0; i < gcode_window_size; i++) {
+      gcode_window[i].busy = false;
+    }
+    gcode_window_next_line = print_control.next_req_line();
+    gcode_window_fill();
+    return;
+  }
+
   uint16_t free_buf = print_control.get_buf_free();
   // SERIAL_ECHOLNPAIR("gcode buf free:", free_buf);
-  if (free_buf >= GCODE_MAX_PACK_SIZE) {
+  if (free_buf >= gcode_pack_size()) {
     info.line_number = print_control.next_req_line();
-    info.buf_max_size = GCODE_MAX_PACK_SIZE;
+    info.buf_max_size = gcode_pack_size();
     // send_event(print_source, source_recever_id, SACP_ATTR_REQ,
     send_event(rep_gcode_source, rep_gcode_recever_id, SACP_ATTR_REQ,
         COMMAND_SET_PRINTER, PRINTER_ID_REQ_GCODE, (uint8_t *)&info, sizeof(info));
@@ -662,10 +1033,18 @@ void printing_status_deal() {
 
   switch (gcode_req_status) {
     case GCODE_PACK_REQ_WAIT_CACHE:
-      req_gcode_pack();
+      if (gcode_window_size)
+        gcode_window_fill();
+      else
+        req_gcode_pack();
       break;
     case GCODE_PACK_REQ_WAIT_RECV:
-      gcode_req_timeout_deal();
+      if (gcode_window_size) {
+        gcode_window_timeout_deal();
+        gcode_window_fill();
+      } else {
+        gcode_req_timeout_deal();
+      }
       break;
     case GCODE_PACK_REQ_DONE:
       wait_print_end();
@@ -707,7 +1086,7 @@ void resuming_status_deal() {
   }
   SERIAL_ECHOLNPAIR("resume work success, ret:", result);
   data[0] = result;
-  info->buf_max_size = GCODE_MAX_PACK_SIZE;
+  info->buf_max_size = gcode_pack_size();
   info->line_number = print_control.next_req_line();
   send_event(print_source, source_recever_id, SACP_ATTR_ACK,
     COMMAND_SET_PRINTER, PRINTER_ID_RESUME_WORK, data, 7, source_sequence);
@@ -47,6 +47,8 @@ enum {
   PRINTER_ID_GET_FDM_ENABLE       = 0x19,
   PRINTER_ID_SET_NOISE_MODE       = 0x1c,
   PRINTER_ID_GET_NOISE_MODE       = 0x1d,
+  PRINTER_ID_SET_GCODE_WINDOW     = 0x1e,
+  PRINTER_ID_SET_GCODE_ENCODING   = 0x1f,
   PRINTER_ID_REQ_LINE             = 0xA0,
   PRINTER_ID_SUBSCRIBE_PRINT_MODE = 0xA1,
   PRINTER_ID_GET_WORK_FEEDRATE    = 0xA2,
@@ -55,7 +57,7 @@ enum {
   PRINTER_ID_SUBSCRIBE_WORK_TIME        = 0xA5,
 };
 
-#define PRINTER_ID_CB_COUNT 28
+#define PRINTER_ID_CB_COUNT 30
 
 extern event_cb_info_t printer_cb_info[PRINTER_ID_CB_COUNT];
 void printer_event_init(void);
@@ -0,0 +1,78 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "event_tx.h"
+#include <string.h>
+
+#define EVENT_TX_MOD(n) ((n) & (EVENT_TX_QUEUE_SIZE - 1))
+
+bool event_tx_push(event_tx_queue_t &queue, const uint8_t *data, uint16_t len) {
+  if (!len) {
+    return true;
+  }
+  const uint32_t need = EVENT_TX_HEADER_LEN + len;
+  uint32_t start = __atomic_load_n(&queue.reserve, __ATOMIC_RELAXED);
+  do {
+    if (need > EVENT_TX_QUEUE_SIZE - (start - __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE))) {
+      return false;
+    }
+  } while (!__atomic_compare_exchange_n(&queue.reserve, &start, start + need, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+  queue.buf[EVENT_TX_MOD(start + 1)] = len & 0xFF;
+  queue.buf[EVENT_TX_MOD(start + 2)] = len >> 8;
+  const uint32_t pos = EVENT_TX_MOD(start + EVENT_TX_HEADER_LEN);
+  const uint32_t first = pos + len > EVENT_TX_QUEUE_SIZE ? EVENT_TX_QUEUE_SIZE - pos : len;
+  memcpy(&queue.buf[pos], data, first);
+  memcpy(queue.buf, data + first, len - first);
+
+  // Publishes the frame, the bytes above are seen before the mark
+  __atomic_store_n(&queue.buf[EVENT_TX_MOD(start)], 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+int16_t event_tx_pull(event_tx_queue_t &queue, bool start) {
+  uint32_t tail = queue.tail;
+  if (!queue.left) {
+    if (!start || tail == __atomic_load_n(&queue.reserve, __ATOMIC_ACQUIRE)) {
+      return -1;
+    }
+    if (!__atomic_load_n(&queue.buf[EVENT_TX_MOD(tail)], __ATOMIC_ACQUIRE)) {
+      return -1;  // Its producer is still copying
+    }
+    queue.left = queue.buf[EVENT_TX_MOD(tail + 1)] | (queue.buf[EVENT_TX_MOD(tail + 2)] << 8);
+    for (uint8_t i = 0; i < EVENT_TX_HEADER_LEN; i++) {
+      queue.buf[EVENT_TX_MOD(tail + i)] = 0;
+    }
+    tail += EVENT_TX_HEADER_LEN;
+  }
+
+  uint8_t *byte = &queue.buf[EVENT_TX_MOD(tail)];
+  const uint8_t c = *byte;
+  *byte = 0;
+  queue.left--;
+  // The zeroed bytes are seen before the room is given back
+  __atomic_store_n(&queue.tail, tail + 1, __ATOMIC_RELEASE);
+  return c;
+}
+
+uint32_t event_tx_used(event_tx_queue_t &queue) {
+  return __atomic_load_n(&queue.reserve, __ATOMIC_RELAXED) - __atomic_load_n(&queue.tail, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,53 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENT_TX_H
+#define EVENT_TX_H
+
+#include <stdint.h>
+
+// Bytes of a TX queue, a power of 2
+#define EVENT_TX_QUEUE_SIZE 1024
+// A frame is queued behind its ready mark and its length
+#define EVENT_TX_HEADER_LEN 3
+
+// The frames waiting to go out on one port. Any number of tasks push, each
+// claims room with one compare and swap and copies its frame in, nobody waits:
+// without room the frame is dropped. The USART TX interrupt is the only one to
+// pull, it starts a frame once its producer set the ready mark and sends it
+// whole, so frames never interleave. Bytes are zeroed as they are pulled, a
+// claimed frame reads as not ready until its producer is done
+typedef struct {
+  uint32_t reserve;  // Bytes claimed by producers, free running
+  uint32_t tail;  // Bytes pulled, free running, written by the consumer only
+  uint16_t left;  // Bytes of the frame being pulled, consumer only
+  uint8_t buf[EVENT_TX_QUEUE_SIZE];
+} event_tx_queue_t;
+
+// Queue the whole frame or nothing, never blocks
+bool event_tx_push(event_tx_queue_t &queue, const uint8_t *data, uint16_t len);
+// The next byte to send, -1 when there is none. A new frame only starts when
+// start is set, so the caller can finish what else it is sending first
+int16_t event_tx_pull(event_tx_queue_t &queue, bool start);
+// Bytes claimed and not pulled yet
+uint32_t event_tx_used(event_tx_queue_t &queue);
+
+#endif // EVENT_TX_H
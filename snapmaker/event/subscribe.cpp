@@ -34,12 +34,21 @@ Subscribe subscribe;
 extern event_cb_info_t * get_event_info(uint8_t cmd_set, uint8_t cmd_id);
 
 static event_param_t event_public_param;
+static SACP_param_t event_public_frame;
 
-ErrCode Subscribe::enable(event_param_t &event) {
-  if (sub_count >= MAX_SUBSCRIBE_COUNT) {
-    SERIAL_ECHOLNPAIR("SNMK_ERROR: subscribe count to max:", sub_count);
-    return E_NO_MEM;
+int8_t Subscribe::find(uint8_t cmd_set, uint8_t cmd_id, event_param_t &event) {
+  for (uint8_t i = 0; i < sub_count; i++) {
+    if (sub[i].info.command_set == cmd_set &&
+        (sub[i].info.command_id == cmd_id) &&
+        (sub[i].info.recever_id == event.info.recever_id) &&
+        (sub[i].source == event.source)) {
+      return i;
+    }
   }
+  return -1;
+}
+
+ErrCode Subscribe::enable(event_param_t &event) {
   if (event.length < 4) {
     SERIAL_ECHOLNPAIR("SNMK_ERROR: subscribe param len faile:", event.length);
     return E_PARAM;
@@ -53,30 +62,52 @@ ErrCode Subscribe::enable(event_param_t &event) {
     SERIAL_ECHOLNPAIR("SNMK_ERROR:heve no cmd_set:", cmd_set, ", cmd_id:", cmd_id);
     return E_PARAM;
   }
-  uint8_t index = 0;
-  for (; index < sub_count; index++) {
-    if (sub[index].info.command_set == cmd_set &&
-        (sub[index].info.command_id == cmd_id) &&
-        (sub[index].info.recever_id == event.info.recever_id) &&
-        (sub[index].source == event.source)) {
-      break;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  int8_t index = find(cmd_set, cmd_id, event);
+  if (index < 0) {
+    if (sub_count >= MAX_SUBSCRIBE_COUNT) {
+      xSemaphoreGive(lock);
+      SERIAL_ECHOLNPAIR("SNMK_ERROR: subscribe count to max:", sub_count);
+      return E_NO_MEM;
     }
+    index = sub_count++;
   }
-  if (index == sub_count) {
-    sub_count++;
-  }
-  sub[index].info = event.info;
-  sub[index].info.command_set = cmd_set;
-  sub[index].info.command_id = cmd_id;
+  subscribe_node_t &node = sub[index];
+  node.info = event.info;
+  node.info.command_set = cmd_set;
+  node.info.command_id = cmd_id;
 
-  sub[index].cb = tmp_cb->cb;
+  node.cb = tmp_cb->cb;
   uint16_t tmp_time = data[3] << 8 | data[2];
-  sub[index].time_interval = tmp_time;
-  sub[index].last_time = millis();
-  sub[index].write_byte = event.write_byte;
-  sub[index].source = event.source;
-  sub[index].is_available = true;
+  NOLESS(tmp_time, SUBSCRIBE_MIN_INTERVAL_MS);
+  node.time_interval = tmp_time;
+  node.write_byte = event.write_byte;
+  node.source = event.source;
+
+  // Optional: flags, then the keepalive period for on-change delivery
+  node.on_change = (event.length >= 5) && (data[4] & SUBSCRIBE_FLAG_ON_CHANGE);
+  node.filter.sent = 0;
+  node.filter.report = 0;
+  node.filter.keepalive_ms = SUBSCRIBE_KEEPALIVE_MS;
+  if (event.length >= 7) {
+    node.filter.keepalive_ms = data[6] << 8 | data[5];
+    NOLESS(node.filter.keepalive_ms, tmp_time);
+  }
+
+  // Share the wakeup of a subscription with the same period, otherwise report now
+  node.next_time = millis();
+  for (uint8_t i = 0; i < sub_count; i++) {
+    if (i != index && sub[i].time_interval == tmp_time) {
+      node.next_time = sub[i].next_time;
+      break;
+    }
+  }
+  xSemaphoreGive(lock);
 
+  if (task) {
+    xTaskNotifyGive(task);
+  }
   return E_SUCCESS;
 }
 
@@ -88,40 +119,112 @@ ErrCode Subscribe::disable(event_param_t &event) {
   uint8_t *data = event.data;
   uint8_t cmd_set = data[0];
   uint8_t cmd_id = data[1];
-  uint8_t index = 0;
   SERIAL_ECHOPAIR("unsubscribe set:", cmd_set, ", id:", cmd_id);
-  for (; index < sub_count; index++) {
-    if (sub[index].info.command_set == cmd_set &&
-        (sub[index].info.command_id == cmd_id) &&
-        (sub[index].info.recever_id == event.info.recever_id) &&
-        (sub[index].source == event.source)) {
-      sub[index].is_available = false;
-      SERIAL_ECHOLN(" success");
-      return E_SUCCESS;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  int8_t index = find(cmd_set, cmd_id, event);
+  if (index >= 0) {
+    // Keep the table packed so the loop only walks live subscriptions
+    sub_count--;
+    if (index != sub_count) {
+      sub[index] = sub[sub_count];
     }
+    sub[sub_count].cb = nullptr;
+  }
+  xSemaphoreGive(lock);
+
+  if (index >= 0) {
+    SERIAL_ECHOLN(" success");
+    return E_SUCCESS;
   }
   SERIAL_ECHOLN(" failed");
   return E_PARAM;
 }
 
-void Subscribe::loop_task(void * arg) {
-  while (true) {
-    for (uint8_t i = 0; i < sub_count; i++) {
-      if (sub[i].is_available) {
-        // if (sub[i].last_time < millis()) {
-        // LOG_I("SB_LOOP: index %i, cur %d, to %d\r\n", i, millis(), sub[i].last_time);
-        if (ELAPSED(millis(), sub[i].last_time)) {
-          sub[i].last_time = millis() + sub[i].time_interval;
-          sub[i].info.sequence = protocol_sacp.sequence_pop();
-          event_public_param.write_byte = sub[i].write_byte;
-          event_public_param.info = sub[i].info;
-          event_public_param.source = sub[i].source;
-          event_public_param.length = 0;
-          (sub[i].cb)(event_public_param);
-        }
+// Run every subscription that is due and return the ms until the next one
+uint32_t Subscribe::run_due(uint32_t now) {
+  uint32_t wait_ms = SUBSCRIBE_IDLE_WAIT_MS;
+  subscribe_node_t node;
+
+  for (uint8_t i = 0; ; i++) {
+    // Only copy the due node under the lock, a callback can block on the TX ring
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (i < sub_count && !ELAPSED(now, sub[i].next_time)) {
+      i++;
+    }
+    if (i >= sub_count) {
+      xSemaphoreGive(lock);
+      break;
+    }
+    sub[i].info.sequence = protocol_sacp.sequence_pop();
+    // Step by the period so subscriptions sharing it stay together
+    sub[i].next_time += sub[i].time_interval;
+    if (ELAPSED(now, sub[i].next_time)) {
+      sub[i].next_time = now + sub[i].time_interval;
+    }
+    node = sub[i];
+    xSemaphoreGive(lock);
+
+    event_public_param.write_byte = node.write_byte;
+    event_public_param.info = node.info;
+    event_public_param.source = node.source;
+    event_public_param.length = 0;
+    event_public_param.filter = node.on_change ? &node.filter : NULL;
+    (node.cb)(event_public_param);
+    reports++;
+
+    if (node.on_change) {
+      // Keep what the filter saw, unless the node was removed meanwhile
+      xSemaphoreTake(lock, portMAX_DELAY);
+      if (i < sub_count && sub[i].source == node.source &&
+          sub[i].info.command_set == node.info.command_set &&
+          sub[i].info.command_id == node.info.command_id &&
+          sub[i].info.recever_id == node.info.recever_id) {
+        sub[i].filter = node.filter;
       }
+      xSemaphoreGive(lock);
     }
   }
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  now = millis();
+  for (uint8_t i = 0; i < sub_count; i++) {
+    int32_t left = (int32_t)(sub[i].next_time - now);
+    if (left <= 0) {
+      wait_ms = 0;
+    } else {
+      NOMORE(wait_ms, (uint32_t)left);
+    }
+  }
+  xSemaphoreGive(lock);
+  return wait_ms;
+}
+
+void Subscribe::loop_task(void * arg) {
+  while (true) {
+    uint32_t wait_ms = run_due(millis());
+    uint32_t start = millis();
+    // Sleep to the earliest deadline, enable() wakes us up early
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+    sleep_ms += millis() - start;
+    wakeups++;
+  }
+}
+
+void Subscribe::report_stats() {
+  LOG_I("subscribe count: %d, wakeups: %u, reports: %u, sleep ms: %u\r\n",
+    sub_count, wakeups, reports, sleep_ms);
+}
+
+void Subscribe::init() {
+  event_public_param.frame = event_public_frame.buff;
+  event_public_param.data = event_public_frame.sacp.data;
+  lock = xSemaphoreCreateMutex();
+  configASSERT(lock);
+}
+
+void Subscribe::set_task(TaskHandle_t handle) {
+  task = handle;
 }
 
 static void subscribe_task(void * arg) {
@@ -130,14 +233,14 @@ static void subscribe_task(void * arg) {
 
 void subscribe_init(void) {
 
+  subscribe.init();
   TaskHandle_t thandle_subscribe = NULL;
   BaseType_t ret = xTaskCreate(subscribe_task, "subscribe_loop", 1024, NULL, 5, &thandle_subscribe);
   if (ret != pdPASS) {
     SERIAL_ECHO("Failed to create subscribe_loop!\n");
   }
   else {
+    subscribe.set_task(thandle_subscribe);
     SERIAL_ECHO("Created subscribe_loop task!\n");
   }
 }
-
-
@@ -27,12 +27,21 @@
 #include "event_base.h"
 
 #define MAX_SUBSCRIBE_COUNT 30
+// Shortest report period, a period of 0 would keep the task busy
+#define SUBSCRIBE_MIN_INTERVAL_MS 10
+// Longest sleep when nothing is subscribed
+#define SUBSCRIBE_IDLE_WAIT_MS 1000
+// Subscribe payload flags, byte 4
+#define SUBSCRIBE_FLAG_ON_CHANGE 0x01  // Only report when the payload changed
+// Unchanged on-change reports are still sent this often, unless bytes 5-6 say otherwise
+#define SUBSCRIBE_KEEPALIVE_MS 5000
 
 typedef struct {
-  bool is_available;
   event_source_e source;
   uint16_t time_interval;
-  uint32_t last_time;
+  uint32_t next_time;  // millis() of the next report
+  bool on_change;
+  event_filter_t filter;
   SACP_head_base_t info;
   write_byte_f write_byte;
   evevnt_cb_f cb;
@@ -43,9 +52,21 @@ class Subscribe {
     ErrCode enable(event_param_t &event);
     ErrCode disable(event_param_t &event);
     void loop_task(void *arg);
+    void init();
+    void set_task(TaskHandle_t handle);
+    void report_stats();
+    // One pass of the task
+    uint32_t run_due(uint32_t now);
+  private:
+    int8_t find(uint8_t cmd_set, uint8_t cmd_id, event_param_t &event);
   private:
     subscribe_node_t sub[MAX_SUBSCRIBE_COUNT];
     uint8_t sub_count;
+    SemaphoreHandle_t lock = NULL;
+    TaskHandle_t task = NULL;
+    uint32_t wakeups = 0;  // Times the task woke up
+    uint32_t reports = 0;  // Callbacks run
+    uint32_t sleep_ms = 0;  // Time spent blocked instead of polling
 };
 void subscribe_init(void);
 extern Subscribe subscribe;
@@ -20,6 +20,7 @@
  */
 
 #include "../../event/event.h"
+#include "../../event/subscribe.h"
 #include "../../debug/debug.h"
 #include "../../../Marlin/src/core/macros.h"
 #include "../../../Marlin/src/gcode/gcode.h"
@@ -117,6 +118,40 @@ void GcodeSuite::M2000() {
     }
     break;
 
+    case 15:
+      for (uint8_t i = 0; i < EVENT_SOURCE_ALL; i++) {
+        LOG_I("tx%d frames: %u, dropped: %u, high watermark: %u, suppressed: %u/%u bytes\r\n", i,
+          event_tx_stats[i].frames, event_tx_stats[i].dropped, event_tx_stats[i].high_watermark,
+          event_tx_stats[i].suppressed, event_tx_stats[i].suppressed_bytes);
+        if (parser.seen('R')) {
+          event_tx_stats[i] = {0};
+        }
+      }
+    break;
+
+    case 16:
+      subscribe.report_stats();
+    break;
+
+    #if ANY(HMI_GCODE_COMPRESSION, HMI_GCODE_MEATPACK, HMI_GCODE_MOTION)
+      case 17:
+      {
+        extern uint32_t statistics_gcode_packed_bytes;
+        extern uint32_t statistics_gcode_unpacked_bytes;
+        LOG_I("gcode packed: %u bytes, unpacked: %u bytes, ratio: %f\r\n",
+          statistics_gcode_packed_bytes, statistics_gcode_unpacked_bytes,
+          statistics_gcode_packed_bytes ? (float)statistics_gcode_unpacked_bytes / statistics_gcode_packed_bytes : 0.0f);
+        if (parser.seen('R')) {
+          statistics_gcode_packed_bytes = statistics_gcode_unpacked_bytes = 0;
+        }
+      }
+      break;
+    #endif
+
+    case 18:
+      print_control.report_gcode_stats(parser.seen('R'));
+    break;
+
     case 100:
       LOG_I("test watch dog!\n");
       vTaskDelay(pdMS_TO_TICKS(1000));
@@ -153,6 +153,27 @@ int HardwareSerial::read(void) {
 	}
 }
 
+/* Drain up to len bytes that are already received, never blocks */
+uint32 HardwareSerial::read(uint8 *buf, uint32 len) {
+    return usart_rx(this->usart_device, buf, len);
+}
+
+/* fn is called from the USART IRQ at the end of every received burst and
+   when USART_RX_NOTIFY_COUNT bytes are waiting */
+void HardwareSerial::rx_notify(voidFuncPtr fn) {
+    usart_set_rx_notify(this->usart_device, fn);
+}
+
+/* fn is called from the USART IRQ for bytes to send after the TX ring */
+void HardwareSerial::tx_pull(int16 (*fn)(uint8)) {
+    usart_set_tx_pull(this->usart_device, fn);
+}
+
+/* Have the USART IRQ poll the pull source, never blocks */
+void HardwareSerial::tx_kick(void) {
+    usart_tx_kick(this->usart_device);
+}
+
 int HardwareSerial::available(void) {
     return usart_data_available(this->usart_device);
 }
@@ -136,6 +136,10 @@ public:
     virtual int available(void);
     virtual int peek(void);
     virtual int read(void);
+    uint32 read(uint8 *buf, uint32 len);
+    void rx_notify(voidFuncPtr fn);
+    void tx_pull(int16 (*fn)(uint8));
+    void tx_kick(void);
     int availableForWrite(void);
     virtual void flush(void);
     size_t write_byte(uint8_t);
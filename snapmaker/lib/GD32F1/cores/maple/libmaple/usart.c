@@ -59,6 +59,8 @@ void usart_init(usart_dev *dev) {
 void usart_enable(usart_dev *dev) {
     usart_reg_map *regs = dev->regs;
     regs->CR1 |= (USART_CR1_TE | USART_CR1_RE | USART_CR1_RXNEIE);// don't change the word length etc, and 'or' in the patten not overwrite |USART_CR1_M_8N1);
+    if (dev->rx_notify)
+        regs->CR1 |= USART_CR1_IDLEIE;
     regs->CR1 |= USART_CR1_UE;
 }
 
@@ -105,7 +107,8 @@ uint32 usart_tx_direct(usart_dev *dev, const uint8 *buf, uint32 len) {
 uint32 usart_tx(usart_dev *dev, const uint8 *buf, uint32 len) {
     usart_reg_map *regs = dev->regs;
     uint32 txed = 0;
-    while (rb_is_empty(dev->wb) && (regs->SR & USART_SR_TXE) && (txed < len)) {
+    /* With a pull source, the IRQ may be in the middle of one of its frames */
+    while (!dev->tx_pull && rb_is_empty(dev->wb) && (regs->SR & USART_SR_TXE) && (txed < len)) {
         regs->DR = buf[txed++];
     }
     regs->CR1 &= ~((uint32)USART_CR1_TXEIE); // disable TXEIE while populating the buffer
@@ -116,7 +119,7 @@ uint32 usart_tx(usart_dev *dev, const uint8 *buf, uint32 len) {
         else
             break;
     }
-    if (!rb_is_empty(dev->wb)) {
+    if (!rb_is_empty(dev->wb) || dev->tx_pull) {
         regs->CR1 |= USART_CR1_TXEIE;
     }
     return txed;
@@ -138,6 +141,45 @@ uint32 usart_rx(usart_dev *dev, uint8 *buf, uint32 len) {
     return rxed;
 }
 
+/**
+ * @brief Set the function called when the RX line goes idle.
+ *
+ * The function runs in the USART interrupt, once after every burst of
+ * received bytes and when USART_RX_NOTIFY_COUNT bytes are waiting. Pass
+ * NULL to disable it.
+ * @param dev Serial port to watch
+ * @param fn Function to call, or NULL
+ */
+void usart_set_rx_notify(usart_dev *dev, voidFuncPtr fn) {
+    dev->rx_notify = fn;
+    if (fn)
+        dev->regs->CR1 |= USART_CR1_IDLEIE;
+    else
+        dev->regs->CR1 &= ~((uint32)USART_CR1_IDLEIE);
+}
+
+/**
+ * @brief Set a source of bytes the TX interrupt sends besides the TX ring.
+ *
+ * The function runs in the USART interrupt whenever it can send a byte.
+ * Pass NULL to remove it.
+ * @param dev Serial port to send on
+ * @param fn Function to call, or NULL
+ */
+void usart_set_tx_pull(usart_dev *dev, usart_tx_pull_f fn) {
+    dev->tx_pull = fn;
+}
+
+/**
+ * @brief Let the TX interrupt look at the pull source again.
+ *
+ * Call after adding bytes to the source, never blocks.
+ * @param dev Serial port to send on
+ */
+void usart_tx_kick(usart_dev *dev) {
+    dev->regs->CR1 |= USART_CR1_TXEIE;
+}
+
 /**
  * @brief Transmit an unsigned integer to the specified serial port in
  *        decimal format.
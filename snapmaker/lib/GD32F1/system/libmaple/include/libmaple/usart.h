@@ -385,6 +385,18 @@ typedef struct usart_reg_map {
 #define USART_TX_BUF_SIZE               1024
 #endif
 
+/* Bytes waiting in the RX ring that call rx_notify before the line goes idle */
+#ifndef USART_RX_NOTIFY_COUNT
+#define USART_RX_NOTIFY_COUNT           64
+#endif
+
+/**
+ * @brief Source of bytes the TX interrupt sends besides the TX ring.
+ * Returns the next byte or -1. ring_empty is set when the TX ring has
+ * nothing left, a source only starts a new frame then.
+ */
+typedef int16 (*usart_tx_pull_f)(uint8 ring_empty);
+
 /** USART device type */
 typedef struct usart_dev {
     usart_reg_map *regs;             /**< Register map */
@@ -399,6 +411,12 @@ typedef struct usart_dev {
     uint8 tx_buf[USART_TX_BUF_SIZE]; /**< Actual TX buffer used by wb */
     rcc_clk_id clk_id;               /**< RCC clock information */
     nvic_irq_num irq_num;            /**< USART NVIC interrupt */
+    voidFuncPtr rx_notify;           /**< Called from the IRQ when the
+                                      * RX line goes idle or the RX ring
+                                      * holds USART_RX_NOTIFY_COUNT bytes,
+                                      * may be NULL */
+    usart_tx_pull_f tx_pull;         /**< Polled by the IRQ for more bytes
+                                      * to send, may be NULL */
 } usart_dev;
 
 void usart_init(usart_dev *dev);
@@ -428,6 +446,9 @@ void usart_foreach(void (*fn)(usart_dev *dev));
 uint32 usart_tx_direct(usart_dev *dev, const uint8 *buf, uint32 len);
 uint32 usart_tx(usart_dev *dev, const uint8 *buf, uint32 len);
 uint32 usart_rx(usart_dev *dev, uint8 *buf, uint32 len);
+void usart_set_rx_notify(usart_dev *dev, voidFuncPtr fn);
+void usart_set_tx_pull(usart_dev *dev, usart_tx_pull_f fn);
+void usart_tx_kick(usart_dev *dev);
 void usart_putudec(usart_dev *dev, uint32 val);
 
 /**
@@ -37,13 +37,16 @@
 #include <libmaple/ring_buffer.h>
 #include <libmaple/usart.h>
 
-static inline __always_inline void usart_irq(ring_buffer *rb, ring_buffer *wb, usart_reg_map *regs) {
+static inline __always_inline void usart_irq(ring_buffer *rb, ring_buffer *wb, usart_reg_map *regs, voidFuncPtr rx_notify,
+                                             usart_tx_pull_f tx_pull) {
+    /* SR is sampled once, reading DR for RXNE also clears IDLE. */
+    uint32 sr = regs->SR;
     /* Handling RXNEIE and TXEIE interrupts. 
      * RXNE signifies availability of a byte in DR.
      *
      * See table 198 (sec 27.4, p809) in STM document RM0008 rev 15.
      * We enable RXNEIE. */
-    if ((regs->CR1 & USART_CR1_RXNEIE) && (regs->SR & USART_SR_RXNE)) {
+    if ((regs->CR1 & USART_CR1_RXNEIE) && (sr & USART_SR_RXNE)) {
 #ifdef USART_SAFE_INSERT
         /* If the buffer is full and the user defines USART_SAFE_INSERT,
          * ignore new bytes. */
@@ -52,10 +55,24 @@ static inline __always_inline void usart_irq(ring_buffer *rb, ring_buffer *wb, u
         /* By default, push bytes around in the ring buffer. */
         rb_push_insert(rb, (uint8)regs->DR);
 #endif
+        /* A burst that does not go idle soon wakes the reader too */
+        if (rx_notify && rb_full_count(rb) == USART_RX_NOTIFY_COUNT)
+            rx_notify();
     }
-    /* TXE signifies readiness to send a byte to DR. */
+    /* IDLE signifies the end of a burst, tell the reader once. */
+    if ((regs->CR1 & USART_CR1_IDLEIE) && (sr & USART_SR_IDLE)) {
+        if (!(sr & USART_SR_RXNE))
+            (void)regs->DR; /* SR then DR read clears IDLE */
+        if (rx_notify)
+            rx_notify();
+    }
+    /* TXE signifies readiness to send a byte to DR. A frame of the pull
+     * source is finished before the ring goes on. */
     if ((regs->CR1 & USART_CR1_TXEIE) && (regs->SR & USART_SR_TXE)) {
-        if (!rb_is_empty(wb))
+        int16 c = tx_pull ? tx_pull(rb_is_empty(wb)) : -1;
+        if (c >= 0)
+            regs->DR = (uint8)c;
+        else if (!rb_is_empty(wb))
             regs->DR=rb_remove(wb);
         else
             regs->CR1 &= ~((uint32)USART_CR1_TXEIE); // disable TXEIE
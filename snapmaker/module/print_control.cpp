@@ -34,6 +34,9 @@
 #include "power_loss.h"
 #include "../module/filament_sensor.h"
 #include "exception.h"
+#if ENABLED(HMI_GCODE_COMPRESSION)
+  #include "../../Marlin/src/libs/heatshrink/heatshrink_decoder.h"
+#endif
 
 
 #define PAUSE_RESUME_MOVE_FEEDRATE_MMM (9000)
@@ -41,10 +44,79 @@
 PrintControl print_control;
 
 
-#define GCODE_BUFFER_SIZE (1024*2)
-uint16_t buffer_head = 0;
-uint16_t buffer_tail = 0;
+// Gcode from the HMI is stored line by line. Every line is kept contiguous and
+// NUL terminated in gcode_buffer so it can be read in place, its position is
+// recorded once at push time in gcode_lines.
+// The event task only moves the heads, the marlin task only moves the tails.
+#define GCODE_BUFFER_SIZE     HMI_GCODE_BUFFER_SIZE
+#ifdef HMI_GCODE_LINE_COUNT
+  #define GCODE_LINE_INDEX_SIZE HMI_GCODE_LINE_COUNT
+#else
+  #define GCODE_LINE_INDEX_SIZE (GCODE_BUFFER_SIZE / 8)
+#endif
+#define GCODE_LINE_SLACK      (MAX_CMD_SIZE + 1)  // bytes lost at most when a line wraps
+
+static_assert(GCODE_BUFFER_SIZE <= 0xFFFF, "HMI_GCODE_BUFFER_SIZE is too large");
+static_assert(GCODE_LINE_INDEX_SIZE >= 16 && GCODE_LINE_INDEX_SIZE <= GCODE_BUFFER_SIZE / 2, "HMI_GCODE_LINE_COUNT is out of range");
+
+#if ENABLED(HMI_GCODE_PREPARSE) && DISABLED(HMI_GCODE_MOTION)
+  #error "HMI_GCODE_PREPARSE requires HMI_GCODE_MOTION."
+#endif
+
+gcode_ring_stats_t gcode_ring_stats;
+static bool gcode_ring_starved = false;
+
+typedef struct {
+  uint16_t offset;  // first byte of the line
+  uint16_t len;     // without the terminator
+} gcode_line_t;
+
 static uint8_t gcode_buffer[GCODE_BUFFER_SIZE];
+static gcode_line_t gcode_lines[GCODE_LINE_INDEX_SIZE];
+static volatile uint16_t buffer_head = 0;
+static volatile uint16_t buffer_tail = 0;
+static volatile uint16_t line_head = 0;
+static volatile uint16_t line_tail = 0;
+// bytes of a line not terminated yet, only used by the pushing side
+static uint16_t partial_offset = 0;
+static uint16_t partial_len = 0;
+
+static void gcode_ring_reset() {
+  buffer_head = buffer_tail = 0;
+  line_head = line_tail = 0;
+  partial_offset = partial_len = 0;
+}
+
+static inline uint16_t next_line_index(uint16_t index) {
+  return (index + 1 < GCODE_LINE_INDEX_SIZE) ? index + 1 : 0;
+}
+
+static uint16_t gcode_lines_free() {
+  return GCODE_LINE_INDEX_SIZE - 1 - (line_head + GCODE_LINE_INDEX_SIZE - line_tail) % GCODE_LINE_INDEX_SIZE;
+}
+
+// Find a contiguous room of need bytes starting at head, or at 0 if the
+// end of the buffer is too short
+static bool gcode_ring_reserve(uint16_t head, uint16_t need, uint16_t &at) {
+  uint16_t tail = buffer_tail;
+  if (head >= tail) {
+    uint16_t end_room = GCODE_BUFFER_SIZE - head - (tail == 0 ? 1 : 0);
+    if (need <= end_room) {
+      at = head;
+      return true;
+    }
+    if (tail > 0 && need <= tail - 1) {
+      at = 0;
+      return true;
+    }
+    return false;
+  }
+  if (need <= tail - head - 1) {
+    at = head;
+    return true;
+  }
+  return false;
+}
 
 void PrintControl::init() {
   print_noise_mode = NOISE_NOIMAL_MODE;
@@ -55,7 +127,7 @@ void PrintControl::init() {
 }
 
 bool PrintControl::buffer_is_empty() {
- return buffer_head == buffer_tail && !planner.has_blocks_queued();
+ return line_head == line_tail && !planner.has_blocks_queued();
 }
 
 bool PrintControl::is_backup_mode() {
@@ -63,15 +135,18 @@ bool PrintControl::is_backup_mode() {
 }
 
 void PrintControl::clear_gcode_buf() {
-  buffer_head = buffer_tail;
+  gcode_ring_reset();
 }
 
 uint32_t PrintControl::get_buf_used() {
-  return (buffer_head + GCODE_BUFFER_SIZE - buffer_tail) % GCODE_BUFFER_SIZE;
+  return (buffer_head + GCODE_BUFFER_SIZE - buffer_tail) % GCODE_BUFFER_SIZE + partial_len;
 }
 
 uint32_t PrintControl::get_buf_free() {
-  return GCODE_BUFFER_SIZE - get_buf_used();
+  int32_t free = GCODE_BUFFER_SIZE - 1 - GCODE_LINE_SLACK - get_buf_used();
+  // The line index is sized for an average line length
+  NOMORE(free, (int32_t)gcode_lines_free() * (GCODE_BUFFER_SIZE / GCODE_LINE_INDEX_SIZE));
+  return free > 0 ? free : 0;
 }
 
 uint32_t PrintControl::get_cur_line() {
@@ -136,6 +211,15 @@ void PrintControl::loop() {
   }
 }
 
+// Drop the line at the tail, its bytes are free for the next push
+static void gcode_line_release() {
+  gcode_line_t &gl = gcode_lines[line_tail];
+  uint16_t next = gl.offset + gl.len + 1;
+  buffer_tail = next < GCODE_BUFFER_SIZE ? next : 0;
+  line_tail = next_line_index(line_tail);
+  power_loss.line_number_sum++;
+}
+
 bool PrintControl::get_commands(uint8_t *cmd, uint32_t &line, uint16_t max_len) {
 
   if (power_loss.power_loss_status != POWER_LOSS_IDLE) {
@@ -154,39 +238,209 @@ bool PrintControl::get_commands(uint8_t *cmd, uint32_t &line, uint16_t max_len)
     return false;
   }
 
-  while (buffer_head != buffer_tail) {
-    if (gcode_buffer[buffer_tail] == ' ' || gcode_buffer[buffer_tail] == '\n') {
-      if (gcode_buffer[buffer_tail] == '\n') {
-        power_loss.line_number_sum++;
-      }
-      buffer_tail = (buffer_tail + 1) % GCODE_BUFFER_SIZE;
-    } else {
-      break;
-    }
+  if (line_tail == line_head) {
+    // count each time the marlin task runs out of gcode while printing
+    if (!gcode_ring_starved) gcode_ring_stats.starved++;
+    gcode_ring_starved = true;
+    return false;
   }
-  uint32_t get_commands = 0;
-  while (buffer_head != buffer_tail) {
-    if (get_commands >= max_len) {
+
+  while (line_tail != line_head) {
+    gcode_line_t &gl = gcode_lines[line_tail];
+    const char *p = (const char *)&gcode_buffer[gl.offset];
+    uint16_t skip = 0;
+    while (skip < gl.len && p[skip] == ' ') skip++;
+
+    if (skip == gl.len) {
+      // Blank line, only count it
+      gcode_line_release();
+      continue;
+    }
+
+    uint16_t len = gl.len - skip;
+    line = power_loss.line_number_sum + 1;
+    gcode_ring_starved = false;
+    if (len >= max_len) {
       SERIAL_ECHOLNPAIR("cmd too long failed!");
+      gcode_line_release();
       return false;
     }
 
-    cmd[get_commands] = gcode_buffer[buffer_tail];
-    buffer_tail = (buffer_tail + 1) % GCODE_BUFFER_SIZE;
+    // The one copy, into the marlin command queue
+    memcpy(cmd, p + skip, len + 1);
+    gcode_line_release();
+    gcode_ring_stats.commands++;
+    return true;
+  }
+  return false;
+}
+
+// A push writes its lines past buffer_head, they become visible to the
+// marlin task only when gcode_push_commit() moves the heads
+typedef struct {
+  uint16_t head;
+  uint16_t line_head;
+  uint16_t partial_offset;
+  uint16_t partial_len;
+  uint32_t lines;
+  uint32_t size;
+  uint32_t spare;  // bytes admitted beyond the packet, records may grow into them
+} gcode_push_t;
+
+static void gcode_push_begin(gcode_push_t &push, uint32_t spare) {
+  push.head = buffer_head;
+  push.line_head = line_head;
+  push.partial_offset = partial_offset;
+  push.partial_len = partial_len;
+  push.lines = 0;
+  push.size = 0;
+  push.spare = spare;
+}
 
-    if (cmd[get_commands] == '\n') {
-      cmd[get_commands] = 0;
-      power_loss.line_number_sum++;
-      line = power_loss.line_number_sum;
-      return true;
+#if ENABLED(HMI_GCODE_PREPARSE)
+
+  // A plain G0/G1 line as a motion record, so the marlin task has nothing
+  // left to parse. Anything else, line numbers, checksums, comments, other
+  // words or repeated axes, stays text. The values go through the parser's own
+  // number routine and come out the same as from the text.
+  static bool gcode_motion_from_text(char *p, gcode_motion_t &motion) {
+    static const char letters[] = "XYZEF";  // in the order of the GCODE_MOTION_* bits
+    float value[5] = { 0, 0, 0, 0, 0 };
+
+    while (*p == ' ') p++;
+    if (*p++ != 'G') return false;
+    while (*p == '0' && (p[1] == '0' || p[1] == '1')) p++;
+    if (*p != '0' && *p != '1') return false;
+    motion.flags = (*p++ == '0') ? GCODE_MOTION_G0 : 0;
+    if (NUMERIC(*p) || *p == '.') return false;  // G10, G1.1, ...
+
+    for (;;) {
+      while (*p == ' ') p++;
+      if (*p == '\0') break;
+
+      const char *l = strchr(letters, *p);
+      if (!l) return false;
+      const uint8_t i = l - letters;
+      if (TEST(motion.flags, i) || !GCodeParser::valid_float(++p)) return false;
+      motion.flags |= _BV(i);
+      value[i] = GCodeParser::parse_float(p);
+      while (DECIMAL_SIGNED(*p)) p++;
     }
-    get_commands++;
+    if (!(motion.flags & ~GCODE_MOTION_G0)) return false;
+
+    motion.marker = GCODE_MOTION_MARKER;
+    motion.x = value[0];
+    motion.y = value[1];
+    motion.z = value[2];
+    motion.e = value[3];
+    motion.f = value[4];
+    return true;
+  }
+
+#endif
+
+static bool gcode_push_append(gcode_push_t &push, const uint8_t *data, uint16_t size) {
+  uint16_t pos = 0;
+
+  while (pos < size) {
+    const uint8_t *eol = (const uint8_t *)memchr(data + pos, '\n', size - pos);
+    uint16_t n = eol ? eol - (data + pos) : size - pos;
+    uint16_t need = push.partial_len + n + 1;
+    uint16_t at;
+
+    #if ENABLED(HMI_GCODE_PREPARSE)
+      // Leave room for a record in place of a short G0/G1, but only out of
+      // the spare bytes, the rest of the packet was admitted as text
+      const uint8_t first = push.partial_len ? gcode_buffer[push.partial_offset] : data[pos];
+      const uint16_t text_need = need;
+      bool preparse = eol && first == 'G';
+      if (preparse && need < sizeof(gcode_motion_t) + 1) {
+        if (sizeof(gcode_motion_t) + 1 - need <= push.spare) {
+          need = sizeof(gcode_motion_t) + 1;
+        } else {
+          preparse = false;  // store it as text
+        }
+      }
+    #endif
+
+    if (!gcode_ring_reserve(push.head, need, at)) {
+      SERIAL_ECHOLNPAIR("gcode no memory for line:", n);
+      return false;
+    }
+    if (push.partial_len && at != push.partial_offset) {
+      memmove(&gcode_buffer[at], &gcode_buffer[push.partial_offset], push.partial_len);
+    }
+    memcpy(&gcode_buffer[at + push.partial_len], data + pos, n);
+    pos += n;
+
+    if (!eol) {
+      // Keep the tail of the packet, the next one completes the line
+      push.partial_offset = at;
+      push.partial_len += n;
+      break;
+    }
+
+    if (next_line_index(push.line_head) == line_tail) {
+      SERIAL_ECHOLNPAIR("gcode no line index, count:", push.lines + 1);
+      return false;
+    }
+    uint16_t len = push.partial_len + n;
+    gcode_buffer[at + len] = 0;
+
+    #if ENABLED(HMI_GCODE_PREPARSE)
+      gcode_motion_t motion;
+      if (preparse && gcode_motion_from_text((char *)&gcode_buffer[at], motion)) {
+        memcpy(&gcode_buffer[at], &motion, sizeof(motion));
+        len = sizeof(motion);
+        gcode_buffer[at + len] = 0;
+        push.spare = push.spare + text_need - (sizeof(motion) + 1);
+        gcode_ring_stats.records++;
+      }
+    #endif
+
+    gcode_lines[push.line_head].offset = at;
+    gcode_lines[push.line_head].len = len;
+    push.line_head = next_line_index(push.line_head);
+    push.head = at + len + 1;
+    if (push.head >= GCODE_BUFFER_SIZE) push.head = 0;
+    push.partial_len = 0;
+    push.lines++;
+    pos++;
+  }
+  push.size += size;
+  return true;
+}
+
+static void gcode_push_commit(gcode_push_t &push, uint32_t end_line) {
+  // Publish the new lines only after their bytes are written
+  partial_offset = push.partial_offset;
+  partial_len = push.partial_len;
+  buffer_head = push.head;
+  line_head = push.line_head;
+  power_loss.next_req = end_line + 1;
+
+  const uint16_t lines = GCODE_LINE_INDEX_SIZE - 1 - gcode_lines_free();
+  const uint16_t bytes = print_control.get_buf_used();
+  NOLESS(gcode_ring_stats.lines_max, lines);
+  NOLESS(gcode_ring_stats.bytes_max, bytes);
+}
+
+void PrintControl::report_gcode_stats(bool reset) {
+  const uint32_t ms = millis() - gcode_ring_stats.since_ms;
+  LOG_I("gcode ring lines: %u/%u max %u, bytes: %u/%u max %u\r\n",
+    GCODE_LINE_INDEX_SIZE - 1 - gcode_lines_free(), GCODE_LINE_INDEX_SIZE - 1, gcode_ring_stats.lines_max,
+    get_buf_used(), GCODE_BUFFER_SIZE - 1, gcode_ring_stats.bytes_max);
+  LOG_I("gcode commands: %u, records: %u, starved: %u, %u cmd/s\r\n",
+    gcode_ring_stats.commands, gcode_ring_stats.records, gcode_ring_stats.starved,
+    ms ? (uint32_t)((uint64_t)gcode_ring_stats.commands * 1000 / ms) : 0);
+  if (reset) {
+    gcode_ring_stats = { 0 };
+    gcode_ring_stats.since_ms = millis();
   }
-  return false;
 }
 
 ErrCode PrintControl::push_gcode(uint32_t start_line, uint32_t end_line, uint8_t *data, uint16_t size) {
-  uint8_t gcode_count = 0;
+  uint32_t gcode_count = 0;
   uint32_t free = get_buf_free();
 
   if (free < size) {
@@ -194,31 +448,311 @@ ErrCode PrintControl::push_gcode(uint32_t start_line, uint32_t end_line, uint8_t
     return E_NO_MEM;
   }
 
-  for (uint16_t i = 0; i < size; i++) {
-    if (data[i] == '\n') {
-      gcode_count ++;
-    }
-  }
-
   if (power_loss.next_req != start_line) {
     LOG_E("HIM gcode start line is NOT equal req, req %d, get %d\r\n", power_loss.next_req, start_line);
     return E_PARAM;
   }
 
+  for (uint8_t *p = data; (p = (uint8_t *)memchr(p, '\n', data + size - p)); p++) {
+    gcode_count++;
+  }
+
   if ((end_line - start_line + 1) != gcode_count) {
     SERIAL_ECHOLNPAIR("failed line start:", start_line, " end:", end_line, " count:", gcode_count, " next_req:", power_loss.next_req);
     return E_PARAM;
   }
 
-  for (uint32_t i = 0; i < size; i++) {
-    gcode_buffer[buffer_head] = data[i];
-    buffer_head = (buffer_head + 1) % GCODE_BUFFER_SIZE;
+  if (gcode_lines_free() < gcode_count) {
+    SERIAL_ECHOLNPAIR("gcode no line index, count:", gcode_count);
+    return E_NO_MEM;
   }
-  power_loss.next_req = end_line + 1;
+
+  gcode_push_t push;
+  gcode_push_begin(push, free - size);
+  if (!gcode_push_append(push, data, size)) {
+    return E_NO_MEM;
+  }
+  gcode_push_commit(push, end_line);
 
   return E_SUCCESS;
 }
 
+#if ANY(HMI_GCODE_COMPRESSION, HMI_GCODE_MEATPACK, HMI_GCODE_MOTION)
+
+  // Bytes received and bytes decoded from encoded packets
+  uint32_t statistics_gcode_packed_bytes = 0;
+  uint32_t statistics_gcode_unpacked_bytes = 0;
+
+  // Decoders write their output in chunks small enough to stay on the stack
+  #define GCODE_DECODE_CHUNK 64
+
+  #if ENABLED(HMI_GCODE_COMPRESSION)
+
+    // The HMI compresses with the same window and lookahead bits
+    static heatshrink_decoder gcode_hsd;
+
+    static ErrCode gcode_heatshrink_decode(gcode_push_t &push, uint8_t *data, uint16_t size, uint16_t raw_size) {
+      uint8_t out[GCODE_DECODE_CHUNK];
+      size_t count;
+      uint16_t pos = 0;
+      bool finished = false;
+
+      heatshrink_decoder_reset(&gcode_hsd);
+      while (!finished) {
+        if (pos < size) {
+          heatshrink_decoder_sink(&gcode_hsd, data + pos, size - pos, &count);
+          pos += count;
+        }
+        else if (heatshrink_decoder_finish(&gcode_hsd) == HSDR_FINISH_DONE) {
+          finished = true;
+        }
+
+        HSD_poll_res pres;
+        do {
+          pres = heatshrink_decoder_poll(&gcode_hsd, out, sizeof(out), &count);
+          if (pres < 0 || push.size + count > raw_size) {
+            return E_PARAM;
+          }
+          if (count && !gcode_push_append(push, out, count)) {
+            return E_NO_MEM;
+          }
+        } while (pres == HSDR_POLL_MORE);
+      }
+      return E_SUCCESS;
+    }
+
+  #endif
+
+  #if ENABLED(HMI_GCODE_MEATPACK)
+
+    // MeatPack nibble codes, 0b1111 means a literal byte follows in the stream.
+    // Without spaces the HMI strips them and packs 'E' in their place.
+    static const uint8_t meatpack_table[2][16] = {
+      { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '.', ' ', '\n', 'G', 'X', 0 },
+      { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '.', 'E', '\n', 'G', 'X', 0 },
+    };
+
+    // Every packet is packed on its own. A '\n' in the low nibble ends the
+    // byte, and the padding of an odd last character is cut by raw_size.
+    static ErrCode gcode_meatpack_decode(gcode_push_t &push, uint8_t *data, uint16_t size, uint16_t raw_size, bool no_spaces) {
+      const uint8_t *table = meatpack_table[no_spaces];
+      uint8_t out[GCODE_DECODE_CHUNK + 1];
+      uint8_t n = 0;
+      uint8_t literals = 0;
+      uint8_t second = 0;
+
+      for (uint16_t i = 0; i < size; i++) {
+        const uint8_t c = data[i];
+        if (literals) {
+          out[n++] = c;
+          if (second) {
+            out[n++] = second;
+            second = 0;
+          }
+          literals--;
+        }
+        else if ((c & 0x0F) == 0x0F) {
+          literals++;
+          if ((c >> 4) == 0x0F) literals++;
+          else second = table[c >> 4];
+        }
+        else {
+          out[n++] = table[c & 0x0F];
+          if (table[c & 0x0F] != '\n') {
+            if ((c >> 4) == 0x0F) literals++;
+            else out[n++] = table[c >> 4];
+          }
+        }
+
+        if (n >= GCODE_DECODE_CHUNK || i + 1 == size) {
+          if (push.size + n > raw_size) {
+            // only the last nibble may be padding
+            if (i + 1 != size || push.size + n > raw_size + 1u) return E_PARAM;
+            n--;
+          }
+          if (n && !gcode_push_append(push, out, n)) {
+            return E_NO_MEM;
+          }
+          n = 0;
+        }
+      }
+      return E_SUCCESS;
+    }
+
+  #endif
+
+  #if ENABLED(HMI_GCODE_MOTION)
+
+    // Record values are integers of this many decimal digits, set per file
+    #define GCODE_MOTION_MAX_DIGITS 6
+    static const float motion_pow10[GCODE_MOTION_MAX_DIGITS + 1] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f };
+    static uint8_t motion_digits[3] = { 3, 5, 0 };  // XYZ, E, F
+
+    static_assert(sizeof(gcode_motion_t) == 24, "gcode_motion_t is counted as 24 bytes by the HMI");
+
+    bool PrintControl::set_motion_scale(uint8_t xyz_digits, uint8_t e_digits, uint8_t f_digits) {
+      if (xyz_digits > GCODE_MOTION_MAX_DIGITS || e_digits > GCODE_MOTION_MAX_DIGITS || f_digits > GCODE_MOTION_MAX_DIGITS) {
+        return false;
+      }
+      motion_digits[0] = xyz_digits;
+      motion_digits[1] = e_digits;
+      motion_digits[2] = f_digits;
+      return true;
+    }
+
+    static bool motion_read_varint(const uint8_t *&p, const uint8_t *end, uint32_t &v) {
+      v = 0;
+      for (uint8_t shift = 0; shift < 35 && p < end; shift += 7) {
+        const uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+      }
+      return false;
+    }
+
+    // A record must start a line, it is stored whole with its terminator
+    static bool gcode_push_append_record(gcode_push_t &push, const gcode_motion_t &motion) {
+      uint16_t at;
+      if (!gcode_ring_reserve(push.head, sizeof(motion) + 1, at) || next_line_index(push.line_head) == line_tail) {
+        SERIAL_ECHOLNPAIR("gcode no memory for record, count:", push.lines + 1);
+        return false;
+      }
+      memcpy(&gcode_buffer[at], &motion, sizeof(motion));
+      gcode_buffer[at + sizeof(motion)] = 0;
+      gcode_lines[push.line_head].offset = at;
+      gcode_lines[push.line_head].len = sizeof(motion);
+      push.line_head = next_line_index(push.line_head);
+      push.head = at + sizeof(motion) + 1;
+      if (push.head >= GCODE_BUFFER_SIZE) push.head = 0;
+      push.lines++;
+      push.size += sizeof(motion);
+      return true;
+    }
+
+    // A line starting with a byte below 0x80 is text up to its '\n'.
+    // 0b10GFEZYX starts a record: the flags, then a zigzag varint for each
+    // axis present holding the change since the previous record of the
+    // packet, then the feedrate as a plain varint. Every packet starts from
+    // zero so it can be decoded on its own after a resend.
+    static ErrCode gcode_motion_decode(gcode_push_t &push, uint8_t *data, uint16_t size) {
+      int32_t last[4] = { 0, 0, 0, 0 };
+      const uint8_t *p = data;
+      const uint8_t *end = data + size;
+
+      while (p < end) {
+        if (*p < 0x80 || push.partial_len) {
+          const uint8_t *eol = (const uint8_t *)memchr(p, '\n', end - p);
+          const uint16_t n = eol ? eol - p + 1 : end - p;
+          if (!gcode_push_append(push, p, n)) {
+            return E_NO_MEM;
+          }
+          p += n;
+          continue;
+        }
+
+        const uint8_t tag = *p++;
+        if (tag & 0x40) {
+          return E_PARAM;
+        }
+
+        gcode_motion_t motion;
+        float *value[4] = { &motion.x, &motion.y, &motion.z, &motion.e };
+        uint32_t v;
+        motion.marker = GCODE_MOTION_MARKER;
+        motion.flags = tag & 0x3F;
+        for (uint8_t i = 0; i < 4; i++) {
+          if (!TEST(motion.flags, i)) {
+            *value[i] = 0;
+            continue;
+          }
+          if (!motion_read_varint(p, end, v)) {
+            return E_PARAM;
+          }
+          last[i] += (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+          *value[i] = last[i] / motion_pow10[motion_digits[i < 3 ? 0 : 1]];
+        }
+        motion.f = 0;
+        if (motion.flags & GCODE_MOTION_F) {
+          if (!motion_read_varint(p, end, v)) {
+            return E_PARAM;
+          }
+          motion.f = v / motion_pow10[motion_digits[2]];
+        }
+        if (!gcode_push_append_record(push, motion)) {
+          return E_NO_MEM;
+        }
+      }
+      return E_SUCCESS;
+    }
+
+  #endif
+
+  ErrCode PrintControl::push_encoded_gcode(gcode_encoding_e encoding, uint32_t start_line, uint32_t end_line, uint8_t *data, uint16_t size, uint16_t raw_size) {
+    uint32_t free = get_buf_free();
+    uint32_t need = raw_size;
+    ErrCode ret;
+
+    #if ENABLED(HMI_GCODE_MOTION)
+      // raw_size counts a record as sizeof(gcode_motion_t), it also takes a terminator
+      if (encoding == GCODE_ENCODING_MOTION) need += end_line - start_line + 1;
+    #endif
+    if (free < need) {
+      SERIAL_ECHOLNPAIR("gcode no memory ,free:", free, " cur:", need);
+      return E_NO_MEM;
+    }
+
+    if (power_loss.next_req != start_line) {
+      LOG_E("HIM gcode start line is NOT equal req, req %d, get %d\r\n", power_loss.next_req, start_line);
+      return E_PARAM;
+    }
+
+    if (gcode_lines_free() < end_line - start_line + 1) {
+      SERIAL_ECHOLNPAIR("gcode no line index, count:", end_line - start_line + 1);
+      return E_NO_MEM;
+    }
+
+    gcode_push_t push;
+    gcode_push_begin(push, free - need);
+    switch (encoding) {
+      #if ENABLED(HMI_GCODE_COMPRESSION)
+        case GCODE_ENCODING_HEATSHRINK:
+          ret = gcode_heatshrink_decode(push, data, size, raw_size);
+          break;
+      #endif
+      #if ENABLED(HMI_GCODE_MEATPACK)
+        case GCODE_ENCODING_MEATPACK:
+        case GCODE_ENCODING_MEATPACK_NSP:
+          ret = gcode_meatpack_decode(push, data, size, raw_size, encoding == GCODE_ENCODING_MEATPACK_NSP);
+          break;
+      #endif
+      #if ENABLED(HMI_GCODE_MOTION)
+        case GCODE_ENCODING_MOTION:
+          ret = gcode_motion_decode(push, data, size);
+          break;
+      #endif
+      default:
+        ret = E_PARAM;
+        break;
+    }
+    if (ret != E_SUCCESS) {
+      LOG_E("gcode decode failed, encoding:%d line:%d\r\n", encoding, start_line);
+      return ret;
+    }
+
+    // The HMI keeps a line for each one it stripped, next_req stays in step with the file
+    if (push.size != raw_size || push.lines != end_line - start_line + 1) {
+      SERIAL_ECHOLNPAIR("failed line start:", start_line, " end:", end_line, " count:", push.lines, " size:", push.size);
+      return E_PARAM;
+    }
+    gcode_push_commit(push, end_line);
+
+    statistics_gcode_packed_bytes += size;
+    statistics_gcode_unpacked_bytes += raw_size;
+    return E_SUCCESS;
+  }
+
+#endif
+
 void PrintControl::start_work_time() {
   // work_time_ms = 0;
   req_clear_work_time = true;
@@ -347,7 +881,7 @@ ErrCode PrintControl::start() {
   power_loss.stash_data.file_position = 0;
   power_loss.cur_line = power_loss.line_number_sum = 0;
   power_loss.next_req = 0;
-  buffer_head = buffer_tail = 0;
+  gcode_ring_reset();
   power_loss.clear();
 
   filament_sensor.reset();
@@ -369,7 +903,7 @@ ErrCode PrintControl::pause() {
   motion_control.wait_G28();
 
   commands_lock();
-  buffer_head = buffer_tail = 0;
+  gcode_ring_reset();
 
   // wait for auto park finish
   while(axisManager.T0_T1_simultaneously_move || axisManager.T0_T1_simultaneously_move_req || tool_changeing) {
@@ -484,7 +1018,7 @@ ErrCode PrintControl::pause() {
 
 ErrCode PrintControl::resume() {
 
-  buffer_head = buffer_tail = 0;
+  gcode_ring_reset();
 
   if (E_SUCCESS != system_service.set_status(SYSTEM_STATUE_RESUMING)) {
     LOG_E("can NOT set to SYSTEM_STATUE_RESUMING\r\n");
@@ -544,7 +1078,7 @@ ErrCode PrintControl::stop() {
 
     // motion_control.quickstop();
     commands_lock();
-    buffer_head = buffer_tail = 0;
+    gcode_ring_reset();
 
     // // set to 0, do not waiting in M109 or M190
     HOTEND_LOOP() {
@@ -568,7 +1102,7 @@ ErrCode PrintControl::stop() {
     }
 
     vTaskDelay(pdMS_TO_TICKS(100));
-    buffer_head = buffer_tail = 0;
+    gcode_ring_reset();
     is_calibretion_mode = false;
     idex_set_parked(false);
     motion_control.retrack_e(PRINT_RETRACK_DISTANCE, PRINT_TRAVEL_FEADRATE);
@@ -634,7 +1168,7 @@ void PrintControl::error_and_stop() {
   print_err_info.is_err = true;
   print_err_info.err_line = next_req_line();
   LOG_E("timeout line:%d\n", print_err_info.err_line);
-  buffer_head = buffer_tail = 0;
+  gcode_ring_reset();
   motion_control.quickstop();
   power_loss.stash_print_env();
   power_loss.write_flash();
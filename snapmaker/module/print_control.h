@@ -59,6 +59,47 @@ typedef struct {
   float max_acc;
 } print_noise_mode_param_t;
 
+// How the data of a gcode packet from the HMI is encoded
+typedef enum : uint8_t {
+  GCODE_ENCODING_RAW,
+  GCODE_ENCODING_HEATSHRINK,
+  GCODE_ENCODING_MEATPACK,
+  GCODE_ENCODING_MEATPACK_NSP,  // MeatPack with the spaces stripped
+  GCODE_ENCODING_MOTION,        // text lines mixed with binary G0/G1 records
+} gcode_encoding_e;
+
+// A G0/G1 received as a binary record. It is kept in the gcode ring as a line
+// starting with GCODE_MOTION_MARKER and runs without the text parser.
+#define GCODE_MOTION_MARKER 0x01
+
+enum : uint8_t {
+  GCODE_MOTION_X  = _BV(0),
+  GCODE_MOTION_Y  = _BV(1),
+  GCODE_MOTION_Z  = _BV(2),
+  GCODE_MOTION_E  = _BV(3),
+  GCODE_MOTION_F  = _BV(4),
+  GCODE_MOTION_G0 = _BV(5),  // G0, G1 otherwise
+};
+
+struct gcode_motion_t {
+  uint8_t marker;      // GCODE_MOTION_MARKER
+  uint8_t flags;       // GCODE_MOTION_*, the values present
+  float x, y, z, e;    // as written in the gcode, in the current units
+  float f;             // mm/min
+};
+
+// Occupancy of the gcode line ring, M2000 S18
+typedef struct {
+  uint16_t lines_max;  // most lines waiting at once
+  uint16_t bytes_max;
+  uint32_t records;    // G0/G1 lines turned into motion records at push time
+  uint32_t commands;   // lines taken by the marlin task
+  uint32_t starved;    // times the marlin task found the ring empty while printing
+  uint32_t since_ms;
+} gcode_ring_stats_t;
+
+extern gcode_ring_stats_t gcode_ring_stats;
+
 typedef struct {
   bool is_err;
   uint32_t err_line;
@@ -70,7 +111,14 @@ class PrintControl {
     void clear_gcode_buf();
     uint32_t get_buf_used();
     uint32_t get_buf_free();
+    void report_gcode_stats(bool reset);
     ErrCode push_gcode(uint32_t start_line, uint32_t end_line, uint8_t *data, uint16_t size);
+    #if ANY(HMI_GCODE_COMPRESSION, HMI_GCODE_MEATPACK, HMI_GCODE_MOTION)
+      ErrCode push_encoded_gcode(gcode_encoding_e encoding, uint32_t start_line, uint32_t end_line, uint8_t *data, uint16_t size, uint16_t raw_size);
+    #endif
+    #if ENABLED(HMI_GCODE_MOTION)
+      bool set_motion_scale(uint8_t xyz_digits, uint8_t e_digits, uint8_t f_digits);
+    #endif
     uint32_t get_cur_line();
     uint32_t next_req_line();
     bool buffer_is_empty();
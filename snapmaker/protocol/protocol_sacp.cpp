@@ -21,25 +21,37 @@
 
 #include "protocol_sacp.h"
 #include <functional>
+#include <string.h>
 #include "HAL.h"
 #include "../../Marlin/src/core/serial.h"
 
 ProtocolSACP protocol_sacp;
 
+// CRC-8, poly 0x07, init 0x00
+static const uint8_t sacp_crc8_table[256] = {
+  0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+  0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+  0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+  0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+  0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+  0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+  0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+  0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+  0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+  0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+  0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+  0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+  0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+  0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+  0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+  0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
+};
+
 static uint8_t sacp_calc_crc8(uint8_t *buffer, uint16_t len) {
-  int crc = 0x00;
-  int poly = 0x07;
-  for (int i = 0; i < len; i++) {
-    for (int j = 0; j < 8; j++) {
-      bool bit = ((buffer[i] >> (7 - j) & 1) == 1);
-      bool c07 = ((crc >> 7 & 1) == 1);
-      crc <<= 1;
-      if (c07 ^ bit) {
-        crc ^= poly;
-      }
-    }
+  uint8_t crc = 0x00;
+  for (uint16_t i = 0; i < len; i++) {
+    crc = sacp_crc8_table[crc ^ buffer[i]];
   }
-  crc &= 0xff;
   return crc;
 }
 
@@ -63,7 +75,9 @@ uint16_t calc_checksum(uint8_t *buffer, uint16_t length) {
   return (uint16_t)checksum;
 }
 
-ErrCode ProtocolSACP::parse(uint8_t *data, uint16_t len, SACP_param_t &out) {
+// The payload checksum is summed as the bytes come in, so the frame is
+// verified as soon as its last byte is received
+ErrCode ProtocolSACP::parse(uint8_t *data, uint16_t len, SACP_param_t &out, uint16_t &used) {
   uint8_t *parse_buff = out.buff;
   if (parse_buff[0] != SACP_PDU_SOF_H) {
     out.lenght = 0;
@@ -74,67 +88,77 @@ ErrCode ProtocolSACP::parse(uint8_t *data, uint16_t len, SACP_param_t &out) {
       if (ch == SACP_PDU_SOF_H) {
         parse_buff[out.lenght++] = ch;
       }
+      continue;
     } else if (out.lenght == 1) {
       if (ch == SACP_PDU_SOF_L) {
         parse_buff[out.lenght++] = ch;
-      } else {
+      } else if (ch != SACP_PDU_SOF_H) {
         out.lenght = 0;
       }
-    } else {
-      parse_buff[out.lenght++] = ch;
+      continue;
     }
 
+    parse_buff[out.lenght++] = ch;
     if (out.lenght < 7) {
-      break;
+      continue;
     }
-    else if (out.lenght == 7) {
-      if (sacp_calc_crc8(parse_buff, 6) != parse_buff[6]) {
+
+    uint16_t data_len = (parse_buff[3] << 8 | parse_buff[2]);
+    uint16_t total_len = data_len + 7;
+    if (out.lenght == 7) {
+      // A bad header or a length we can not hold, drop it and wait for the next SOF
+      if (sacp_calc_crc8(parse_buff, 6) != ch || data_len < 8 || total_len > PACK_PARSE_MAX_SIZE) {
         out.lenght = 0;
       }
-    }
-    else {
-      uint16_t data_len = (parse_buff[3] << 8 | parse_buff[2]);
-      uint16_t total_len = data_len + 7;
-      if (out.lenght == total_len) {
-        uint16_t checksum = calc_checksum(&parse_buff[7], data_len - 2);
-        uint16_t checksum1 = (parse_buff[total_len - 1] << 8) | parse_buff[total_len - 2];
-        if (checksum == checksum1) {
-          out.lenght = 0;
-          return E_SUCCESS;
-        } else {
-          out.lenght = 0;
-          return E_PARAM;
-        }
-      } else if (out.lenght > total_len) {
-        out.lenght = 0;
-        return E_PARAM;
+      out.checksum = 0;
+    } else if (out.lenght <= total_len - 2) {
+      // Big endian 16-bit words starting right after the header crc
+      out.checksum += ((out.lenght - 8) & 1) ? ch : (ch << 8);
+    } else if (out.lenght == total_len) {
+      uint32_t checksum = out.checksum;
+      if (data_len & 1) {
+        // calc_checksum() adds an odd tail byte as the low byte
+        uint8_t last = parse_buff[total_len - 3];
+        checksum = checksum - (last << 8) + last;
       }
+      while (checksum > 0xffff)
+        checksum = ((checksum >> 16) & 0xffff) + (checksum & 0xffff);
+      uint16_t checksum1 = (parse_buff[total_len - 1] << 8) | parse_buff[total_len - 2];
+      out.lenght = 0;
+      used = i + 1;
+      return ((uint16_t)~checksum == checksum1) ? E_SUCCESS : E_PARAM;
     }
   }
+  used = len;
   return E_IN_PROGRESS;
 }
 
 
 uint16_t ProtocolSACP::package(SACP_head_base_t head, uint8_t *in_data, uint16_t length, uint8_t *out_data) {
-  uint16_t data_len = (length + 8); // header 6 byte, checknum 2byte
   SACP_struct_t *out =  (SACP_struct_t *)out_data;
+  if (in_data != out->data) {
+    memmove(out->data, in_data, length);
+  }
+  return package(head, length, out_data);
+}
+
+uint16_t ProtocolSACP::package(SACP_head_base_t head, uint16_t length, uint8_t *frame) {
+  uint16_t data_len = (length + 8); // header 6 byte, checknum 2byte
+  SACP_struct_t *out =  (SACP_struct_t *)frame;
   out->sof_h = SACP_PDU_SOF_H;
   out->sof_l = SACP_PDU_SOF_L;
   out->length = data_len;
   out->version = SACP_VERSION;
   out->recever_id = head.recever_id;
-  out->crc8 = sacp_calc_crc8(out_data, 6);
+  out->crc8 = sacp_calc_crc8(frame, 6);
   out->sender_id = SACP_ID_CONTROLLER;
   out->attr = head.attribute;
   out->sequence = head.sequence;
   out->command_set = head.command_set;
   out->command_id = head.command_id;
-  for (uint16_t i = 0; i < length; i++) {
-    out->data[i] = in_data[i];
-  }
-  uint16_t checksum = calc_checksum(&out_data[7], data_len - 2);  // - checknum 2 byte
+  uint16_t checksum = calc_checksum(&frame[7], data_len - 2);  // - checknum 2 byte
   length = sizeof(SACP_struct_t) + length;
-  out_data[length++] = (uint8_t)(checksum & 0x00FF);
-  out_data[length++] = (uint8_t)(checksum>>8);
+  frame[length++] = (uint8_t)(checksum & 0x00FF);
+  frame[length++] = (uint8_t)(checksum>>8);
   return length;
 }
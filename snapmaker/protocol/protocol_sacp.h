@@ -66,6 +66,7 @@ typedef struct {
 
 typedef struct {
   uint16_t lenght;  // The total length of data
+  uint32_t checksum;  // Running sum of the payload received so far
   union {
     uint8_t buff[PACK_PARSE_MAX_SIZE];
     SACP_struct_t sacp;
@@ -78,9 +79,12 @@ typedef struct {
 
 class ProtocolSACP {
   public:
-    ErrCode parse(uint8_t *data, uint16_t len, SACP_param_t &out);
+    // Stops after a complete frame, used returns how many bytes were taken
+    ErrCode parse(uint8_t *data, uint16_t len, SACP_param_t &out, uint16_t &used);
     // Package the incoming data
     uint16_t package(SACP_head_base_t head, uint8_t *in_data, uint16_t length, uint8_t *out_data);
+    // Package a frame whose length bytes of payload are already in place after the header
+    uint16_t package(SACP_head_base_t head, uint16_t length, uint8_t *frame);
     uint16_t sequence_pop() {return sequence++;}
   private:
     uint32_t sequence = 0;
@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""
+Reference encoder and decoder of the GCODE_ENCODING_MOTION packets the
+controller accepts in PRINTER_ID_REQ_GCODE (see print_control.cpp).
+
+A packet is a mix of text lines and binary G0/G1 records:
+  - a line starting with a byte below 0x80 is text up to its '\\n'
+  - 0b10GFEZYX starts a record, followed by a zigzag varint for each axis
+    present holding the change since the previous record of the packet,
+    then the feedrate as a plain varint. Every packet starts from zero.
+Values are integers of the decimal digits negotiated for the file.
+
+  gcode_motion_pack.py file.gcode [--xyz 3] [--e 5] [--f 0]
+
+packs the file, decodes it back and checks every line round trips.
+"""
+
+import argparse
+import re
+from decimal import Decimal, InvalidOperation
+
+PACK_SIZE = 450      # GCODE_MAX_PACK_SIZE
+UNPACK_SIZE = 1350   # GCODE_MAX_UNPACK_SIZE, room asked by a request
+RECORD_SIZE = 24     # sizeof(gcode_motion_t), what a record takes once decoded
+AXES = 'XYZE'
+FLAG_F = 0x10
+FLAG_G0 = 0x20
+
+MOVE_RE = re.compile(r'^G0*([01])((?:\s*[XYZEF][-+]?[0-9.]+)*)\s*$')
+WORD_RE = re.compile(r'([XYZEF])([-+]?[0-9.]+)')
+
+
+def zigzag(v):
+  return (v << 1) ^ (v >> 31) if v < 0 else v << 1
+
+
+def unzigzag(v):
+  return (v >> 1) ^ -(v & 1)
+
+
+def varint(v):
+  out = bytearray()
+  while True:
+    b = v & 0x7F
+    v >>= 7
+    if v:
+      out.append(b | 0x80)
+    else:
+      out.append(b)
+      return bytes(out)
+
+
+def read_varint(data, pos):
+  v = shift = 0
+  while True:
+    b = data[pos]
+    pos += 1
+    v |= (b & 0x7F) << shift
+    if not b & 0x80:
+      return v, pos
+    shift += 7
+
+
+def quantize(text, digits):
+  try:
+    q = Decimal(text).scaleb(digits)
+  except InvalidOperation:
+    return None
+  if q != q.to_integral_value():
+    return None
+  return int(q)
+
+
+def parse_move(line, digits):
+  """ Values of a G0/G1 a record can carry exactly, None otherwise """
+  code = line.split(';', 1)[0].strip()
+  m = MOVE_RE.match(code)
+  if not m:
+    return None
+  flags = FLAG_G0 if m.group(1) == '0' else 0
+  values = {}
+  for letter, text in WORD_RE.findall(m.group(2)):
+    if letter in values:
+      return None
+    v = quantize(text, digits['F' if letter == 'F' else ('E' if letter == 'E' else 'XYZ')])
+    if v is None or (letter == 'F' and v < 0) or abs(v) >= 1 << 31:
+      return None
+    values[letter] = v
+  if not values:
+    return None
+  return flags, values
+
+
+class Packer:
+  def __init__(self, digits):
+    self.digits = digits
+    self.reset()
+
+  def reset(self):
+    self.last = [0, 0, 0, 0]
+
+  def record(self, flags, values):
+    out = bytearray()
+    for i, a in enumerate(AXES):
+      if a in values:
+        flags |= 1 << i
+        out += varint(zigzag(values[a] - self.last[i]))
+        self.last[i] = values[a]
+    if 'F' in values:
+      flags |= FLAG_F
+      out += varint(values['F'])
+    return bytes([0x80 | flags]) + bytes(out)
+
+  def encode(self, line):
+    """ Encoded bytes of a line and its size once decoded in the gcode ring """
+    move = parse_move(line, self.digits)
+    if move:
+      return self.record(*move), RECORD_SIZE
+    text = line.encode() + b'\n'
+    if text[0] >= 0x80:
+      text = b' ' + text  # the controller skips leading spaces
+    return text, len(text)
+
+
+def pack_file(lines, digits, pack_size=PACK_SIZE, unpack_size=UNPACK_SIZE):
+  """ [(start_line, end_line, data, raw_len)], lines counted from 1 """
+  packer = Packer(digits)
+  packets = []
+  data, raw, start = bytearray(), 0, 1
+  for n, line in enumerate(lines, 1):
+    enc, size = packer.encode(line)
+    if data and (len(data) + len(enc) > pack_size or raw + size > unpack_size):
+      packets.append((start, n - 1, bytes(data), raw))
+      packer.reset()
+      data, raw, start = bytearray(), 0, n
+      enc, size = packer.encode(line)
+    data += enc
+    raw += size
+  if data:
+    packets.append((start, len(lines), bytes(data), raw))
+  return packets
+
+
+def unpack(data, digits):
+  """ Lines of a packet, records as (flags, {letter: value}) """
+  last = [0, 0, 0, 0]
+  lines, pos = [], 0
+  while pos < len(data):
+    if data[pos] < 0x80:
+      eol = data.index(b'\n', pos)
+      lines.append(data[pos:eol].decode().lstrip(' '))
+      pos = eol + 1
+      continue
+    flags = data[pos] & 0x3F
+    pos += 1
+    values = {}
+    for i, a in enumerate(AXES):
+      if flags & (1 << i):
+        v, pos = read_varint(data, pos)
+        last[i] += unzigzag(v)
+        values[a] = last[i]
+    if flags & FLAG_F:
+      values['F'], pos = read_varint(data, pos)
+    lines.append((flags, values))
+  return lines
+
+
+def main():
+  parser = argparse.ArgumentParser(description='Pack a gcode file into motion records')
+  parser.add_argument('gcode')
+  parser.add_argument('--xyz', type=int, default=3, help='decimal digits of XYZ')
+  parser.add_argument('--e', type=int, default=5, help='decimal digits of E')
+  parser.add_argument('--f', type=int, default=0, help='decimal digits of F')
+  args = parser.parse_args()
+  digits = {'XYZ': args.xyz, 'E': args.e, 'F': args.f}
+
+  with open(args.gcode, encoding='utf-8', errors='replace') as f:
+    lines = f.read().split('\n')
+  if lines and lines[-1] == '':
+    lines.pop()
+
+  packets = pack_file(lines, digits)
+  text_bytes = sum(len(l.encode()) + 1 for l in lines)
+  packed_bytes = sum(len(p[2]) for p in packets)
+  records = 0
+  for start, end, data, _ in packets:
+    decoded = unpack(data, digits)
+    assert len(decoded) == end - start + 1, 'line count of packet %d' % start
+    for n, got in zip(range(start, end + 1), decoded):
+      move = parse_move(lines[n - 1], digits)
+      if move:
+        records += 1
+        assert got == (move[0] | sum(1 << i for i, a in enumerate(AXES) if a in move[1])
+                       | (FLAG_F if 'F' in move[1] else 0), move[1]), 'line %d' % n
+      else:
+        assert got == lines[n - 1].lstrip(' '), 'line %d' % n
+
+  print('lines: %d, records: %d, packets: %d' % (len(lines), records, len(packets)))
+  print('text: %d bytes, packed: %d bytes, %.1f%% saved' %
+        (text_bytes, packed_bytes, 100.0 * (1 - packed_bytes / max(text_bytes, 1))))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,173 @@
+#pragma once
+// Stands in for the GD32 HAL.h when the sources are built on the host
+#define CPU_32_BIT
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (s)
+#define PGMSTR(NAM,STR) const char NAM[] = STR
+#define pgm_read_byte(a) (*(const uint8_t *)(a))
+#define pgm_read_word(a) (*(const uint16_t *)(a))
+#define pgm_read_dword(a) (*(const uint32_t *)(a))
+#define pgm_read_float(a) (*(const float *)(a))
+#define pgm_read_ptr(a) (*(a))
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+typedef uint8_t byte;
+typedef int8_t pin_t;
+
+#ifndef F_CPU
+  #define F_CPU 120000000UL
+#endif
+#define FORCE_INLINE __attribute__((always_inline)) inline
+
+// Pins exist so the pin map builds, none of them does anything
+enum {
+  PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+  PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+  PC0, PC1, PC2, PC3, PC4, PC5, PC6, PC7, PC8, PC9, PC10, PC11, PC12, PC13, PC14, PC15,
+  PD0, PD1, PD2, PD3, PD4, PD5, PD6, PD7, PD8, PD9, PD10, PD11, PD12, PD13, PD14, PD15,
+  PE0, PE1, PE2, PE3, PE4, PE5, PE6, PE7, PE8, PE9, PE10, PE11, PE12, PE13, PE14, PE15,
+};
+#define HIGH 1
+#define LOW 0
+#define READ(IO) LOW
+#define WRITE(IO,V) ((void)(IO), (void)(V))
+#define TOGGLE(IO) ((void)(IO))
+#define WRITE_VAR(IO,V) WRITE(IO,V)
+#define OUT_WRITE(IO,V) WRITE(IO,V)
+#define SET_INPUT(IO) ((void)(IO))
+#define SET_INPUT_PULLUP(IO) ((void)(IO))
+#define SET_INPUT_PULLDOWN(IO) ((void)(IO))
+#define SET_OUTPUT(IO) ((void)(IO))
+#define SET_PWM(IO) ((void)(IO))
+#define PWM_PIN(P) false
+#define extDigitalRead(IO) LOW
+#define extDigitalWrite(IO,V) WRITE(IO,V)
+#define digitalRead(IO) LOW
+#define digitalWrite(IO,V) WRITE(IO,V)
+#define pwmWrite(IO,V) WRITE(IO,V)
+#define analogWrite(IO,V) WRITE(IO,V)
+
+// Delay.h leaves DELAY_CYCLES to the platform
+#define __PLAT_LINUX__
+#define DELAY_CYCLES(x) ((void)(x))
+
+#define HAL_ADC_RESOLUTION 12
+#define HAL_ADC_RANGE _BV(HAL_ADC_RESOLUTION)
+
+class Stream {};
+class SPIClass {};
+
+// Timers of the host run the stepper ISR by hand
+typedef uint16_t hal_timer_t;
+#define HAL_TIMER_TYPE_MAX 0xFFFF
+#define HAL_TIMER_RATE uint32_t(F_CPU)
+#define STEP_TIMER_NUM 5
+#define TEMP_TIMER_NUM 2
+#define PULSE_TIMER_NUM STEP_TIMER_NUM
+#define TEMP_TIMER_FREQUENCY 1000
+#define STEPPER_TIMER_PRESCALE 40
+#define STEPPER_TIMER_RATE (HAL_TIMER_RATE / STEPPER_TIMER_PRESCALE)
+#define STEPPER_TIMER_TICKS_PER_US ((STEPPER_TIMER_RATE) / 1000000)
+#define STEPPER_TIMER_TICKS_PER_MS ((STEPPER_TIMER_RATE) / 1000)
+#define PULSE_TIMER_RATE STEPPER_TIMER_RATE
+#define PULSE_TIMER_PRESCALE STEPPER_TIMER_PRESCALE
+#define PULSE_TIMER_TICKS_PER_US STEPPER_TIMER_TICKS_PER_US
+extern bool host_stepper_isr_enabled;
+#define ENABLE_STEPPER_DRIVER_INTERRUPT() (host_stepper_isr_enabled = true)
+#define DISABLE_STEPPER_DRIVER_INTERRUPT() (host_stepper_isr_enabled = false)
+#define STEPPER_ISR_ENABLED() host_stepper_isr_enabled
+#define ENABLE_TEMPERATURE_INTERRUPT()
+#define DISABLE_TEMPERATURE_INTERRUPT()
+#define HAL_timer_get_count(timer_num) 0
+#define HAL_CYCLES_PER_US ((F_CPU) / 1000000UL)
+#define HAL_cycle_count() 0
+#define HAL_STEP_TIMER_ISR() void stepTC_Handler()
+#define HAL_TEMP_TIMER_ISR() void tempTC_Handler()
+#define HAL_timer_isr_prologue(TIMER_NUM)
+#define HAL_timer_isr_epilogue(TIMER_NUM)
+inline void HAL_timer_start(const uint8_t, const uint32_t) {}
+inline void HAL_timer_set_compare(const uint8_t, const hal_timer_t) {}
+inline hal_timer_t HAL_timer_get_compare(const uint8_t) { return 0; }
+
+extern uint32_t host_millis;
+inline uint32_t millis() { return host_millis; }
+inline uint32_t micros() { return host_millis * 1000; }
+
+#define CRITICAL_SECTION_START
+#define CRITICAL_SECTION_END
+#define ISRS_ENABLED() true
+#define ENABLE_ISRS()
+#define DISABLE_ISRS()
+#define cli()
+#define sei()
+
+#include "../../inc/MarlinConfigPre.h"
+#include "../../core/serial_base.h"
+
+#define sq(x) ((x)*(x))
+#define square(x) ((x)*(x))
+// wirish_math.h has them as macros, those would break the C++ headers
+template <class A, class B> inline auto min(const A a, const B b) -> decltype(a < b ? a : b) { return a < b ? a : b; }
+template <class A, class B> inline auto max(const A a, const B b) -> decltype(a > b ? a : b) { return a > b ? a : b; }
+#define constrain(v, lo, hi) ((v) < (lo) ? (lo) : (v) > (hi) ? (hi) : (v))
+
+// Serial output goes to stdout when TEST_VERBOSE is set
+extern bool host_verbose;
+struct HostSerial : public SerialBase<HostSerial> {
+  HostSerial() : SerialBase<HostSerial>(false) {}
+  void begin(long) {}
+  void end() {}
+  void write(uint8_t c) { if (host_verbose) putchar(c); }
+  int available(serial_index_t=0) { return 0; }
+  int read(serial_index_t=0) { return -1; }
+  void flush() {}
+  void msgDone() {}
+  bool connected() { return true; }
+  SerialFeature features(serial_index_t=0) const { return SerialFeature::None; }
+
+  // The SACP side of the GD32 serial. A test feeds what the port receives,
+  // and a kick sends everything the TX pull source has, as the TXE IRQ would
+  bool enable_sacp_ = false;
+  void enable_sacp(bool enable) { enable_sacp_ = enable; }
+  bool enable_sacp() { return enable_sacp_; }
+  void rx_notify(void (*)(void)) {}
+  size_t write_byte(uint8_t c) { tx_out[tx_len++ % sizeof(tx_out)] = c; return 1; }
+
+  uint8_t rx_in[4096];
+  uint32_t rx_head = 0, rx_tail = 0;
+  void host_receive(const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) rx_in[rx_head++ % sizeof(rx_in)] = data[i];
+  }
+  uint32_t read(uint8_t *buf, uint32_t len) {
+    uint32_t n = 0;
+    while (n < len && rx_tail != rx_head) buf[n++] = rx_in[rx_tail++ % sizeof(rx_in)];
+    return n;
+  }
+
+  int16_t (*tx_pull_fn)(uint8_t) = NULL;
+  uint8_t tx_out[4096];
+  uint32_t tx_len = 0;
+  void tx_pull(int16_t (*fn)(uint8_t)) { tx_pull_fn = fn; }
+  void tx_kick() {
+    for (int16_t c; tx_pull_fn && (c = tx_pull_fn(1)) >= 0;) tx_out[tx_len++ % sizeof(tx_out)] = c;
+  }
+};
+extern HostSerial MSerial1, MSerial2;
+typedef HostSerial HardwareSerial;
+#define MYSERIAL0 MSerial1
+#define MYSERIAL1 MSerial1
+#define NUM_SERIAL 1
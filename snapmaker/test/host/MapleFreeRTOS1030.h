@@ -0,0 +1,66 @@
+#pragma once
+// FreeRTOS types and calls the host builds see, one task and no preemption
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *QueueHandle_t;
+typedef void *TimerHandle_t;
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+typedef void (*TaskFunction_t)(void *);
+
+// The host runs one thread, taking a lock or waiting never blocks
+extern uint32_t host_millis;
+inline void vTaskDelay(TickType_t ticks) { host_millis += ticks; }
+inline TickType_t xTaskGetTickCount() { return host_millis; }
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return (SemaphoreHandle_t)1; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t ticks) { host_millis += ticks; return 0; }
+inline BaseType_t xTaskCreate(TaskFunction_t, const char *, uint16_t, void *, UBaseType_t, TaskHandle_t *) { return pdFAIL; }
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t *) {}
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+#define taskSCHEDULER_RUNNING 2
+inline BaseType_t xTaskGetSchedulerState() { return taskSCHEDULER_RUNNING; }
+
+// Queues copy their items like FreeRTOS does, a full or empty one fails at once
+struct HostQueue {
+  UBaseType_t length, item_size, head, count;
+  uint8_t *items;
+};
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  HostQueue *q = (HostQueue *)calloc(1, sizeof(HostQueue));
+  q->length = length;
+  q->item_size = item_size;
+  q->items = (uint8_t *)calloc(length, item_size);
+  return q;
+}
+inline BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t) {
+  HostQueue *q = (HostQueue *)handle;
+  if (q->count == q->length) return pdFAIL;
+  memcpy(q->items + (q->head + q->count) % q->length * q->item_size, item, q->item_size);
+  q->count++;
+  return pdPASS;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t) {
+  HostQueue *q = (HostQueue *)handle;
+  if (!q->count) return pdFAIL;
+  memcpy(item, q->items + q->head * q->item_size, q->item_size);
+  q->head = (q->head + 1) % q->length;
+  q->count--;
+  return pdPASS;
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) { return ((HostQueue *)handle)->count; }
+#define configASSERT(x) do { if (!(x)) abort(); } while (0)
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
@@ -0,0 +1,74 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// What the callbacks of event_printer.cpp and the print control reach
+// besides the gcode ring. The callback table keeps them linked, the tests
+// only run the gcode requests and none of these is called
+
+#include "src/inc/MarlinConfig.h"
+#include "src/module/motion.h"
+#include "src/module/planner.h"
+#include "src/module/tool_change.h"
+#include "snapmaker/event/event_base.h"
+#include "snapmaker/module/exception.h"
+#include "snapmaker/module/fdm.h"
+#include "snapmaker/module/motion_control.h"
+#include "snapmaker/module/power_loss.h"
+#include "snapmaker/module/system.h"
+
+Exception exception_server;
+FDM_Head fdm_head;
+MotionControl motion_control;
+
+volatile uint8_t Planner::block_buffer_head, Planner::block_buffer_tail;
+int16_t Planner::flow_percentage[EXTRUDERS];
+float Planner::e_factor[EXTRUDERS];
+float Planner::volumetric_multiplier[EXTRUDERS];
+
+linear_axis_bits_t axis_homed;
+float duplicate_extruder_x_offset;
+int16_t feedrate_percentage;
+bool x_first_move;
+
+bool Exception::is_allow_work(bool) { return true; }
+uint8_t FDM_Head::get_key(uint8_t) { return 0; }
+bool FDM_Head::is_duplicating() { return false; }
+ErrCode MotionControl::home() { return E_SUCCESS; }
+void MotionControl::retrack_e(float, uint16_t) {}
+void MotionControl::synchronize() {}
+
+void PowerLoss::clear() {}
+ErrCode PowerLoss::is_power_loss_data() { return E_FAILURE; }
+ErrCode PowerLoss::power_loss_resume() { return E_FAILURE; }
+void PowerLoss::stash_print_env() {}
+ErrCode PowerLoss::set_file_name(uint8_t *, uint8_t) { return E_SUCCESS; }
+ErrCode PowerLoss::set_file_md5(uint8_t *, uint8_t) { return E_SUCCESS; }
+uint8_t *PowerLoss::get_file_name(uint8_t &len) { len = 0; return NULL; }
+uint8_t *PowerLoss::get_file_md5(uint8_t &len) { len = 0; return NULL; }
+void PowerLoss::write_flash() {}
+
+void idex_set_mirrored_mode(const bool) {}
+void quickstop_stepper() {}
+void tool_change(const uint8_t, bool) {}
+void tmc_set_stealthChop(uint8_t, bool) {}
+
+ErrCode send_event(event_param_t &) { return E_SUCCESS; }
+void event_filter_select(event_param_t &, uint8_t) {}
@@ -0,0 +1,52 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/debug/debug.h"
+#include <stdarg.h>
+
+// What the host HAL declares in place of the GD32 core
+uint32_t host_millis;
+bool host_stepper_isr_enabled;
+HostSerial MSerial1, MSerial2;
+bool host_verbose;
+
+// debug.cpp sends the log to the HMI as well, the host only prints it
+SnapDebug debug;
+
+void SnapDebug::Log(debug_level_e level, const char *fmt, ...) {
+  if (!host_verbose) return;
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+uint32_t test_checks;
+uint32_t test_failures;
+
+int main(int argc, char *argv[]) {
+  host_verbose = getenv("TEST_VERBOSE") != NULL;
+  test_main();
+  printf("%s: %u checks, %u failed\n", argv[0], test_checks, test_failures);
+  return test_failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+// Included ahead of every file of a test that builds libmaple sources, see
+// test_usart_rx_DEFS. glibc's __always_inline already says inline and libmaple
+// puts another inline in front of it, so it is changed for libmaple only
+#include <sys/cdefs.h>
+#pragma push_macro("__always_inline")
+#undef __always_inline
+#define __always_inline __attribute__((always_inline))
+
+// The bit-band region only exists on the MCU, its address math does not fit
+// a 64 bit pointer. The USART code does not use it
+#define _LIBMAPLE_BITBAND_H_
+#include <libmaple/libmaple_types.h>
+static inline volatile uint32 *bb_perip(volatile void *address, uint32 bit) { return (volatile uint32 *)address; }
+static inline uint8 bb_peri_get_bit(volatile void *address, uint32 bit) { return 0; }
+static inline void bb_peri_set_bit(volatile void *address, uint32 bit, uint8 val) {}
+
+#include <libmaple/usart.h>
+#include "usart_private.h"
+
+#pragma pop_macro("__always_inline")
@@ -0,0 +1,48 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// What the gcode ring in print_control.cpp reaches outside of it
+
+#include "src/inc/MarlinConfig.h"
+#include "src/module/motion.h"
+#include "snapmaker/module/power_loss.h"
+#include "snapmaker/module/system.h"
+#include "snapmaker/module/filament_sensor.h"
+
+PowerLoss power_loss;
+SystemService system_service;
+FilamentSensor filament_sensor;
+uint8_t active_extruder;
+DualXMode dual_x_carriage_mode;
+
+ErrCode SystemService::set_status(system_status_e status, system_status_source_e source) {
+  status_ = status;
+  source_ = source;
+  return E_SUCCESS;
+}
+
+void SystemService::return_to_idle() {
+  status_ = SYSTEM_STATUE_IDLE;
+}
+
+bool SystemService::is_working() { return status_ != SYSTEM_STATUE_IDLE; }
+
+void FilamentSensor::reset() {}
@@ -0,0 +1,54 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// What the planner and the stepper ISR reach outside of the motion code. The
+// replay runs no endstops, sensors or power loss, all of them stay idle
+
+#include "src/inc/MarlinConfig.h"
+#include "src/gcode/queue.h"
+#include "src/module/endstops.h"
+#include "src/module/motion.h"
+#include "src/module/temperature.h"
+#include "snapmaker/J1/switch_detect.h"
+#include "snapmaker/module/fdm.h"
+#include "snapmaker/module/filament_sensor.h"
+#include "snapmaker/module/motion_control.h"
+#include "snapmaker/module/power_loss.h"
+
+FDM_Head fdm_head;
+MotionControl motion_control;
+SwitchDetect switch_detect;
+
+GCodeQueue::RingBuffer GCodeQueue::ring_buffer = { 0 };
+uint8_t Temperature::fan_speed[FAN_COUNT];
+
+xyze_pos_t current_position, destination;
+bool extruder_duplication_enabled;
+
+bool got_stepper_debug_info;
+xyze_pos_t stepper_cur_position, motion_cur_position, motion_get_position;
+
+void Endstops::update() {}
+void FilamentSensor::e0_step(uint8_t) {}
+void FilamentSensor::e1_step(uint8_t) {}
+bool PowerLoss::check() { return false; }
+void SwitchDetect::check() {}
+void SwitchDetect::disable_all() {}
@@ -0,0 +1,218 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// SACP requests from the HMI port to the callbacks and back. The payload a
+// callback sees lies in the frame the parser filled and the reply is packaged
+// in that same frame, nothing is copied before the TX queue. Queued events
+// keep their frame until they ran: the pool runs dry exactly when every event
+// cache waits, and each frame comes back once its callback returned
+
+#include "test.h"
+#include <chrono>
+#include <stddef.h>
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/event/event.h"
+#include "snapmaker/event/event_system.h"
+#include "snapmaker/event/event_fdm.h"
+#include "snapmaker/event/event_bed.h"
+#include "snapmaker/event/event_calibtration.h"
+#include "snapmaker/event/event_printer.h"
+#include "snapmaker/event/event_enclouser.h"
+#include "snapmaker/event/event_update.h"
+#include "snapmaker/event/event_exception.h"
+
+#define ID_ECHO 0x01  // Direct run, replies with the payload inverted
+#define ID_QUEUED 0x02  // Task run, records its payload
+#define PAYLOAD_LEN 24
+
+event_cb_info_t system_cb_info[SYS_ID_CB_COUNT];
+event_cb_info_t fdm_cb_info[FDM_ID_CB_COUNT];
+event_cb_info_t bed_cb_info[BED_ID_CB_COUNT];
+event_cb_info_t calibtration_cb_info[CAlIBRATION_ID_CB_COUNT];
+event_cb_info_t printer_cb_info[PRINTER_ID_CB_COUNT];
+event_cb_info_t enclouser_cb_info[ENCLOUSER_ID_CB_COUNT];
+event_cb_info_t update_cb_info[UPDATE_ID_CB_COUNT];
+event_cb_info_t exception_cb_info[EXCEPTION_ID_CB_COUNT];
+void printer_event_init(void) {}
+
+static HardwareSerial &hmi = MSerial2;
+static ProtocolSACP reply_parser;
+static SACP_param_t reply;
+static uint32_t tx_read;
+static uint16_t sequence;
+
+static uint32_t echo_calls, echo_in_place, echo_reply_in_frame;
+static uint8_t queued_seen[EVENT_CACHE_COUNT * 4];
+static uint32_t queued_calls, queued_intact;
+
+static void payload_for(uint16_t seq, uint8_t *payload) {
+  for (uint8_t i = 0; i < PAYLOAD_LEN; i++) payload[i] = (uint8_t)(seq * 7 + i);
+}
+
+static ErrCode echo_cb(event_param_t &event) {
+  echo_calls++;
+  if (event.data == event.frame + offsetof(SACP_struct_t, data) && event.length == PAYLOAD_LEN) {
+    echo_in_place++;
+  }
+  for (uint16_t i = 0; i < event.length; i++) event.data[i] ^= 0xff;
+  uint32_t before = hmi.tx_len;
+  send_event(event, event.data, event.length);
+  // What went out is the request frame, rewritten into the reply
+  uint32_t sent = hmi.tx_len - before, same = 0;
+  while (same < sent && hmi.tx_out[(before + same) % sizeof(hmi.tx_out)] == event.frame[same]) same++;
+  if (sent == (uint32_t)(SACP_HEADER_LEN + event.length) && same == sent) {
+    echo_reply_in_frame++;
+  }
+  return E_SUCCESS;
+}
+
+static ErrCode queued_cb(event_param_t &event) {
+  uint8_t payload[PAYLOAD_LEN];
+  payload_for(event.info.sequence, payload);
+  if (event.length == PAYLOAD_LEN && !memcmp(event.data, payload, PAYLOAD_LEN)) {
+    queued_intact++;
+  }
+  if (queued_calls < sizeof(queued_seen)) {
+    queued_seen[queued_calls] = event.info.sequence;
+  }
+  queued_calls++;
+  return E_SUCCESS;
+}
+
+static uint16_t request(uint8_t command_id, uint8_t *frame) {
+  SACP_head_base_t head = {0x02, 0, sequence, COMMAND_SET_SYS, command_id};
+  uint8_t payload[PAYLOAD_LEN];
+  payload_for(sequence++, payload);
+  return protocol_sacp.package(head, payload, PAYLOAD_LEN, frame);
+}
+
+static void receive(uint8_t command_id, uint8_t count) {
+  uint8_t frame[PACK_PARSE_MAX_SIZE];
+  while (count--) {
+    hmi.host_receive(frame, request(command_id, frame));
+  }
+  while (event_handler.recv_poll()) {}
+}
+
+// The next reply on the HMI port, false when nothing complete was sent
+static bool next_reply() {
+  while (tx_read != hmi.tx_len) {
+    uint16_t used = 0;
+    uint8_t *c = &hmi.tx_out[tx_read % sizeof(hmi.tx_out)];
+    ErrCode ret = reply_parser.parse(c, 1, reply, used);
+    tx_read++;
+    if (ret == E_SUCCESS) return true;
+  }
+  return false;
+}
+
+static void check_echo() {
+  receive(ID_ECHO, 1);
+  CHECK_EQ(echo_calls, 1);
+  CHECK_EQ(echo_in_place, 1);
+  CHECK_EQ(echo_reply_in_frame, 1);
+  CHECK(next_reply());
+  CHECK_EQ(reply.sacp.attr, SACP_ATTR_ACK);
+  CHECK_EQ(reply.sacp.sequence, sequence - 1);
+  CHECK_EQ(reply.sacp.command_id, ID_ECHO);
+  CHECK_EQ(reply.sacp.length, PAYLOAD_LEN + 8);
+  uint8_t payload[PAYLOAD_LEN];
+  payload_for(sequence - 1, payload);
+  for (uint8_t i = 0; i < PAYLOAD_LEN; i++) CHECK_EQ(reply.sacp.data[i], (uint8_t)~payload[i]);
+  CHECK(!next_reply());
+  // The parser keeps its frame, a direct run takes none from the pool
+  CHECK_EQ(event_frame_pool_free(), EVENT_FRAME_POOL_COUNT - EVENT_SOURCE_ALL);
+}
+
+static void check_pool() {
+  const uint16_t first = sequence;
+  queued_calls = queued_intact = 0;
+
+  // Every queued request takes the frame it was parsed in along
+  for (uint8_t i = 0; i < EVENT_CACHE_COUNT; i++) {
+    receive(ID_QUEUED, 1);
+    CHECK_EQ(event_frame_pool_free(), EVENT_FRAME_POOL_COUNT - EVENT_SOURCE_ALL - i - 1);
+  }
+  CHECK_EQ(event_frame_pool_free(), 0);
+  CHECK(!next_reply());
+
+  // With every cache waiting the next one is refused, its frame is reused
+  receive(ID_QUEUED, 1);
+  CHECK(next_reply());
+  CHECK_EQ(reply.sacp.sequence, sequence - 1);
+  CHECK_EQ(reply.sacp.length, 1 + 8);
+  CHECK_EQ(reply.sacp.data[0], E_NO_MEM);
+  CHECK_EQ(event_frame_pool_free(), 0);
+  CHECK_EQ(queued_calls, 0);
+
+  // Run in order, each on its own payload, and every frame comes back
+  for (uint8_t i = 0; i < EVENT_CACHE_COUNT; i++) {
+    CHECK(event_handler.dispatch(0));
+    CHECK_EQ(event_frame_pool_free(), i + 1);
+  }
+  CHECK(!event_handler.dispatch(0));
+  CHECK_EQ(queued_calls, EVENT_CACHE_COUNT);
+  CHECK_EQ(queued_intact, EVENT_CACHE_COUNT);
+  for (uint8_t i = 0; i < EVENT_CACHE_COUNT; i++) CHECK_EQ(queued_seen[i], (uint8_t)(first + i));
+  CHECK_EQ(event_frame_pool_free(), EVENT_FRAME_POOL_COUNT - EVENT_SOURCE_ALL);
+}
+
+static double bench_ns(uint8_t command_id, uint32_t rounds) {
+  uint8_t frame[PACK_PARSE_MAX_SIZE];
+  uint16_t len = request(command_id, frame);
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; i++) {
+    hmi.host_receive(frame, len);
+    while (event_handler.recv_poll()) {}
+    while (event_handler.dispatch(0)) {}
+  }
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  tx_read = hmi.tx_len;
+  return (double)ns / rounds;
+}
+
+void test_main() {
+  for (uint8_t i = 0; i < SYS_ID_CB_COUNT; i++) system_cb_info[i].command_id = 0x10 + i;
+  system_cb_info[0] = {ID_ECHO, EVENT_CB_DIRECT_RUN, echo_cb};
+  system_cb_info[1] = {ID_QUEUED, EVENT_CB_TASK_RUN, queued_cb};
+
+  event_init();
+  CHECK_EQ(event_frame_pool_free(), EVENT_FRAME_POOL_COUNT);
+  event_handler.recv_init();
+  event_handler.recv_enable(EVENT_SOURCE_HMI);
+  CHECK_EQ(event_frame_pool_free(), EVENT_FRAME_POOL_COUNT - EVENT_SOURCE_ALL);
+
+  check_echo();
+  // The pool is drained and filled again, nothing leaks over the rounds
+  for (uint8_t round = 0; round < 20; round++) check_pool();
+  CHECK_EQ(event_tx_stats[EVENT_SOURCE_HMI].dropped, 0);
+
+  uint32_t calls = echo_calls;
+  double echo_ns = bench_ns(ID_ECHO, 100000);
+  CHECK_EQ(echo_calls - calls, 100000);
+  CHECK_EQ(echo_reply_in_frame, echo_calls);
+  calls = queued_calls;
+  double queued_ns = bench_ns(ID_QUEUED, 100000);
+  CHECK_EQ(queued_calls - calls, 100000);
+  CHECK_EQ(event_frame_pool_free(), EVENT_FRAME_POOL_COUNT - EVENT_SOURCE_ALL);
+  printf("dispatch: %d byte request, direct run with reply %.0f ns, task run %.0f ns\n",
+         PAYLOAD_LEN, echo_ns, queued_ns);
+}
@@ -0,0 +1,193 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// On-change subscriptions of a callback that reports once per hotend, as the
+// fdm and printer ones do, while the hotends change state at their own pace.
+// What reaches the HMI port must be exactly what a per report model sends: a
+// report only when its hotend changed or its keepalive ran out, every change
+// at the first report after it. Without event_filter_select() the two reports
+// compare against each other and nothing is ever suppressed
+
+#include "test.h"
+#include <stddef.h>
+#include <vector>
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/event/subscribe.h"
+
+#define SUB_SET 0x10
+#define ID_SELECT 0x01  // Selects the report of each hotend
+#define ID_PLAIN 0x02  // Does not
+#define PERIOD_MS 100
+#define KEEPALIVE_MS 1000
+#define RUN_MS 20000
+#define REPORT_LEN 3
+
+static HardwareSerial &hmi = MSerial2;
+static uint8_t state[HOTENDS];
+static uint32_t attempts;
+
+static ErrCode report_hotends(event_param_t &event, bool select) {
+  HOTEND_LOOP() {
+    if (select) event_filter_select(event, e);
+    event.data[0] = E_SUCCESS;
+    event.data[1] = e;
+    event.data[2] = state[e];
+    event.length = REPORT_LEN;
+    send_event(event);
+    attempts++;
+  }
+  return E_SUCCESS;
+}
+
+static event_cb_info_t cb_info[] = {
+  { ID_SELECT, EVENT_CB_TASK_RUN, [](event_param_t &event) { return report_hotends(event, true); } },
+  { ID_PLAIN, EVENT_CB_TASK_RUN, [](event_param_t &event) { return report_hotends(event, false); } },
+};
+event_cb_info_t * get_event_info(uint8_t cmd_set, uint8_t cmd_id) {
+  return cmd_set == SUB_SET && cmd_id >= ID_SELECT && cmd_id <= ID_PLAIN ? &cb_info[cmd_id - 1] : NULL;
+}
+
+static ErrCode sub_request(uint8_t id, bool enable) {
+  uint8_t data[7] = { SUB_SET, id, PERIOD_MS, 0, SUBSCRIBE_FLAG_ON_CHANGE,
+                      (uint8_t)KEEPALIVE_MS, (uint8_t)(KEEPALIVE_MS >> 8) };
+  event_param_t event = {};
+  event.info.recever_id = 0x02;
+  event.source = EVENT_SOURCE_HMI;
+  event.data = data;
+  event.length = enable ? sizeof(data) : 2;
+  return enable ? subscribe.enable(event) : subscribe.disable(event);
+}
+
+typedef struct {
+  uint32_t ms;
+  uint8_t e, value;
+} report_t;
+
+// The reports on the HMI port since the last call, stamped with now
+static ProtocolSACP wire_parser;
+static SACP_param_t wire_frame;
+static uint32_t wire_read;
+static void read_wire(std::vector<report_t> &out) {
+  for (; wire_read != hmi.tx_len; wire_read++) {
+    uint16_t used = 0;
+    if (wire_parser.parse(&hmi.tx_out[wire_read % sizeof(hmi.tx_out)], 1, wire_frame, used) == E_SUCCESS) {
+      const uint8_t *payload = wire_frame.buff + offsetof(SACP_struct_t, data);
+      CHECK_EQ(wire_frame.sacp.length, REPORT_LEN + 8);
+      out.push_back({ millis(), payload[1], payload[2] });
+    }
+  }
+}
+
+// Hotend 0 changes rarely, hotend 1 often and sometimes back and forth
+static void set_state(uint32_t ms) {
+  state[0] = ms < 7350 ? 20 : ms < 15420 ? 60 : 200;
+  state[1] = (ms / 700) % 4 == 3 ? 90 : 100 + (ms / 1400) % 3;
+}
+
+static void run(uint8_t id, std::vector<report_t> &wire, uint32_t &suppressed, uint32_t &suppressed_bytes) {
+  const uint32_t start = millis();
+  event_tx_stats_t before = event_tx_stats[EVENT_SOURCE_HMI];
+  attempts = 0;
+  set_state(0);
+  CHECK_EQ(sub_request(id, true), E_SUCCESS);
+  while (PENDING(millis(), start + RUN_MS)) {
+    set_state(millis() - start);
+    uint32_t wait_ms = subscribe.run_due(millis());
+    read_wire(wire);
+    host_millis += _MIN(wait_ms, start + RUN_MS - millis());
+  }
+  CHECK_EQ(sub_request(id, false), E_SUCCESS);
+  suppressed = event_tx_stats[EVENT_SOURCE_HMI].suppressed - before.suppressed;
+  suppressed_bytes = event_tx_stats[EVENT_SOURCE_HMI].suppressed_bytes - before.suppressed_bytes;
+  CHECK_EQ(event_tx_stats[EVENT_SOURCE_HMI].dropped, before.dropped);
+}
+
+static void check_select() {
+  const uint32_t start = millis();
+  std::vector<report_t> wire;
+  uint32_t suppressed, suppressed_bytes;
+  run(ID_SELECT, wire, suppressed, suppressed_bytes);
+
+  // Each hotend on its own: sent when changed or KEEPALIVE_MS after the last
+  std::vector<report_t> model;
+  bool sent[HOTENDS] = { false };
+  uint8_t last[HOTENDS];
+  uint32_t last_ms[HOTENDS];
+  for (uint32_t ms = start; PENDING(ms, start + RUN_MS); ms += PERIOD_MS) {
+    set_state(ms - start);
+    HOTEND_LOOP() {
+      if (sent[e] && last[e] == state[e] && PENDING(ms, last_ms[e] + KEEPALIVE_MS)) continue;
+      model.push_back({ ms, (uint8_t)e, state[e] });
+      sent[e] = true;
+      last[e] = state[e];
+      last_ms[e] = ms;
+    }
+  }
+
+  CHECK_EQ(wire.size(), model.size());
+  for (size_t i = 0; i < wire.size() && i < model.size(); i++) {
+    CHECK_EQ(wire[i].ms, model[i].ms);
+    CHECK_EQ(wire[i].e, model[i].e);
+    CHECK_EQ(wire[i].value, model[i].value);
+  }
+  CHECK_EQ(attempts, RUN_MS / PERIOD_MS * HOTENDS);
+  CHECK_EQ(suppressed, attempts - wire.size());
+  CHECK_EQ(suppressed_bytes, suppressed * REPORT_LEN);
+
+  // A change is on the wire at the first report after it, the quiet hotend
+  // only goes out for its two changes and every keepalive
+  uint32_t quiet = 0;
+  for (const report_t &r : wire) quiet += r.e == 0;
+  CHECK(quiet <= RUN_MS / KEEPALIVE_MS + 2);
+  for (uint32_t ms = start + PERIOD_MS; PENDING(ms, start + RUN_MS); ms += PERIOD_MS) {
+    uint8_t before[HOTENDS], now[HOTENDS];
+    set_state(ms - PERIOD_MS - start);
+    memcpy(before, state, sizeof(before));
+    set_state(ms - start);
+    memcpy(now, state, sizeof(now));
+    HOTEND_LOOP() {
+      if (before[e] == now[e]) continue;
+      bool found = false;
+      for (const report_t &r : wire) found |= r.ms == ms && r.e == e && r.value == now[e];
+      CHECK(found);
+    }
+  }
+  printf("select: %u reports, %u sent, %u suppressed\n", attempts, (uint32_t)wire.size(), suppressed);
+}
+
+static void check_plain() {
+  std::vector<report_t> wire;
+  uint32_t suppressed, suppressed_bytes;
+  run(ID_PLAIN, wire, suppressed, suppressed_bytes);
+  // The hotends share one hash and replace each other's every time
+  CHECK_EQ(suppressed, 0);
+  CHECK_EQ(wire.size(), attempts);
+  printf("plain: %u reports, %u sent, %u suppressed\n", attempts, (uint32_t)wire.size(), suppressed);
+}
+
+void test_main() {
+  subscribe.init();
+  hmi.enable_sacp(true);
+  event_base_init();
+  host_millis = 1000;
+  check_select();
+  check_plain();
+}
@@ -0,0 +1,168 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Callback lookup of the SACP command sets: the index must find what a scan
+// of the cb_info arrays finds, for every command set and command id
+
+#include "test.h"
+#include <chrono>
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/event/event_cb_index.h"
+#include "snapmaker/event/event_system.h"
+#include "snapmaker/event/event_fdm.h"
+#include "snapmaker/event/event_bed.h"
+#include "snapmaker/event/event_calibtration.h"
+#include "snapmaker/event/event_printer.h"
+#include "snapmaker/event/event_enclouser.h"
+#include "snapmaker/event/event_update.h"
+#include "snapmaker/event/event_exception.h"
+
+static event_cb_info_t system_cb[SYS_ID_CB_COUNT], fdm_cb[FDM_ID_CB_COUNT], bed_cb[BED_ID_CB_COUNT],
+                       calibtration_cb[CAlIBRATION_ID_CB_COUNT], printer_cb[PRINTER_ID_CB_COUNT],
+                       enclouser_cb[ENCLOUSER_ID_CB_COUNT], update_cb[UPDATE_ID_CB_COUNT],
+                       exception_cb[EXCEPTION_ID_CB_COUNT];
+
+// The command sets of event.cpp with arrays of the same sizes
+static event_cb_set_t sets[] = {
+  {COMMAND_SET_SYS, system_cb, SYS_ID_CB_COUNT},
+  {COMMAND_SET_FDM, fdm_cb, FDM_ID_CB_COUNT},
+  {COMMAND_SET_BED, bed_cb, BED_ID_CB_COUNT},
+  {COMMAND_SET_CAlIBRATION, calibtration_cb, CAlIBRATION_ID_CB_COUNT},
+  {COMMAND_SET_PRINTER, printer_cb, PRINTER_ID_CB_COUNT},
+  {COMMAND_SET_ENCLOUSER, enclouser_cb, ENCLOUSER_ID_CB_COUNT},
+  {COMMAND_SET_UPDATE, update_cb, UPDATE_ID_CB_COUNT},
+  {COMMAND_SET_EXCEPTION, exception_cb, EXCEPTION_ID_CB_COUNT},
+};
+#define SET_COUNT COUNT(sets)
+
+static ErrCode callback(event_param_t &) { return E_SUCCESS; }
+
+typedef enum {
+  IDS_DENSE,       // 0, 1, 2 ... like most sets
+  IDS_RANDOM,      // distinct, anywhere in 0..255
+  IDS_DUPLICATE,   // random with one id used twice
+  IDS_UNUSED_TAIL, // random with zeroed entries at the end
+} ids_e;
+
+static void make_ids(event_cb_set_t &set, ids_e ids) {
+  bool used[256] = { false };
+  for (uint8_t i = 0; i < set.count; i++) {
+    uint8_t id = i;
+    if (ids != IDS_DENSE) {
+      do { id = rand() & 0xFF; } while (used[id]);
+    }
+    used[id] = true;
+    set.array[i].command_id = id;
+    set.array[i].type = EVENT_CB_DIRECT_RUN;
+    set.array[i].cb = callback;
+  }
+  if (ids == IDS_DUPLICATE && set.count > 1) {
+    set.array[set.count - 1].command_id = set.array[rand() % (set.count - 1)].command_id;
+  }
+  if (ids == IDS_UNUSED_TAIL) {
+    for (uint8_t i = set.count - 1 - rand() % ((set.count + 1) / 2); i < set.count; i++) {
+      set.array[i].command_id = 0;
+      set.array[i].cb = nullptr;
+    }
+  }
+}
+
+// What event.cpp returned before the index: the first entry with the id
+static event_cb_info_t *scan(uint8_t cmd_set, uint8_t cmd_id) {
+  for (uint8_t s = 0; s < SET_COUNT; s++) {
+    if (sets[s].command_set != cmd_set) continue;
+    for (uint8_t i = 0; i < sets[s].count; i++) {
+      if (sets[s].array[i].cb && sets[s].array[i].command_id == cmd_id) {
+        return &sets[s].array[i];
+      }
+    }
+    return NULL;
+  }
+  return NULL;
+}
+
+static void check_all(ids_e ids) {
+  for (uint8_t s = 0; s < SET_COUNT; s++) {
+    make_ids(sets[s], ids);
+  }
+  event_cb_index_build(sets, SET_COUNT);
+  for (uint16_t cmd_set = 0; cmd_set < 256; cmd_set++) {
+    for (uint16_t cmd_id = 0; cmd_id < 256; cmd_id++) {
+      CHECK(event_cb_index_find(cmd_set, cmd_id) == scan(cmd_set, cmd_id));
+    }
+  }
+  for (uint8_t s = 0; s < SET_COUNT; s++) {
+    if (ids == IDS_DENSE) {
+      // Ids 0..count-1 never collide
+      CHECK_EQ(sets[s].modulo, sets[s].count);
+    }
+    if (ids == IDS_DUPLICATE && sets[s].count > 1) {
+      // Not indexed, the first of the two is found
+      CHECK_EQ(sets[s].modulo, 0);
+    }
+  }
+}
+
+static void bench() {
+  uint32_t found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint8_t r = 0; r < 50; r++) {
+    for (uint16_t cmd_set = 0; cmd_set < 256; cmd_set++) {
+      for (uint16_t cmd_id = 0; cmd_id < 256; cmd_id++) {
+        found += event_cb_index_find(cmd_set, cmd_id) != NULL;
+      }
+    }
+  }
+  auto mid = std::chrono::steady_clock::now();
+  for (uint8_t r = 0; r < 50; r++) {
+    for (uint16_t cmd_set = 0; cmd_set < 256; cmd_set++) {
+      for (uint16_t cmd_id = 0; cmd_id < 256; cmd_id++) {
+        found -= scan(cmd_set, cmd_id) != NULL;
+      }
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  CHECK_EQ(found, 0);
+  const double lookups = 50.0 * 65536;
+  printf("index %.1f ns, scan %.1f ns per lookup over the whole command space\n",
+         std::chrono::duration<double, std::nano>(mid - start).count() / lookups,
+         std::chrono::duration<double, std::nano>(end - mid).count() / lookups);
+}
+
+void test_main() {
+  srand(1);
+  check_all(IDS_DENSE);
+  for (uint8_t i = 0; i < 50; i++) {
+    check_all(IDS_RANDOM);
+    check_all(IDS_DUPLICATE);
+    check_all(IDS_UNUSED_TAIL);
+  }
+
+  // A command set listed twice keeps its first array
+  sets[1].command_set = sets[0].command_set;
+  check_all(IDS_RANDOM);
+  CHECK(event_cb_index_find(sets[0].command_set, sets[0].array[0].command_id) == &sets[0].array[0]);
+  sets[1].command_set = COMMAND_SET_FDM;
+
+  check_all(IDS_DENSE);
+  bench();
+}
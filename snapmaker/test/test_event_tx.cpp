@@ -0,0 +1,196 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The SACP TX queue: tasks push whole frames without waiting while a model of
+// the USART TX interrupt pulls them. Frames come out whole, never interleaved,
+// in the order each sender pushed them, and a frame is either sent or counted
+// as dropped
+
+#include "test.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "snapmaker/event/event_tx.h"
+
+#define PRODUCERS 4
+#define FRAMES_PER_PRODUCER 20000
+#define FRAME_HEADER 5  // producer, sequence and length, ahead of the payload
+#define FRAME_MAX 520
+
+static event_tx_queue_t queue;
+
+static uint8_t payload_byte(uint8_t producer, uint16_t sequence, uint16_t i) {
+  return (uint8_t)(producer * 31 + sequence * 7 + i);
+}
+
+static uint16_t make_frame(uint8_t *frame, uint8_t producer, uint16_t sequence, uint16_t len) {
+  frame[0] = producer;
+  frame[1] = sequence & 0xFF;
+  frame[2] = sequence >> 8;
+  frame[3] = len & 0xFF;
+  frame[4] = len >> 8;
+  for (uint16_t i = FRAME_HEADER; i < len; i++) {
+    frame[i] = payload_byte(producer, sequence, i);
+  }
+  return len;
+}
+
+// Without other senders: whole frames or nothing, and the ring's bytes first
+static void test_single() {
+  memset(&queue, 0, sizeof(queue));
+  uint8_t frame[FRAME_MAX];
+
+  CHECK_EQ(event_tx_pull(queue, true), -1);
+  CHECK(event_tx_push(queue, frame, 0));
+  CHECK_EQ(event_tx_used(queue), 0);
+
+  // Fill it, the frame that does not fit is refused whole
+  uint16_t queued = 0;
+  while (event_tx_push(queue, frame, make_frame(frame, 0, queued, 100))) {
+    queued++;
+  }
+  CHECK_EQ(queued, EVENT_TX_QUEUE_SIZE / (100 + EVENT_TX_HEADER_LEN));
+  CHECK(EVENT_TX_QUEUE_SIZE - event_tx_used(queue) < 100 + EVENT_TX_HEADER_LEN);
+
+  // A frame waits while the ring has bytes, once started it goes on regardless
+  CHECK_EQ(event_tx_pull(queue, false), -1);
+  CHECK_EQ(event_tx_pull(queue, true), 0);
+  make_frame(frame, 0, 0, 100);
+  for (uint16_t i = 1; i < 100; i++) {
+    CHECK_EQ(event_tx_pull(queue, false), frame[i]);
+  }
+  CHECK_EQ(event_tx_pull(queue, false), -1);
+
+  // The room of a sent frame is free again, also across the wrap
+  for (uint16_t n = 0; n < 3 * queued; n++) {
+    uint16_t len = make_frame(frame, 1, n, 100);
+    CHECK(event_tx_push(queue, frame, len));
+    for (uint16_t i = 0; i < 100; i++) {
+      CHECK(event_tx_pull(queue, true) >= 0);
+    }
+  }
+  while (event_tx_pull(queue, true) >= 0);
+  CHECK_EQ(event_tx_used(queue), 0);
+}
+
+static std::atomic<uint32_t> dropped;
+static std::atomic<int> producers_left;
+static double push_max_us[PRODUCERS], push_sum_us[PRODUCERS];
+
+static void producer(uint8_t id) {
+  uint8_t frame[FRAME_MAX];
+  uint32_t seed = id + 1;
+  for (uint32_t n = 0; n < FRAMES_PER_PRODUCER; n++) {
+    seed = seed * 1103515245 + 12345;
+    uint16_t len = FRAME_HEADER + (seed >> 16) % (FRAME_MAX - FRAME_HEADER);
+    make_frame(frame, id, n, len);
+
+    auto begin = std::chrono::steady_clock::now();
+    bool queued = event_tx_push(queue, frame, len);
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+    if (us > push_max_us[id]) push_max_us[id] = us;
+    push_sum_us[id] += us;
+
+    // A sender whose frame was dropped goes on with other work for a while
+    if (!queued) {
+      dropped++;
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    } else if (n % 64 == 0) {
+      std::this_thread::yield();
+    }
+  }
+  producers_left--;
+}
+
+// The TX interrupt, the stream it sends is parsed back into frames
+static void test_concurrent() {
+  memset(&queue, 0, sizeof(queue));
+  dropped = 0;
+  producers_left = PRODUCERS;
+
+  std::vector<std::thread> threads;
+  for (uint8_t i = 0; i < PRODUCERS; i++) {
+    threads.emplace_back(producer, i);
+  }
+
+  uint32_t received = 0, broken = 0, out_of_order = 0;
+  int32_t last_sequence[PRODUCERS];
+  for (auto &s : last_sequence) s = -1;
+  uint8_t frame[FRAME_MAX];
+  uint16_t pos = 0;
+  uint32_t pulls = 0;
+
+  for (;;) {
+    // Now and then text in the ring goes first
+    int16_t c = event_tx_pull(queue, (++pulls % 13) != 0);
+    if (c < 0) {
+      if (!producers_left && !event_tx_used(queue)) break;
+      if (pulls % 64 == 0) std::this_thread::yield();
+      continue;
+    }
+    if (pos >= FRAME_MAX) {
+      broken++;
+      break;
+    }
+    frame[pos++] = c;
+    if (pos < FRAME_HEADER || pos < (frame[3] | (frame[4] << 8))) continue;
+
+    uint8_t id = frame[0];
+    uint16_t sequence = frame[1] | (frame[2] << 8);
+    uint16_t len = frame[3] | (frame[4] << 8);
+    bool whole = id < PRODUCERS && len >= FRAME_HEADER;
+    for (uint16_t i = FRAME_HEADER; whole && i < len; i++) {
+      whole = frame[i] == payload_byte(id, sequence, i);
+    }
+    if (!whole) {
+      broken++;
+      break;
+    }
+    if ((int32_t)sequence <= last_sequence[id]) out_of_order++;
+    last_sequence[id] = sequence;
+    received++;
+    pos = 0;
+  }
+
+  for (auto &t : threads) t.join();
+
+  CHECK_EQ(broken, 0);
+  CHECK_EQ(out_of_order, 0);
+  CHECK_EQ(pos, 0);
+  CHECK_EQ(received + dropped, PRODUCERS * FRAMES_PER_PRODUCER);
+  CHECK(received > 0);
+  CHECK_EQ(event_tx_used(queue), 0);
+
+  double max_us = 0, sum_us = 0;
+  for (uint8_t i = 0; i < PRODUCERS; i++) {
+    if (push_max_us[i] > max_us) max_us = push_max_us[i];
+    sum_us += push_sum_us[i];
+  }
+  printf("%d producers: %u frames sent, %u dropped, push mean %.3f us, max %.1f us\n", PRODUCERS,
+         received, (uint32_t)dropped, sum_us / (PRODUCERS * FRAMES_PER_PRODUCER), max_us);
+}
+
+void test_main() {
+  test_single();
+  test_concurrent();
+}
@@ -0,0 +1,302 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Shaper step solver: random piecewise functions fed to FuncManager for X and
+// for E, whose positions are kept relative to their chunk. Every step time the
+// single precision solver gives must match a double solve of the same pieces
+
+#include "test.h"
+#include <math.h>
+#include <deque>
+#include "src/inc/MarlinConfig.h"
+#include "src/module/shaper/FuncManager.h"
+
+uint32_t statistics_funcgen_runout_cnt;
+
+// How far, in steps, a step may land from where the double solve puts it.
+// As a time it is a few ns at speed and some us on a slow E move
+#define STEP_POS_MAX_ERROR 0.001
+
+#define HOUR_MS (3600.0 * 1000)
+
+// A piece as the double reference sees it, c and right_pos in absolute steps
+typedef struct {
+  double left_time;
+  double a, b, c, right_pos;
+  int8_t type;
+} piece_t;
+
+typedef struct {
+  double vmax;          // steps per ms
+  double move_ms;       // longest moving piece
+  double dwell_ms;      // longest dwell
+  uint8_t stop;         // percent of the moving pieces that end in a stop
+  uint8_t dwell;        // percent of the stops that dwell before moving again
+  double pos_min, pos_max;
+} motion_t;
+
+typedef struct {
+  FuncManager fm;
+  motion_t motion;
+
+  // Producer
+  double time;          // exact end of the last piece
+  time_double_t fixed;  // the same in the firmware time
+  double pos;           // exact position at the end of the last piece
+  double v;             // its speed, 0 when stopped
+  int8_t dir;
+  bool stopping;        // the last piece ends at a whole step, 0 speed
+
+  // Consumer and the reference
+  std::deque<piece_t> pieces;
+  int32_t step;
+  double last_step_time;
+  uint32_t steps;
+  double max_error;     // ms
+  double sum_error;
+  double max_pos_error; // steps
+  double hour_error[2]; // summed over the first and the last hour
+  uint32_t hour_steps[2];
+} axis_t;
+
+static double uniform(double lo, double hi) {
+  return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+static void axis_reset(axis_t &axis, int8_t index, const motion_t &motion) {
+  axis.fm.init(index);
+  axis.fm.reset();
+  axis.motion = motion;
+  axis.time = 0;
+  axis.fixed = 0;
+  axis.pos = index == E_AXIS ? E_START_POS : 0;
+  axis.v = 0;
+  axis.dir = 1;
+  axis.stopping = true;
+  axis.pieces.clear();
+  axis.step = (int32_t)axis.pos;
+  axis.last_step_time = 0;
+  axis.steps = 0;
+  axis.max_error = 0;
+  axis.sum_error = 0;
+  axis.max_pos_error = 0;
+  axis.hour_error[0] = axis.hour_error[1] = 0;
+  axis.hour_steps[0] = axis.hour_steps[1] = 0;
+}
+
+// Add one piece, velocity is continuous and direction changes only at a stop,
+// which ends on a whole step so no step boundary sits next to the turn
+static void add_piece(axis_t &axis, bool last) {
+  const motion_t &m = axis.motion;
+  const bool e = axis.fm.axis == E_AXIS;
+  float a = 0, b = 0, d;
+  double end = axis.pos;
+
+  if (axis.stopping && !last && (uint32_t)(rand() % 100) < m.dwell) {
+    d = uniform(0.1, m.dwell_ms);
+  }
+  else {
+    if (axis.stopping) {
+      // Moving off from a stop, E mostly forward with a few retracts
+      axis.dir = e ? (rand() % 8 ? 1 : -1) : (rand() % 2 ? 1 : -1);
+      if (axis.pos > m.pos_max) axis.dir = -1;
+      if (axis.pos < m.pos_min) axis.dir = 1;
+    }
+    const bool stop = last || (uint32_t)(rand() % 100) < m.stop
+                   || (axis.dir > 0 ? axis.pos > m.pos_max : axis.pos < m.pos_min);
+    if (stop) {
+      // Decelerate to a whole step
+      const double v0 = axis.v > 0 ? axis.v : uniform(0.05, m.vmax);
+      end = floor(axis.pos + axis.dir * uniform(0.6, v0 * m.move_ms / 2) + 0.5);
+      if (end == axis.pos) end += axis.dir;
+      d = 2 * fabs(end - axis.pos) / v0;
+      b = axis.dir * v0;
+      a = -b / (2 * d);
+      axis.v = 0;
+    }
+    else {
+      const double v1 = uniform(0.05, m.vmax);
+      d = uniform(0.5, m.move_ms);
+      b = axis.dir * axis.v;
+      a = axis.dir * (v1 - axis.v) / (2 * d);
+      axis.v = v1;
+    }
+    end = axis.pos + ((double)a * d + b) * d;
+    axis.stopping = stop;
+  }
+
+  piece_t piece;
+  piece.left_time = axis.time;
+  piece.a = a;
+  piece.b = b;
+  piece.c = axis.pos;
+  piece.type = fabs(end - axis.pos) < EPSILON ? 0 : axis.dir;
+  axis.time += d;
+  axis.fixed += d;
+  // Q32.32 adds a float time exactly, however long the print
+  CHECK(axis.fixed.toDouble() == axis.time);
+
+  if (e) {
+    const int32_t origin = (int32_t)floor(axis.pos);
+    const float right_pos = end - origin;
+    piece.right_pos = origin + (double)right_pos;
+    axis.fm.addFuncParamsExtend(origin, a, b, axis.pos - origin, piece.type, axis.fixed, right_pos);
+  }
+  else {
+    piece.right_pos = (float)end;
+    axis.fm.addFuncParams(a, b, axis.pos, piece.type, axis.fixed, piece.right_pos);
+  }
+  axis.pos = piece.right_pos;
+  axis.pieces.push_back(piece);
+}
+
+// The next step time of the reference, solved in double
+static bool reference_step(axis_t &axis, int32_t &step, double &time, double &speed) {
+  while (!axis.pieces.empty()) {
+    const piece_t &p = axis.pieces.front();
+    double target = 0;
+    if (p.type > 0) {
+      step = axis.step + 1;
+      target = step - 0.5;
+      if (target > p.right_pos + EPSILON) target = NAN;
+    }
+    else if (p.type < 0) {
+      step = axis.step - 1;
+      target = step + 0.5;
+      if (target < p.right_pos - EPSILON) target = NAN;
+    }
+    else {
+      target = NAN;
+    }
+    if (!isnan(target)) {
+      // Stable for either sign of a, and for a linear piece
+      const double dc = target - p.c;
+      const double root = sqrt(fmax(p.b * p.b + 4 * p.a * dc, 0.0));
+      const double t = 2 * dc / (p.type > 0 ? p.b + root : p.b - root);
+      time = p.left_time + t;
+      speed = fabs(p.b + 2 * p.a * t);
+      return true;
+    }
+    axis.pieces.pop_front();
+  }
+  return false;
+}
+
+// Steps until the manager runs dry or max steps are taken
+static void take_steps(axis_t &axis, uint32_t max, double duration) {
+  float mm_to_step = 1, half_step_mm = 0.5;
+  for (uint32_t i = 0; i < max; i++) {
+    int8_t dir = 0;
+    const bool got = axis.fm.axis == E_AXIS
+                   ? axis.fm.getNextPosTimeEextend(1, &dir, mm_to_step, half_step_mm)
+                   : axis.fm.getNextPosTime(1, &dir, mm_to_step, half_step_mm);
+    int32_t step;
+    double time, speed;
+    if (!got) return;
+    if (!reference_step(axis, step, time, speed)) {
+      CHECK(!"step past the reference");
+      return;
+    }
+    CHECK_EQ(axis.fm.print_step, step);
+    const double fm_time = axis.fm.print_time.toDouble();
+    const double error = fabs(fm_time - time);
+    CHECK(error * speed <= STEP_POS_MAX_ERROR);
+    CHECK(fm_time >= axis.last_step_time);
+    NOLESS(axis.max_error, error);
+    NOLESS(axis.max_pos_error, error * speed);
+    if (time < HOUR_MS || time >= duration - HOUR_MS) {
+      const uint8_t hour = time >= duration - HOUR_MS;
+      axis.hour_error[hour] += error;
+      axis.hour_steps[hour]++;
+    }
+    axis.sum_error += error;
+    axis.last_step_time = fm_time;
+    axis.step = step;
+    axis.steps++;
+  }
+}
+
+static void run(const char *name, double duration, const motion_t &motion_x, const motion_t &motion_e) {
+  static axis_t axes[2];
+  axis_t &x = axes[0], &e = axes[1];
+  // Both give their chunks back before either takes its first one
+  x.fm.init(X_AXIS);
+  e.fm.init(E_AXIS);
+  x.fm.reset();
+  e.fm.reset();
+  axis_reset(x, X_AXIS, motion_x);
+  axis_reset(e, E_AXIS, motion_e);
+  statistics_funcgen_runout_cnt = 0;
+
+  bool done[2] = { false, false };
+  while (!done[0] || !done[1] || !x.pieces.empty() || !e.pieces.empty()) {
+    for (uint8_t i = 0; i < 2; i++) {
+      axis_t &axis = axes[i];
+      // The arena is shared, one axis may hold most of it for a while
+      while (!done[i] && axis.fm.getFreeSize() > 0) {
+        const bool last = axis.time >= duration;
+        add_piece(axis, last);
+        done[i] = last;
+      }
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+      take_steps(axes[i], 1 + rand() % 3000, duration);
+    }
+    if (done[0] && done[1]) {
+      take_steps(x, UINT32_MAX, duration);
+      take_steps(e, UINT32_MAX, duration);
+      break;
+    }
+  }
+
+  for (uint8_t i = 0; i < 2; i++) {
+    axis_t &axis = axes[i];
+    // Every piece stepped, the axis ends on the step of its last stop
+    int32_t step;
+    double time, speed;
+    CHECK(!reference_step(axis, step, time, speed));
+    CHECK_EQ(axis.step, (int32_t)axis.pos);
+    printf("%s %c: %u steps, step time error max %.2e ms mean %.2e ms, position error max %.2e steps\n",
+           name, "XE"[i], axis.steps, axis.max_error, axis.sum_error / (axis.steps ? axis.steps : 1),
+           axis.max_pos_error);
+    if (duration >= 2 * HOUR_MS) {
+      // The time keeps its resolution, the last hour solves as well as the first
+      const double first = axis.hour_error[0] / axis.hour_steps[0];
+      const double last = axis.hour_error[1] / axis.hour_steps[1];
+      printf("%s %c: step time error mean %.2e ms in the first hour, %.2e ms in the last\n", name, "XE"[i], first, last);
+      CHECK(last < 2 * first);
+    }
+  }
+  CHECK_EQ(statistics_funcgen_runout_cnt, 0);
+}
+
+void test_main() {
+  srand(1);
+  // Fast moves of a print, a minute of them
+  const motion_t print_x = { 40, 60, 50, 10, 20, 1000, 27000 };
+  const motion_t print_e = { 4, 60, 50, 10, 20, 0, 1e9 };
+  run("print", 60 * 1000, print_x, print_e);
+  // Hours of slow moves and dwells, long after a float ms would have lost the steps
+  const motion_t slow_x = { 2, 100, 2000, 20, 50, 1000, 27000 };
+  const motion_t slow_e = { 0.5, 100, 2000, 20, 50, 0, 1e9 };
+  run("4 hours", 4 * HOUR_MS, slow_x, slow_e);
+}
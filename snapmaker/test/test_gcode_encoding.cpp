@@ -0,0 +1,401 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Encoded gcode packets from the HMI: each encoding is streamed through
+// push_encoded_gcode() into the ring and must come back as the text it was
+// made from, bad packets must leave the ring untouched
+
+#include "test.h"
+#include <string>
+#include <vector>
+#include "src/inc/MarlinConfig.h"
+#include "src/libs/heatshrink/heatshrink_config.h"
+#include "snapmaker/module/print_control.h"
+#include "snapmaker/module/power_loss.h"
+#include "snapmaker/module/system.h"
+
+#define PACKET_MAX_LINES 40
+#define PACKET_MAX_RAW   900
+
+typedef std::vector<uint8_t> bytes_t;
+// Encoded data of whole lines and the bytes it decodes to
+typedef bytes_t (*encode_f)(const std::string &text, uint32_t &raw_size);
+
+static std::vector<std::string> file;
+
+// Sliced gcode: mostly G1 moves, some travel, temperatures and comments
+static void make_file(uint32_t count) {
+  float x = 100, y = 100, e = 0;
+  file.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    char line[MAX_CMD_SIZE];
+    x += (rand() % 2001 - 1000) / 1000.0f;
+    y += (rand() % 2001 - 1000) / 1000.0f;
+    switch (rand() % 20) {
+      case 0: snprintf(line, sizeof(line), ";TYPE:WALL-OUTER %u", i); break;
+      case 1: snprintf(line, sizeof(line), "G0 F9000 X%.3f Y%.3f", x, y); break;
+      case 2: snprintf(line, sizeof(line), "M104 S%u T%u", 190 + rand() % 30, rand() % 2); break;
+      case 3: line[0] = '\0'; break;
+      case 4: snprintf(line, sizeof(line), "G1 Z%.2f F600", (rand() % 300) / 100.0f); break;
+      default:
+        e += (rand() % 1000) / 20000.0f;
+        snprintf(line, sizeof(line), "G1 X%.3f Y%.3f E%.5f", x, y, e);
+        break;
+    }
+    file.push_back(line);
+  }
+}
+
+static const char *command_of(const std::string &line) {
+  size_t skip = line.find_first_not_of(' ');
+  return skip == std::string::npos ? NULL : line.c_str() + skip;
+}
+
+static void reset_ring(uint32_t next_req) {
+  print_control.clear_gcode_buf();
+  power_loss.next_req = next_req;
+  power_loss.line_number_sum = next_req;
+}
+
+static bool same_motion(const uint8_t *cmd, const std::string &expect) {
+  gcode_motion_t a, b;
+  memcpy(&a, cmd, sizeof(a));
+  memcpy(&b, expect.data(), sizeof(b));
+  return a.flags == b.flags && a.x == b.x && a.y == b.y && a.z == b.z && a.e == b.e && a.f == b.f;
+}
+
+// Take every command waiting, each must be the next line of expect, a
+// motion record is expected as the bytes of the record
+static void drain(const std::vector<std::string> &expect, uint32_t &taken, uint32_t pushed, uint32_t max) {
+  for (uint32_t i = 0; i < max; i++) {
+    uint8_t cmd[MAX_CMD_SIZE];
+    uint32_t line;
+    while (taken < pushed && !command_of(expect[taken])) taken++;
+    if (taken == pushed) {
+      CHECK(!print_control.get_commands(cmd, line, sizeof(cmd)));
+      return;
+    }
+    CHECK(print_control.get_commands(cmd, line, sizeof(cmd)));
+    if (expect[taken][0] == GCODE_MOTION_MARKER) {
+      CHECK(cmd[0] == GCODE_MOTION_MARKER && same_motion(cmd, expect[taken]));
+    }
+    else {
+      CHECK(strcmp((char *)cmd, command_of(expect[taken])) == 0);
+    }
+    CHECK_EQ(line, taken + 1);
+    taken++;
+  }
+}
+
+// Send lines in packets of whole lines, with the marlin task taking up to
+// consume_max commands between two packets
+static void run_stream(gcode_encoding_e encoding, encode_f encode, const std::vector<std::string> &lines,
+                       const std::vector<std::string> &expect, uint8_t consume_max) {
+  uint32_t pushed = 0, taken = 0, packed = 0, raw = 0;
+  reset_ring(0);
+
+  while (taken < expect.size()) {
+    std::string text;
+    uint32_t count = 0;
+    uint32_t want = 1 + rand() % PACKET_MAX_LINES;
+    while (pushed + count < lines.size() && count < want && text.size() + lines[pushed + count].size() < PACKET_MAX_RAW) {
+      text += lines[pushed + count++] + "\n";
+    }
+    if (count) {
+      uint32_t raw_size;
+      bytes_t data = encode(text, raw_size);
+      uint32_t free = print_control.get_buf_free();
+      ErrCode ret = print_control.push_encoded_gcode(encoding, pushed, pushed + count - 1, &data[0], data.size(), raw_size);
+      if (ret == E_SUCCESS) {
+        pushed += count;
+        packed += data.size();
+        raw += text.size();
+      }
+      else {
+        // Room that was reported free must take the packet, a record also takes a terminator
+        CHECK_EQ(ret, E_NO_MEM);
+        CHECK(free < raw_size + (encoding == GCODE_ENCODING_MOTION ? count : 0));
+        if (ret != E_NO_MEM) return;
+      }
+    }
+    drain(expect, taken, pushed, rand() % (consume_max + 1));
+  }
+  CHECK(packed <= raw);
+}
+
+// Encoded data that does not decode to raw_size bytes of count lines is refused
+static void check_refused(gcode_encoding_e encoding, const bytes_t &data, uint16_t raw_size, uint32_t count) {
+  reset_ring(5);
+  bytes_t copy = data;
+  CHECK_EQ(print_control.push_encoded_gcode(encoding, 5, 5 + count - 1, copy.empty() ? NULL : &copy[0], copy.size(), raw_size), E_PARAM);
+  CHECK_EQ(print_control.next_req_line(), 5);
+  CHECK_EQ(print_control.get_buf_used(), 0);
+}
+
+/**
+ * Heatshrink, greedy matching into the same window the firmware decodes with
+ */
+#define HS_WINDOW    (1 << HEATSHRINK_STATIC_WINDOW_BITS)
+#define HS_LOOKAHEAD (1 << HEATSHRINK_STATIC_LOOKAHEAD_BITS)
+
+static void put_bits(bytes_t &out, uint8_t &bit, uint16_t value, uint8_t count) {
+  while (count--) {
+    if (!bit) {
+      out.push_back(0);
+      bit = 0x80;
+    }
+    if (value & (1 << count)) out.back() |= bit;
+    bit >>= 1;
+  }
+}
+
+static bytes_t heatshrink_encode(const std::string &text, uint32_t &raw_size) {
+  bytes_t out;
+  raw_size = text.size();
+  uint8_t bit = 0;
+  for (size_t i = 0; i < text.size();) {
+    size_t best = 0, best_offset = 0;
+    for (size_t offset = 1; offset <= HS_WINDOW && offset <= i; offset++) {
+      size_t n = 0;
+      while (n < HS_LOOKAHEAD && i + n < text.size() && text[i + n] == text[i + n - offset]) n++;
+      if (n > best) {
+        best = n;
+        best_offset = offset;
+      }
+    }
+    if (best >= 2) {
+      put_bits(out, bit, 0, 1);
+      put_bits(out, bit, best_offset - 1, HEATSHRINK_STATIC_WINDOW_BITS);
+      put_bits(out, bit, best - 1, HEATSHRINK_STATIC_LOOKAHEAD_BITS);
+      i += best;
+    }
+    else {
+      put_bits(out, bit, 1, 1);
+      put_bits(out, bit, (uint8_t)text[i++], 8);
+    }
+  }
+  return out;
+}
+
+static void test_heatshrink() {
+  run_stream(GCODE_ENCODING_HEATSHRINK, heatshrink_encode, file, file, 3);
+  run_stream(GCODE_ENCODING_HEATSHRINK, heatshrink_encode, file, file, 50);
+
+  std::string text = "G1 X1 Y2\nG1 X1 Y3\n";
+  uint32_t raw_size;
+  bytes_t data = heatshrink_encode(text, raw_size);
+  // Decoding past raw_size, short of it, or to another line count
+  check_refused(GCODE_ENCODING_HEATSHRINK, data, text.size() - 1, 2);
+  check_refused(GCODE_ENCODING_HEATSHRINK, data, text.size() + 1, 2);
+  check_refused(GCODE_ENCODING_HEATSHRINK, data, text.size(), 3);
+  check_refused(GCODE_ENCODING_HEATSHRINK, bytes_t(), 0, 1);
+}
+
+/**
+ * MeatPack, two characters of the table a byte, anything else as a literal
+ */
+static uint8_t meatpack_code(char c, bool no_spaces) {
+  const char *table = no_spaces ? "0123456789.E\nGX" : "0123456789. \nGX";
+  const char *p = c ? strchr(table, c) : NULL;
+  return p ? p - table : 0x0F;
+}
+
+static bytes_t meatpack_encode(const std::string &text, bool no_spaces) {
+  bytes_t out;
+  for (size_t i = 0; i < text.size();) {
+    const char a = text[i++];
+    const uint8_t ca = meatpack_code(a, no_spaces);
+    if (a == '\n') {
+      out.push_back(ca);  // a '\n' in the low nibble ends the byte
+      continue;
+    }
+    // An odd last character is padded, raw_size cuts it
+    const char b = i < text.size() ? text[i++] : '0';
+    const uint8_t cb = meatpack_code(b, no_spaces);
+    out.push_back(cb << 4 | ca);
+    if (ca == 0x0F) out.push_back(a);
+    if (cb == 0x0F) out.push_back(b);
+  }
+  return out;
+}
+
+static bytes_t meatpack_encode_spaces(const std::string &text, uint32_t &raw_size) {
+  raw_size = text.size();
+  return meatpack_encode(text, false);
+}
+
+static bytes_t meatpack_encode_no_spaces(const std::string &text, uint32_t &raw_size) {
+  raw_size = text.size();
+  return meatpack_encode(text, true);
+}
+
+static void test_meatpack() {
+  run_stream(GCODE_ENCODING_MEATPACK, meatpack_encode_spaces, file, file, 3);
+  run_stream(GCODE_ENCODING_MEATPACK, meatpack_encode_spaces, file, file, 50);
+
+  // The HMI strips the spaces before packing
+  std::vector<std::string> stripped;
+  for (size_t i = 0; i < file.size(); i++) {
+    std::string line;
+    for (size_t c = 0; c < file[i].size(); c++) {
+      if (file[i][c] != ' ') line += file[i][c];
+    }
+    stripped.push_back(line);
+  }
+  run_stream(GCODE_ENCODING_MEATPACK_NSP, meatpack_encode_no_spaces, stripped, stripped, 3);
+  run_stream(GCODE_ENCODING_MEATPACK_NSP, meatpack_encode_no_spaces, stripped, stripped, 50);
+
+  // A packet ending on an odd character, the next one finishes the line
+  reset_ring(0);
+  std::string first = "G1 X1\nG", second = "1\n";
+  bytes_t data = meatpack_encode(first, false);
+  CHECK_EQ(print_control.push_encoded_gcode(GCODE_ENCODING_MEATPACK, 0, 0, &data[0], data.size(), first.size()), E_SUCCESS);
+  data = meatpack_encode(second, false);
+  CHECK_EQ(print_control.push_encoded_gcode(GCODE_ENCODING_MEATPACK, 1, 1, &data[0], data.size(), second.size()), E_SUCCESS);
+  std::vector<std::string> expect;
+  expect.push_back("G1 X1");
+  expect.push_back("G1");
+  uint32_t taken = 0;
+  drain(expect, taken, 2, 3);
+  CHECK_EQ(taken, 2);
+
+  // Decoding more than the padding past raw_size, or short of it
+  std::string text = "G1 X12.5 Y3\nM104 S200\n";
+  data = meatpack_encode(text, false);
+  check_refused(GCODE_ENCODING_MEATPACK, data, text.size() - 2, 2);
+  check_refused(GCODE_ENCODING_MEATPACK, data, text.size() + 1, 2);
+  check_refused(GCODE_ENCODING_MEATPACK, data, text.size(), 1);
+}
+
+/**
+ * Motion records, G0/G1 lines as a flags byte and varints, the rest as text
+ */
+static const uint8_t motion_digits[3] = { 3, 5, 0 };  // XYZ, E, F, set_motion_scale() defaults
+static const float motion_pow10[6] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f };
+
+// Quantized words of a G0/G1 a record can carry, false for any other line
+static bool motion_parse(const std::string &line, uint8_t &flags, int32_t q[5]) {
+  static const char letters[] = "XYZEF";
+  const char *p = line.c_str();
+  if (p[0] != 'G' || (p[1] != '0' && p[1] != '1') || p[2] != ' ') return false;
+  flags = p[1] == '0' ? GCODE_MOTION_G0 : 0;
+  for (p += 2; *p;) {
+    while (*p == ' ') p++;
+    const char *l = strchr(letters, *p);
+    if (!*p || !l) return false;
+    const uint8_t i = l - letters;
+    char *end;
+    double v = strtod(p + 1, &end);
+    const uint8_t digits = motion_digits[i < 3 ? 0 : i - 2];
+    q[i] = (int32_t)lround(v * motion_pow10[digits]);
+    flags |= _BV(i);
+    p = end;
+  }
+  return flags & ~GCODE_MOTION_G0;
+}
+
+static void put_varint(bytes_t &out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back(0x80 | (v & 0x7F));
+    v >>= 7;
+  }
+  out.push_back(v);
+}
+
+static bytes_t motion_encode(const std::string &text, uint32_t &raw_size) {
+  bytes_t out;
+  int32_t last[4] = { 0, 0, 0, 0 };
+  raw_size = 0;
+  for (size_t start = 0; start < text.size();) {
+    const size_t eol = text.find('\n', start);
+    const std::string line = text.substr(start, eol - start);
+    start = eol + 1;
+
+    uint8_t flags;
+    int32_t q[5];
+    if (!motion_parse(line, flags, q)) {
+      out.insert(out.end(), line.begin(), line.end());
+      out.push_back('\n');
+      raw_size += line.size() + 1;
+      continue;
+    }
+    out.push_back(0x80 | flags);
+    for (uint8_t i = 0; i < 4; i++) {
+      if (!TEST(flags, i)) continue;
+      const int32_t d = q[i] - last[i];
+      put_varint(out, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+      last[i] = q[i];
+    }
+    if (flags & GCODE_MOTION_F) put_varint(out, q[4]);
+    raw_size += sizeof(gcode_motion_t);
+  }
+  return out;
+}
+
+// The record a line comes back as, as bytes, or the line itself
+static std::string motion_expect(const std::string &line) {
+  uint8_t flags;
+  int32_t q[5];
+  if (!motion_parse(line, flags, q)) return line;
+  gcode_motion_t m;
+  memset(&m, 0, sizeof(m));
+  m.marker = GCODE_MOTION_MARKER;
+  m.flags = flags;
+  float *value[4] = { &m.x, &m.y, &m.z, &m.e };
+  for (uint8_t i = 0; i < 4; i++) {
+    if (TEST(flags, i)) *value[i] = q[i] / motion_pow10[motion_digits[i < 3 ? 0 : 1]];
+  }
+  if (flags & GCODE_MOTION_F) m.f = q[4] / motion_pow10[motion_digits[2]];
+  return std::string((const char *)&m, sizeof(m));
+}
+
+static void test_motion() {
+  std::vector<std::string> expect;
+  uint32_t records = 0;
+  for (size_t i = 0; i < file.size(); i++) {
+    expect.push_back(motion_expect(file[i]));
+    if (expect.back()[0] == GCODE_MOTION_MARKER) records++;
+  }
+  CHECK(records > file.size() / 2);
+  run_stream(GCODE_ENCODING_MOTION, motion_encode, file, expect, 3);
+  run_stream(GCODE_ENCODING_MOTION, motion_encode, file, expect, 50);
+
+  std::string text = "G1 X1.5 Y-2 E0.01\nM104 S200\n";
+  uint32_t raw_size;
+  bytes_t data = motion_encode(text, raw_size);
+  CHECK_EQ(data[0], 0x80 | GCODE_MOTION_X | GCODE_MOTION_Y | GCODE_MOTION_E);
+  // A short varint, a reserved tag bit, or another raw size or line count
+  check_refused(GCODE_ENCODING_MOTION, bytes_t(data.begin(), data.begin() + 3), raw_size, 2);
+  bytes_t reserved = data;
+  reserved[0] |= 0x40;
+  check_refused(GCODE_ENCODING_MOTION, reserved, raw_size, 2);
+  check_refused(GCODE_ENCODING_MOTION, data, raw_size + 1, 2);
+  check_refused(GCODE_ENCODING_MOTION, data, raw_size, 3);
+}
+
+void test_main() {
+  srand(1);
+  system_service.set_status(SYSTEM_STATUE_PRINTING);
+  make_file(30000);
+  test_heatshrink();
+  test_meatpack();
+  test_motion();
+}
@@ -0,0 +1,150 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// G0/G1 text lines turned into motion records as they are pushed: a record
+// must hold what the parser reads from the text, and the bigger record of a
+// short line must never make an admitted packet fail
+
+#include "test.h"
+#include <string>
+#include <vector>
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/module/print_control.h"
+#include "snapmaker/module/power_loss.h"
+#include "snapmaker/module/system.h"
+
+#define PACKET_MAX_LINES 60
+#define PACKET_MAX_SIZE  900
+
+static std::vector<std::string> file;
+
+static void make_file(uint32_t count) {
+  static const char *odd[] = {
+    "G1 X1", "G0 Y2", "G1 E-1.5", "G01 X3", "G1 F1200", "G0", "G1 X1 X2",
+    "G10", "G1.1 X1", "G1 X1 ;wipe", "N5 G1 X1*33", "G1 Y.5", "G1 X-.25 Y+3",
+    "G92 E0", "G28", "  G1 X7",
+  };
+  float x = 100, y = 100, e = 0;
+  file.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    char line[MAX_CMD_SIZE];
+    x += (rand() % 2001 - 1000) / 1000.0f;
+    y += (rand() % 2001 - 1000) / 1000.0f;
+    e += (rand() % 1000) / 20000.0f;
+    switch (rand() % 6) {
+      case 0: strcpy(line, odd[rand() % COUNT(odd)]); break;
+      case 1: snprintf(line, sizeof(line), "G1 E%.4f", e); break;
+      case 2: snprintf(line, sizeof(line), "G0 F9000 X%.3f Y%.3f", x, y); break;
+      default: snprintf(line, sizeof(line), "G1 X%.3f Y%.3f E%.5f", x, y, e); break;
+    }
+    file.push_back(line);
+  }
+}
+
+// What a record of the line holds, false when the line has to stay text
+static bool expect_motion(const std::string &line, gcode_motion_t &m) {
+  static const char letters[] = "XYZEF";
+  float *value[5] = { &m.x, &m.y, &m.z, &m.e, &m.f };
+  const char *p = line.c_str();
+  while (*p == ' ') p++;
+  if (p[0] != 'G') return false;
+  p++;
+  while (*p == '0' && (p[1] == '0' || p[1] == '1')) p++;
+  if (*p != '0' && *p != '1') return false;
+  memset(&m, 0, sizeof(m));
+  m.flags = *p++ == '0' ? GCODE_MOTION_G0 : 0;
+  if (*p && *p != ' ') return false;
+  for (;;) {
+    while (*p == ' ') p++;
+    if (!*p) break;
+    const char *l = strchr(letters, *p);
+    if (!l || TEST(m.flags, l - letters)) return false;
+    char *end;
+    *value[l - letters] = strtof(p + 1, &end);
+    if (end == p + 1 || (*end && *end != ' ')) return false;
+    m.flags |= _BV(l - letters);
+    p = end;
+  }
+  return m.flags & ~GCODE_MOTION_G0;
+}
+
+static void run_stream(uint8_t consume_max) {
+  uint32_t pushed = 0, taken = 0, records = 0;
+  print_control.clear_gcode_buf();
+  power_loss.next_req = 0;
+  power_loss.line_number_sum = 0;
+
+  while (taken < file.size()) {
+    std::string data;
+    uint32_t count = 0;
+    uint32_t want = 1 + rand() % PACKET_MAX_LINES;
+    while (pushed + count < file.size() && count < want && data.size() + file[pushed + count].size() < PACKET_MAX_SIZE) {
+      data += file[pushed + count++] + "\n";
+    }
+    if (count) {
+      uint32_t free = print_control.get_buf_free();
+      ErrCode ret = print_control.push_gcode(pushed, pushed + count - 1, (uint8_t *)&data[0], data.size());
+      if (ret == E_SUCCESS) {
+        pushed += count;
+      }
+      else {
+        // Records only grow into room beyond the packet, an admitted packet fits
+        CHECK_EQ(ret, E_NO_MEM);
+        CHECK(free < data.size());
+        if (ret != E_NO_MEM) return;
+      }
+    }
+
+    uint8_t n = rand() % (consume_max + 1);
+    for (uint8_t i = 0; i < n && taken < pushed; i++) {
+      uint8_t cmd[MAX_CMD_SIZE];
+      uint32_t line;
+      gcode_motion_t want_motion;
+      const bool motion = expect_motion(file[taken], want_motion);
+      CHECK(print_control.get_commands(cmd, line, sizeof(cmd)));
+      CHECK_EQ(line, taken + 1);
+      if (cmd[0] == GCODE_MOTION_MARKER) {
+        gcode_motion_t got;
+        memcpy(&got, cmd, sizeof(got));
+        CHECK(motion);
+        CHECK_EQ(got.flags, want_motion.flags);
+        CHECK(got.x == want_motion.x && got.y == want_motion.y && got.z == want_motion.z);
+        CHECK(got.e == want_motion.e && got.f == want_motion.f);
+        records++;
+      }
+      else {
+        // A move long enough to hold its record is always converted
+        CHECK(!motion || file[taken].size() < sizeof(gcode_motion_t));
+        CHECK(strcmp((char *)cmd, file[taken].c_str() + file[taken].find_first_not_of(' ')) == 0);
+      }
+      taken++;
+    }
+  }
+  CHECK(records > file.size() / 2);
+}
+
+void test_main() {
+  srand(1);
+  system_service.set_status(SYSTEM_STATUE_PRINTING);
+  make_file(30000);
+  run_stream(3);
+  run_stream(50);
+}
@@ -0,0 +1,181 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// HMI gcode line ring: packets pushed by the event task, lines taken by the
+// marlin task, with lines split across packets and the ring wrapping
+
+#include "test.h"
+#include <string>
+#include <vector>
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/module/print_control.h"
+#include "snapmaker/module/power_loss.h"
+#include "snapmaker/module/system.h"
+
+#define RING_LINES ((HMI_GCODE_BUFFER_SIZE / 8) - 1)
+#define PACKET_MAX_SIZE 1000
+
+static std::vector<std::string> file;
+
+static void make_file(uint32_t count) {
+  file.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    std::string line;
+    switch (rand() % 10) {
+      case 0: break;  // blank
+      case 1: line = "   "; break;
+      case 2: line = "  G1 X1.5"; break;
+      default: {
+        uint16_t len = 1 + rand() % (MAX_CMD_SIZE - 2);
+        for (uint16_t c = 0; c < len; c++) {
+          line += (char)('!' + rand() % 94);
+        }
+        if (rand() % 4 == 0) line[0] = ' ';
+      }
+    }
+    file.push_back(line);
+  }
+}
+
+// What get_commands() returns for a line, NULL when it is skipped
+static const char *command_of(const std::string &line) {
+  size_t skip = line.find_first_not_of(' ');
+  return skip == std::string::npos ? NULL : line.c_str() + skip;
+}
+
+static void test_stream(uint32_t lines, uint8_t consume_max) {
+  make_file(lines);
+  print_control.clear_gcode_buf();
+  power_loss.next_req = 0;
+  power_loss.line_number_sum = 0;
+
+  uint32_t pushed = 0;   // lines complete in the ring
+  uint16_t partial = 0;  // bytes of the next line already pushed
+  uint32_t taken = 0;    // lines released by the consumer
+  uint32_t refused = 0;
+
+  while (taken < lines) {
+    std::string data;
+    uint32_t count = 0;
+    uint16_t cut = 0;
+    uint32_t want = 1 + rand() % 40;
+    while (pushed + count < lines && count < want) {
+      std::string rest = file[pushed + count].substr(count ? 0 : partial) + "\n";
+      if (data.size() + rest.size() > PACKET_MAX_SIZE) break;
+      data += rest;
+      count++;
+    }
+    // Sometimes end the packet inside the next line
+    if (pushed + count < lines && rand() % 4 == 0) {
+      const uint16_t from = count ? 0 : partial;
+      const uint16_t left = file[pushed + count].size() - from;
+      cut = left > 1 ? rand() % left : 0;
+      data += file[pushed + count].substr(from, cut);
+    }
+
+    if (!data.empty()) {
+      uint32_t free = print_control.get_buf_free();
+      uint32_t index_free = RING_LINES - (pushed - taken);
+      ErrCode ret = print_control.push_gcode(pushed, pushed + count - 1, (uint8_t *)&data[0], data.size());
+      if (ret == E_SUCCESS) {
+        CHECK(free >= data.size());
+        partial = (count ? 0 : partial) + cut;
+        pushed += count;
+        CHECK_EQ(print_control.next_req_line(), pushed);
+      }
+      else {
+        // Room that was reported free must take the packet
+        CHECK_EQ(ret, E_NO_MEM);
+        CHECK(free < data.size() || index_free < count);
+        refused++;
+      }
+    }
+
+    uint8_t n = rand() % (consume_max + 1);
+    for (uint8_t i = 0; i < n; i++) {
+      uint8_t cmd[MAX_CMD_SIZE];
+      uint32_t line = 0;
+      // Blank lines are stepped over inside get_commands()
+      while (taken < pushed && !command_of(file[taken])) taken++;
+      if (taken == pushed) {
+        CHECK(!print_control.get_commands(cmd, line, sizeof(cmd)));
+        break;
+      }
+      CHECK(print_control.get_commands(cmd, line, sizeof(cmd)));
+      CHECK(strcmp((char *)cmd, command_of(file[taken])) == 0);
+      CHECK_EQ(line, taken + 1);
+      taken++;
+    }
+  }
+  // The ring fills up when the consumer is slow
+  CHECK(refused > 0 || consume_max > 20);
+}
+
+static void test_rejects() {
+  print_control.clear_gcode_buf();
+  power_loss.next_req = 10;
+
+  uint8_t data[] = "G28\nG1 X1\n";
+  uint16_t size = sizeof(data) - 1;
+  // Not the line asked for
+  CHECK_EQ(print_control.push_gcode(11, 12, data, size), E_PARAM);
+  // Line count not matching the data
+  CHECK_EQ(print_control.push_gcode(10, 10, data, size), E_PARAM);
+  CHECK_EQ(print_control.push_gcode(10, 12, data, size), E_PARAM);
+  CHECK_EQ(print_control.get_buf_used(), 0);
+  CHECK_EQ(print_control.next_req_line(), 10);
+
+  CHECK_EQ(print_control.push_gcode(10, 11, data, size), E_SUCCESS);
+  CHECK_EQ(print_control.next_req_line(), 12);
+  CHECK_EQ(print_control.get_buf_used(), size);
+
+  // More than the reported room is refused without touching the ring
+  static uint8_t big[HMI_GCODE_BUFFER_SIZE];
+  memset(big, 'M', sizeof(big));
+  big[sizeof(big) - 1] = '\n';
+  CHECK_EQ(print_control.push_gcode(12, 12, big, sizeof(big)), E_NO_MEM);
+  CHECK_EQ(print_control.get_buf_used(), size);
+
+  // A line longer than a command is dropped, not copied
+  uint8_t cmd[MAX_CMD_SIZE];
+  uint32_t line;
+  power_loss.line_number_sum = 0;
+  uint8_t longer[MAX_CMD_SIZE + 2];
+  memset(longer, 'M', sizeof(longer));
+  longer[sizeof(longer) - 1] = '\n';
+  CHECK_EQ(print_control.push_gcode(12, 12, longer, sizeof(longer)), E_SUCCESS);
+  CHECK(print_control.get_commands(cmd, line, sizeof(cmd)));
+  CHECK(strcmp((char *)cmd, "G28") == 0);
+  CHECK(print_control.get_commands(cmd, line, sizeof(cmd)));
+  CHECK(strcmp((char *)cmd, "G1 X1") == 0);
+  CHECK(!print_control.get_commands(cmd, line, sizeof(cmd)));
+  CHECK_EQ(print_control.get_buf_used(), 0);
+  CHECK_EQ(power_loss.line_number_sum, 3);
+}
+
+void test_main() {
+  srand(1);
+  system_service.set_status(SYSTEM_STATUE_PRINTING);
+  // A slow consumer keeps the ring full, a fast one keeps it near empty
+  test_stream(50000, 3);
+  test_stream(50000, 50);
+  test_rejects();
+}
@@ -0,0 +1,233 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Sliding window gcode requests against a loopback HMI which answers late,
+// out of order, loses requests and packets, sends past the requested lines
+// or garbage line ranges. The gcode buffer must get every line once, in order
+
+#include "test.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// The window code is static, the test is built into the same unit
+#include "snapmaker/event/event_printer.cpp"
+
+uint32_t statistics_gcode_timeout_cnt;
+
+typedef struct {
+  uint32_t line;
+  uint16_t buf_size;
+  uint16_t count;
+} request_t;
+
+typedef struct {
+  bool inverted;  // a bad range, end_line before start_line
+  uint8_t flag;
+  uint32_t start_line;
+  uint32_t end_line;
+  std::string data;
+} packet_t;
+
+// How the loopback HMI misbehaves, in percent of the requests or packets
+typedef struct {
+  uint8_t late;       // kept back a few steps, the packets arrive out of order
+  uint8_t lost;       // a request or a packet does not arrive
+  uint8_t overshoot;  // more lines than asked for, within buf_max_size
+  uint8_t short_of;   // fewer lines than asked for
+  uint8_t inverted;
+} hmi_t;
+
+static std::vector<std::string> file;
+static std::vector<request_t> requests;  // sent by the firmware, not seen by the HMI yet
+
+ErrCode send_event(event_source_e source, uint8_t recever_id, uint8_t attribute, uint8_t command_set,
+                   uint8_t command_id, uint8_t *data, uint16_t length, uint16_t sequence) {
+  CHECK_EQ(command_set, COMMAND_SET_PRINTER);
+  CHECK_EQ(command_id, PRINTER_ID_REQ_GCODE);
+  CHECK_EQ(length, sizeof(batch_gcode_window_req_t));
+  batch_gcode_window_req_t info;
+  memcpy(&info, data, sizeof(info));
+  CHECK_EQ(info.ack_line, print_control.next_req_line());
+  CHECK(info.line_count >= 1 && info.line_count <= GCODE_WINDOW_MAX_LINES);
+  CHECK(info.buf_max_size <= gcode_pack_size());
+  requests.push_back({info.line_number, info.buf_max_size, info.line_count});
+  return E_SUCCESS;
+}
+
+static void make_file(uint32_t count) {
+  file.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    char line[MAX_CMD_SIZE];
+    snprintf(line, sizeof(line), "G1 X%d.%03d Y%d E%u", rand() % 300, rand() % 1000, rand() % 300, i);
+    std::string text = line;
+    // Some long lines, so the measured line size moves
+    if (rand() % 8 == 0) text += " M" + std::string(rand() % 60, '1');
+    file.push_back(text);
+  }
+}
+
+// What the HMI sends for a request, the lines from its start that fit buf_max_size
+static packet_t answer(const request_t &req, const hmi_t &hmi) {
+  packet_t pack = { false, 0, req.line, 0, "" };
+  if (req.line >= file.size()) {
+    pack.flag = PRINT_RESULT_GCODE_RECV_DONE_E;
+    pack.end_line = req.line;
+    return pack;
+  }
+  uint32_t want = req.count;
+  if ((uint32_t)(rand() % 100) < hmi.overshoot) want += 1 + rand() % GCODE_WINDOW_MAX_LINES;
+  else if (want > 1 && (uint32_t)(rand() % 100) < hmi.short_of) want = 1 + rand() % (want - 1);
+  uint32_t line = req.line;
+  while (line < file.size() && line - req.line < want && pack.data.size() + file[line].size() + 1 <= req.buf_size) {
+    pack.data += file[line++] + "\n";
+  }
+  // buf_max_size always holds a whole line
+  CHECK(line > req.line);
+  pack.end_line = line - 1;
+  if ((uint32_t)(rand() % 100) < hmi.inverted) {
+    pack.inverted = true;
+    pack.end_line = pack.start_line - 1;
+  }
+  return pack;
+}
+
+static ErrCode deliver(const packet_t &pack) {
+  static uint8_t frame[sizeof(batch_gcode_t) + GCODE_MAX_UNPACK_SIZE];
+  batch_gcode_t *gcode = (batch_gcode_t *)frame;
+  gcode->flag = pack.flag;
+  gcode->start_line = pack.start_line;
+  gcode->end_line = pack.end_line;
+  gcode->data_len = pack.data.size();
+  memcpy(gcode->data, pack.data.data(), pack.data.size());
+  event_param_t event = event_param_t();
+  event.data = frame;
+  event.length = sizeof(batch_gcode_t) + pack.data.size();
+  return gcode_pack_deal(event);
+}
+
+static void run_stream(uint32_t lines, const hmi_t &hmi, uint8_t consume_max) {
+  make_file(lines);
+  print_control.clear_gcode_buf();
+  power_loss.next_req = 0;
+  power_loss.line_number_sum = 0;
+  system_service.set_status(SYSTEM_STATUE_PRINTING);
+  gcode_window_line_bytes = gcode_window_wire_bytes = GCODE_WINDOW_LINE_BYTES;
+  gcode_req_base_wait_ms = 0;
+  statistics_gcode_timeout_cnt = 0;
+  requests.clear();
+
+  std::vector<packet_t> in_flight;  // sent by the HMI, not delivered yet
+  uint32_t taken = 0;
+  uint8_t max_busy = 0;
+  req_gcode_pack();
+
+  for (uint32_t step = 0; gcode_req_status != GCODE_PACK_REQ_DONE; step++) {
+    if (step > lines * 20 || system_service.get_status() != SYSTEM_STATUE_PRINTING) {
+      CHECK(!"stream stuck");
+      return;
+    }
+
+    // The HMI answers what reached it
+    for (size_t i = 0; i < requests.size(); i++) {
+      if ((uint32_t)(rand() % 100) >= hmi.lost) in_flight.push_back(answer(requests[i], hmi));
+    }
+    requests.clear();
+
+    // The packets on the way arrive now, a late one stays for later
+    std::vector<packet_t> arrived;
+    for (size_t i = 0; i < in_flight.size();) {
+      if ((uint32_t)(rand() % 100) < hmi.late) {
+        i++;
+      } else {
+        arrived.push_back(in_flight[i]);
+        in_flight.erase(in_flight.begin() + i);
+      }
+    }
+    if (hmi.late) std::random_shuffle(arrived.begin(), arrived.end());
+    for (size_t i = 0; i < arrived.size(); i++) {
+      if ((uint32_t)(rand() % 100) < hmi.lost) continue;
+      const packet_t &pack = arrived[i];
+      const bool expected = pack.start_line == print_control.next_req_line() && gcode_window_find(pack.start_line);
+      const uint32_t before = requests.size();
+      ErrCode ret = deliver(pack);
+      if (expected && pack.inverted) {
+        // Refused, the slot asks again
+        CHECK_EQ(ret, E_PARAM);
+        CHECK(requests.size() > before && requests[before].line == pack.start_line);
+        CHECK_EQ(print_control.next_req_line(), pack.start_line);
+      }
+      else {
+        // A packet within the room the request reserved is always taken
+        CHECK_EQ(ret, E_SUCCESS);
+        if (expected && pack.flag != PRINT_RESULT_GCODE_RECV_DONE_E) {
+          CHECK_EQ(print_control.next_req_line(), pack.end_line + 1);
+        }
+      }
+      if (gcode_req_status == GCODE_PACK_REQ_DONE) break;
+    }
+
+    uint8_t busy = 0;
+    for (uint8_t i = 0; i < gcode_window_size; i++) busy += gcode_window[i].busy;
+    NOLESS(max_busy, busy);
+
+    uint8_t n = rand() % (consume_max + 1);
+    for (uint8_t i = 0; i < n && taken < print_control.next_req_line(); i++) {
+      uint8_t cmd[MAX_CMD_SIZE];
+      uint32_t line;
+      CHECK(print_control.get_commands(cmd, line, sizeof(cmd)));
+      CHECK_EQ(line, taken + 1);
+      CHECK(strcmp((char *)cmd, file[taken].c_str()) == 0);
+      taken++;
+    }
+
+    host_millis += 10;
+    printing_status_deal();
+  }
+
+  CHECK_EQ(print_control.next_req_line(), lines);
+  CHECK(max_busy > 1);
+  if (!hmi.lost) {
+    // Late, partial or refused answers are asked again without waiting
+    CHECK_EQ(statistics_gcode_timeout_cnt, 0);
+  }
+  else {
+    CHECK(statistics_gcode_timeout_cnt > 0);
+  }
+}
+
+void test_main() {
+  srand(1);
+  gcode_window_size = GCODE_WINDOW_MAX_SIZE;
+  const hmi_t in_order = { 0, 0, 0, 0, 0 };
+  const hmi_t reordered = { 30, 0, 0, 0, 0 };
+  const hmi_t lossy = { 0, 10, 0, 0, 0 };
+  const hmi_t overshoot = { 0, 0, 30, 30, 0 };
+  const hmi_t inverted = { 0, 0, 0, 0, 5 };
+  const hmi_t everything = { 20, 5, 10, 10, 2 };
+  run_stream(20000, in_order, 10);
+  run_stream(20000, reordered, 10);
+  run_stream(20000, lossy, 10);
+  run_stream(20000, overshoot, 10);
+  run_stream(20000, inverted, 10);
+  run_stream(20000, everything, 10);
+  run_stream(20000, everything, 2);
+}
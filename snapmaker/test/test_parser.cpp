@@ -0,0 +1,142 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// GCodeParser number parsing against strtof/strtol, and how much faster it
+// is than the strtof path value_float() had before
+
+#include "test.h"
+#include <chrono>
+#include <vector>
+#include "src/gcode/parser.h"
+
+static void check_float(const char *text) {
+  char buf[32];
+  strcpy(buf, text);
+  float got = parser.parse_float(buf);
+  float want = strtof(text, NULL);
+  // Bit exact, the parser must round like strtof
+  CHECK(memcmp(&got, &want, sizeof(float)) == 0);
+  if (memcmp(&got, &want, sizeof(float))) {
+    printf("  \"%s\": %.9g, strtof %.9g\n", text, got, want);
+  }
+}
+
+static void check_range(long from, long to, int decimals) {
+  long scale = 1;
+  for (int i = 0; i < decimals; i++) scale *= 10;
+  for (long i = from; i <= to; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s%ld.%0*ld", i < 0 ? "-" : "", labs(i) / scale, decimals, labs(i) % scale);
+    check_float(buf);
+  }
+}
+
+// What value_float() did before parse_float()
+static float strtof_value_float(char * const value_ptr) {
+  char *e = value_ptr;
+  for (;;) {
+    const char c = *e;
+    if (c == '\0' || c == ' ') break;
+    if (c == 'E' || c == 'e') {
+      *e = '\0';
+      const float ret = strtof(value_ptr, nullptr);
+      *e = c;
+      return ret;
+    }
+    ++e;
+  }
+  return strtof(value_ptr, nullptr);
+}
+
+template <typename F>
+static double bench_ns(std::vector<char> &text, const std::vector<uint32_t> &at, F parse) {
+  volatile float sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint8_t pass = 0; pass < 10; pass++) {
+    for (uint32_t i : at) sink = sink + parse(&text[i]);
+  }
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  return (double)ns / (at.size() * 10);
+}
+
+// Values as a slicer writes them: coordinates, extrusion, feedrates, temperatures
+static void bench() {
+  std::vector<char> text;
+  std::vector<uint32_t> floats, longs;
+  srand(1);
+  for (uint32_t i = 0; i < 200000; i++) {
+    char buf[32];
+    switch (i % 4) {
+      case 0: snprintf(buf, sizeof(buf), "%.3f", (rand() % 3000000) / 1000.0); break;
+      case 1: snprintf(buf, sizeof(buf), "%.5f", (rand() % 200000) / 100000.0); break;
+      case 2: snprintf(buf, sizeof(buf), "%d", (rand() % 120) * 100); break;
+      default: snprintf(buf, sizeof(buf), "-%.2f", (rand() % 1000) / 100.0); break;
+    }
+    floats.push_back(text.size());
+    text.insert(text.end(), buf, buf + strlen(buf) + 1);
+    snprintf(buf, sizeof(buf), "%d", rand() % (i % 2 ? 300 : 100000));
+    longs.push_back(text.size());
+    text.insert(text.end(), buf, buf + strlen(buf) + 1);
+  }
+  for (uint32_t i : floats) {
+    float got = parser.parse_float(&text[i]), want = strtof_value_float(&text[i]);
+    CHECK(memcmp(&got, &want, sizeof(float)) == 0);
+  }
+  for (uint32_t i : longs) CHECK_EQ(parser.parse_long(&text[i]), (int32_t)strtol(&text[i], NULL, 10));
+
+  const double float_ns = bench_ns(text, floats, [](char *p) { return parser.parse_float(p); });
+  const double strtof_ns = bench_ns(text, floats, strtof_value_float);
+  const double long_ns = bench_ns(text, longs, [](char *p) { return (float)parser.parse_long(p); });
+  const double strtol_ns = bench_ns(text, longs, [](char *p) { return (float)strtol(p, NULL, 10); });
+  printf("parse_float %.1f ns, strtof %.1f ns, %.1fx\n", float_ns, strtof_ns, strtof_ns / float_ns);
+  printf("parse_long %.1f ns, strtol %.1f ns, %.1fx\n", long_ns, strtol_ns, strtol_ns / long_ns);
+}
+
+void test_main() {
+  // Coordinates, extrusion and feedrates the slicers write
+  check_range(-1000000, 1000000, 3);
+  check_range(-1000000, 1000000, 5);
+  check_range(-100000, 100000, 2);
+
+  const char *forms[] = {
+    "0", "-0", "+.5", ".125", "5.", "007.500", "123456789.123",
+    "0.00000000001", "16777216", "16777215.5", "-.0001", "3.14159265358979",
+  };
+  for (uint8_t i = 0; i < COUNT(forms); i++) {
+    check_float(forms[i]);
+  }
+
+  // The parser stops at an exponent, gcode has none
+  char exp[] = "2.5E4";
+  CHECK(parser.parse_float(exp) == 2.5f);
+  char word[] = "X";
+  CHECK(parser.parse_float(word) == 0.0f);
+
+  const char *longs[] = {
+    "0", "-1", "+42", "999999999", "-2147483647", "12abc", "-", "7 ",
+  };
+  for (uint8_t i = 0; i < COUNT(longs); i++) {
+    CHECK_EQ(parser.parse_long(longs[i]), (int32_t)strtol(longs[i], NULL, 10));
+    CHECK_EQ(parser.parse_ulong(longs[i]), (uint32_t)strtoul(longs[i], NULL, 10));
+  }
+
+  bench();
+}
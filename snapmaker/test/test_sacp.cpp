@@ -0,0 +1,209 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// SACP framing: package() output parsed back whole, in chunks and corrupted
+
+#include "test.h"
+#include <string.h>
+#include <stdlib.h>
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/protocol/protocol_sacp.h"
+
+extern uint16_t calc_checksum(uint8_t *buffer, uint16_t length);
+
+static ProtocolSACP sacp;
+
+// CRC-8 poly 0x07 a bit at a time, what the table was generated from
+static uint8_t crc8_bitwise(const uint8_t *buffer, uint16_t len) {
+  uint8_t crc = 0;
+  for (uint16_t i = 0; i < len; i++) {
+    crc ^= buffer[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// One's complement sum of big endian words, an odd tail byte is the low byte
+static uint16_t checksum_reference(const uint8_t *buffer, uint16_t len) {
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i + 1 < len; i += 2) {
+    sum += (buffer[i] << 8) | buffer[i + 1];
+  }
+  if (len & 1) {
+    sum += buffer[len - 1];
+  }
+  while (sum > 0xffff) {
+    sum = (sum >> 16) + (sum & 0xffff);
+  }
+  return (uint16_t)~sum;
+}
+
+static uint16_t make_frame(uint8_t *frame, uint16_t payload_len, uint16_t sequence) {
+  SACP_head_base_t head = {SACP_ID_HMI, SACP_ATTR_REQ, sequence, 0xAC, 0xA0};
+  uint8_t payload[PACK_PARSE_MAX_SIZE];
+  for (uint16_t i = 0; i < payload_len; i++) {
+    payload[i] = rand();
+  }
+  return sacp.package(head, payload, payload_len, frame);
+}
+
+// Feed data in chunks of at most chunk bytes, collect the frames that complete
+static uint16_t feed(uint8_t *data, uint16_t len, uint16_t chunk, SACP_param_t &out,
+                     uint16_t *ends, ErrCode *results, uint16_t max_frames) {
+  uint16_t frames = 0;
+  uint16_t pos = 0;
+  while (pos < len) {
+    uint16_t n = len - pos;
+    NOMORE(n, chunk);
+    uint16_t used = 0;
+    ErrCode ret = sacp.parse(&data[pos], n, out, used);
+    CHECK(used > 0 && used <= n);
+    if (!used) break;
+    pos += used;
+    if (ret != E_IN_PROGRESS) {
+      if (frames < max_frames) {
+        ends[frames] = pos;
+        results[frames] = ret;
+      }
+      frames++;
+    }
+    else {
+      CHECK_EQ(used, n);
+    }
+  }
+  return frames;
+}
+
+static void test_crc_and_checksum() {
+  for (uint16_t i = 0; i < 256; i++) {
+    uint8_t b = i;
+    uint8_t frame[PACK_PARSE_MAX_SIZE];
+    // package() fills the crc from the first six header bytes
+    make_frame(frame, i, b);
+    CHECK_EQ(frame[6], crc8_bitwise(frame, 6));
+  }
+  for (uint16_t len = 0; len < 300; len++) {
+    uint8_t buf[300];
+    for (uint16_t i = 0; i < len; i++) buf[i] = rand();
+    CHECK_EQ(calc_checksum(buf, len), len ? checksum_reference(buf, len) : 0);
+  }
+}
+
+static void test_whole_frames() {
+  for (uint16_t payload = 0; payload <= PACK_PARSE_MAX_SIZE - SACP_HEADER_LEN; payload++) {
+    uint8_t frame[PACK_PARSE_MAX_SIZE];
+    uint16_t len = make_frame(frame, payload, payload);
+    CHECK_EQ(len, payload + SACP_HEADER_LEN);
+    // The running checksum matches what package() computed over the frame
+    CHECK_EQ(frame[len - 2] | frame[len - 1] << 8, checksum_reference(&frame[7], len - 9));
+
+    static const uint16_t chunks[] = {1, 2, 3, 7, 64, 0xffff};
+    for (uint8_t c = 0; c < COUNT(chunks); c++) {
+      SACP_param_t out;
+      memset(&out, 0, sizeof(out));
+      uint16_t ends[1];
+      ErrCode results[1];
+      CHECK_EQ(feed(frame, len, chunks[c], out, ends, results, 1), 1);
+      CHECK_EQ(results[0], E_SUCCESS);
+      CHECK_EQ(ends[0], len);
+      CHECK(memcmp(out.buff, frame, len) == 0);
+    }
+  }
+}
+
+static void test_stream() {
+  // Frames back to back with noise between them, one call can end a frame mid chunk
+  static uint8_t stream[16 * PACK_PARSE_MAX_SIZE];
+  uint16_t expect_end[64];
+  uint16_t frames = 0, len = 0;
+  while (frames < COUNT(expect_end)) {
+    uint16_t noise = rand() % 5;
+    for (uint16_t i = 0; i < noise; i++) {
+      stream[len++] = (rand() % 2) ? SACP_PDU_SOF_H : 0x13;
+    }
+    uint16_t payload = rand() % 200;
+    if (len + payload + SACP_HEADER_LEN > (int)sizeof(stream)) break;
+    len += make_frame(&stream[len], payload, frames);
+    expect_end[frames++] = len;
+  }
+
+  for (uint16_t chunk = 1; chunk < 600; chunk += 37) {
+    SACP_param_t out;
+    memset(&out, 0, sizeof(out));
+    uint16_t ends[COUNT(expect_end)];
+    ErrCode results[COUNT(expect_end)];
+    CHECK_EQ(feed(stream, len, chunk, out, ends, results, COUNT(ends)), frames);
+    for (uint16_t f = 0; f < frames; f++) {
+      CHECK_EQ(results[f], E_SUCCESS);
+      CHECK_EQ(ends[f], expect_end[f]);
+    }
+  }
+}
+
+static void test_corrupt() {
+  uint8_t frame[PACK_PARSE_MAX_SIZE];
+  uint16_t len = make_frame(frame, 40, 7);
+  uint16_t ends[2];
+  ErrCode results[2];
+
+  // A payload byte flipped fails the checksum once the frame ends
+  for (uint16_t i = 7; i < len; i++) {
+    uint8_t bad[PACK_PARSE_MAX_SIZE];
+    memcpy(bad, frame, len);
+    bad[i] ^= 0x10;
+    SACP_param_t out;
+    memset(&out, 0, sizeof(out));
+    CHECK_EQ(feed(bad, len, len, out, ends, results, 2), 1);
+    CHECK_EQ(results[0], E_PARAM);
+  }
+
+  // A bad header is dropped and the next frame still parses
+  for (uint16_t i = 2; i < 7; i++) {
+    uint8_t bad[2 * PACK_PARSE_MAX_SIZE];
+    memcpy(bad, frame, len);
+    memcpy(&bad[len], frame, len);
+    bad[i] ^= 0x01;
+    SACP_param_t out;
+    memset(&out, 0, sizeof(out));
+    CHECK_EQ(feed(bad, 2 * len, 5, out, ends, results, 2), 1);
+    CHECK_EQ(results[0], E_SUCCESS);
+    CHECK_EQ(ends[0], 2 * len);
+  }
+
+  // A length the parse buffer can not hold is refused at the header
+  SACP_param_t out;
+  memset(&out, 0, sizeof(out));
+  uint8_t big[7] = {SACP_PDU_SOF_H, SACP_PDU_SOF_L, (PACK_PARSE_MAX_SIZE - 6) & 0xff, (PACK_PARSE_MAX_SIZE - 6) >> 8, SACP_VERSION, 0, 0};
+  big[6] = crc8_bitwise(big, 6);
+  uint16_t used;
+  CHECK_EQ(sacp.parse(big, sizeof(big), out, used), E_IN_PROGRESS);
+  CHECK_EQ(out.lenght, 0);
+}
+
+void test_main() {
+  srand(1);
+  test_crc_and_checksum();
+  test_whole_frames();
+  test_stream();
+  test_corrupt();
+}
@@ -0,0 +1,432 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host replay of the shaped motion pipeline: moves go through the planner,
+// the shaper and the FuncManager rings, shaped_loop() runs as the marlin task
+// every ms and the stepper ISR phases run on a simulated timer. The steps
+// that come out must add up to every planned position
+
+#include "test.h"
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "src/inc/MarlinConfig.h"
+#include "src/module/planner.h"
+#include "src/module/stepper.h"
+#include "src/module/AxisManager.h"
+
+extern uint32_t statistics_funcgen_runout_cnt;
+
+// A stuck pipeline gives up after this long without a step
+#define REPLAY_STALL_MS 2000
+
+typedef struct {
+  xyze_pos_t pos;
+  feedRate_t feedrate;  // mm/s
+} target_t;
+
+// Host time of the stepper ISR calls that send a step, in 10 ns buckets
+#define ISR_NS_BUCKET  10
+#define ISR_NS_BUCKETS 2000
+
+typedef struct {
+  uint32_t count[ISR_NS_BUCKETS];
+  uint32_t calls;
+  double total_ns, max_ns;
+} isr_time_t;
+
+typedef struct {
+  uint32_t print_ms;      // simulated time until the last step
+  uint32_t steps;
+  int32_t position[AXIS_SIZE];
+  double host_ns;         // host time of the task and the ISR per step
+  isr_time_t popped;      // the step came from the event ring
+  isr_time_t underrun;    // the ISR calculated the step itself
+  uint32_t retries;       // ISR calls that found the ring dry with the task inside a calculation
+  uint32_t switch_ms;     // simulated time the shaper profile switch waited for the old moves
+} replay_t;
+
+typedef struct {
+  const char *name;
+  InputShaperType shaper;
+  uint32_t task_ms;      // the marlin task runs this often
+  float arrival;         // moves the gcode stream brings each ms, 0 keeps the planner full
+  bool fixed_window;     // the delivery window is held at SHAPED_WAITING_MIN_TIME
+  float advance_k;       // M900 K
+  float advance_smooth;  // M900 W (s)
+  bool preempt;          // every other ISR call on a dry ring lands inside a task calculation
+  uint32_t switch_at;    // a tool change selects switch_profile before this move, 0 for none
+  uint8_t switch_profile;
+} scenario_t;
+
+static std::vector<target_t> path;
+
+// A wait runs the marlin task as idle() does on the printer. The replay only
+// queues into a planner with room, a wait on queued blocks would never end
+void idle(bool) {
+  if (planner.has_blocks_queued()) {
+    CHECK(!"planner wait");
+    exit(1);
+  }
+  planner.shaped_loop();
+}
+
+static void add(xyze_pos_t &pos, float x, float y, float e, feedRate_t feedrate) {
+  pos.x = x;
+  pos.y = y;
+  pos.e += e;
+  path.push_back({ pos, feedrate });
+}
+
+// Layers of polygons of short segments, travels between them with a retract
+static void make_print(uint32_t segments) {
+  xyze_pos_t pos;
+  pos.reset();
+  path.clear();
+  while (path.size() < segments) {
+    if (path.size() % 2000 == 0) {
+      pos.z += 0.2f;
+    }
+    const float cx = 60 + rand() % 180, cy = 60 + rand() % 180;
+    const float r = 5 + rand() % 50;
+    const uint16_t sides = 3 + rand() % 120;
+    const feedRate_t feedrate = 40 + rand() % 260;
+    add(pos, pos.x, pos.y, -0.8f, 40);
+    add(pos, cx + r, cy, 0, 350);
+    add(pos, pos.x, pos.y, 0.8f, 40);
+    for (uint16_t i = 1; i <= sides; i++) {
+      const float a = 2 * M_PI * i / sides;
+      const float x = cx + r * cosf(a), y = cy + r * sinf(a);
+      add(pos, x, y, 0.033f * HYPOT(x - pos.x, y - pos.y), feedrate);
+    }
+  }
+}
+
+// Curves sliced into segments of a few tenths of a mm, a few ms each
+static void make_segments(uint32_t segments) {
+  xyze_pos_t pos;
+  pos.reset();
+  path.clear();
+  while (path.size() < segments) {
+    const float cx = 60 + rand() % 180, cy = 60 + rand() % 180;
+    const float r = 10 + rand() % 20;
+    const uint16_t sides = 2 * M_PI * r / (0.1f + (rand() % 20) / 100.0f);
+    const feedRate_t feedrate = 150 + rand() % 100;
+    add(pos, cx + r, cy, 0, 350);
+    for (uint16_t i = 1; i <= sides; i++) {
+      const float a = 2 * M_PI * i / sides;
+      const float x = cx + r * cosf(a), y = cy + r * sinf(a);
+      add(pos, x, y, 0.033f * HYPOT(x - pos.x, y - pos.y), feedrate);
+    }
+  }
+}
+
+static void setup() {
+  const float steps_per_mm[] = DEFAULT_AXIS_STEPS_PER_UNIT;
+  const float max_feedrate[] = DEFAULT_MAX_FEEDRATE;
+  const uint32_t max_acceleration[] = DEFAULT_MAX_ACCELERATION;
+  LOOP_DISTINCT_AXES(i) {
+    planner.settings.axis_steps_per_mm[i] = steps_per_mm[i];
+    planner.settings.max_feedrate_mm_s[i] = max_feedrate[i];
+    planner.settings.max_acceleration_mm_per_s2[i] = max_acceleration[i];
+  }
+  planner.settings.min_segment_time_us = DEFAULT_MINSEGMENTTIME;
+  planner.settings.acceleration = DEFAULT_ACCELERATION;
+  planner.settings.retract_acceleration = DEFAULT_RETRACT_ACCELERATION;
+  planner.settings.travel_acceleration = DEFAULT_TRAVEL_ACCELERATION;
+  planner.settings.min_feedrate_mm_s = DEFAULT_MINIMUMFEEDRATE;
+  planner.settings.min_travel_feedrate_mm_s = DEFAULT_MINTRAVELFEEDRATE;
+  planner.settings.acceleration_to_deceleration_ratio = DEFAULT_ACCELERATION_TO_DECELERATION_RATIO;
+  planner.corner_velocity_sqr = CORNER_VELOCITY;
+  planner.junction_deviation_mm = planner.corner_velocity_sqr * (SQRT(2.) - 1.) / _MAX(planner.settings.acceleration, planner.settings.travel_acceleration);
+  LOOP_L_N(i, EXTRUDERS) {
+    planner.flow_percentage[i] = 100;
+    planner.volumetric_multiplier[i] = 1;
+    planner.refresh_e_factor(i);
+  }
+  TERN_(HAS_LINEAR_E_JERK, planner.recalculate_max_e_jerk());
+  planner.init();
+  planner.refresh_positioning();
+  axisManager.input_shaper_reset();
+  axisManager.init();
+}
+
+// Back at the origin with the shaper set the way M593 sets it. The abort that
+// restarts the pipeline drops queued blocks, it is served before any move
+static void restart(const scenario_t &s) {
+  current_position.reset();
+  planner.set_position_mm(current_position);
+  for (int axis = X_AXIS; axis <= Y_AXIS; axis++) {
+    int type;
+    float freq, dampe;
+    axisManager.input_shaper_get(axis, type, freq, dampe);
+    axisManager.input_shaper_set(axis, (int)s.shaper, freq, dampe);
+  }
+  planner.synchronize();
+  LOOP_L_N(i, EXTRUDERS) {
+    planner.extruder_advance_K[i] = s.advance_k;
+    planner.extruder_advance_smooth[i] = s.advance_smooth;
+  }
+  axisManager.reset_debug_info();
+}
+
+static void isr_time_add(isr_time_t &t, const timespec &start, const timespec &end) {
+  const double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  t.count[_MIN((uint32_t)(ns / ISR_NS_BUCKET), (uint32_t)ISR_NS_BUCKETS - 1)]++;
+  t.calls++;
+  t.total_ns += ns;
+  NOLESS(t.max_ns, ns);
+}
+
+// The time the given part of the calls stays within, the host preempting a
+// call only shows in the worst case
+static double isr_time_at(const isr_time_t &t, double part) {
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < ISR_NS_BUCKETS; i++) {
+    sum += t.count[i];
+    if (sum >= part * t.calls) return (i + 1) * ISR_NS_BUCKET;
+  }
+  return t.max_ns;
+}
+
+// The marlin task queues the moves that arrived and runs shaped_loop() every
+// task_ms, the ISR pops what the task precomputed and only calculates a step
+// when it runs dry
+static void replay(replay_t &r, const scenario_t &s) {
+  int32_t seen[AXIS_SIZE] = { 0 };
+  uint64_t isr_tick = (uint64_t)host_millis * STEPPER_TIMER_TICKS_PER_MS;
+  const uint32_t start_ms = host_millis;
+  uint32_t next = 0, last_step_ms = host_millis;
+  time_double_t last_print_time = 0;
+  uint32_t dry = 0;
+  clock_t host = 0;
+  uint32_t switch_start_ms = 0;
+  r = replay_t();
+
+  for (;;) {
+    clock_t start = clock();
+    if (host_millis % s.task_ms == 0) {
+      // The gcode task queues what arrived and the planner takes
+      const uint32_t arrived = s.arrival ? _MIN((uint32_t)((host_millis - start_ms) * s.arrival), (uint32_t)path.size()) : path.size();
+      if (s.switch_at && next == s.switch_at && !switch_start_ms) {
+        // The tool change selects its profile with the moves of the old tool
+        // still queued, the running shaper is left alone until they are done
+        const float left_delta = axisManager.shaped_left_delta;
+        CHECK(planner.has_blocks_queued());
+        axisManager.input_shaper_select(s.switch_profile);
+        CHECK(axisManager.shaper_switch_pending);
+        CHECK(axisManager.shaped_left_delta == left_delta);
+        switch_start_ms = host_millis;
+      }
+      // and moves the carriages once the switch is made
+      while (next < arrived && !planner.is_full() && !axisManager.shaper_switch_pending) {
+        planner.buffer_line(path[next].pos, path[next].feedrate, 0);
+        next++;
+      }
+      if (s.fixed_window) planner.shaped_window_time = SHAPED_WAITING_MIN_TIME;
+      start = clock();
+      const bool abort = axisManager.req_abort || axisManager.shaper_switch_pending;
+      planner.shaped_loop();
+      // An abort restarts the step counts and the times of the pipeline
+      LOOP_L_N(i, AXIS_SIZE) seen[i] = axisManager.current_steps[i];
+      if (abort) last_print_time = 0;
+      if (switch_start_ms && !r.switch_ms && !axisManager.shaper_switch_pending) {
+        // Every step of the old profile came out before the switch
+        r.switch_ms = _MAX(host_millis - switch_start_ms, 1U);
+        LOOP_L_N(i, AXIS_SIZE) {
+          CHECK_EQ(r.position[i], LROUND(path[s.switch_at - 1].pos[i] * planner.settings.axis_steps_per_mm[i]));
+        }
+      }
+    }
+
+    while (isr_tick < (uint64_t)(host_millis + 1) * STEPPER_TIMER_TICKS_PER_MS) {
+      const int32_t popped = axisManager.counts[SHAPER_DBG_STEP_ISR];
+      const int32_t underruns = axisManager.counts[SHAPER_DBG_STEP_UNDERRUN];
+      const bool preempted = s.preempt && axisManager.getAxisStepperSize() == 0 && (dry++ & 1);
+      axisManager.calc_busy = preempted;
+      timespec isr_start, isr_end;
+      clock_gettime(CLOCK_MONOTONIC, &isr_start);
+      Stepper::pulse_phase_isr();
+      const uint32_t interval = Stepper::block_phase_isr();
+      clock_gettime(CLOCK_MONOTONIC, &isr_end);
+      axisManager.calc_busy = false;
+      if (preempted) {
+        // The ISR leaves the calculation state to the task, nothing was produced
+        CHECK_EQ(axisManager.counts[SHAPER_DBG_STEP_UNDERRUN], underruns);
+        CHECK_EQ(axisManager.getAxisStepperSize(), 0);
+        r.retries++;
+      }
+      if (axisManager.counts[SHAPER_DBG_STEP_ISR] != popped) {
+        isr_time_add(axisManager.counts[SHAPER_DBG_STEP_UNDERRUN] != underruns ? r.underrun : r.popped, isr_start, isr_end);
+        // Whoever calculated them, the steps leave in time order
+        CHECK(Stepper::axis_stepper.print_time >= last_print_time);
+        last_print_time = Stepper::axis_stepper.print_time;
+      }
+      LOOP_L_N(i, AXIS_SIZE) {
+        const int32_t moved = axisManager.current_steps[i] - seen[i];
+        if (moved) {
+          r.position[i] += moved;
+          r.steps += ABS(moved);
+          last_step_ms = host_millis;
+        }
+        seen[i] = axisManager.current_steps[i];
+      }
+      isr_tick += interval ? interval : 1;
+    }
+    host += clock() - start;
+
+    // Done once the abort at the end of the last burst has been served too
+    if (next == path.size() && !planner.has_blocks_queued() && !Stepper::current_block && !axisManager.req_abort) break;
+    if (host_millis - last_step_ms > REPLAY_STALL_MS) {
+      CHECK(!"replay stalled");
+      break;
+    }
+    host_millis++;
+  }
+  r.print_ms = last_step_ms;
+  r.host_ns = r.steps ? (double)host * 1e9 / CLOCKS_PER_SEC / r.steps : 0;
+}
+
+static void print_isr_time(const char *name, const char *what, const isr_time_t &t) {
+  if (!t.calls) return;
+  printf("%s: %u ISR calls %s, %.0f ns mean, %.0f ns for 99.99%%, %.0f ns worst\n", name, t.calls, what,
+         t.total_ns / t.calls, isr_time_at(t, 0.9999), t.max_ns);
+}
+
+// Runs a scenario, returns the stops taken while gcode was still arriving
+static int32_t run(const scenario_t &s) {
+  static replay_t r;
+  const char *name = s.name;
+  restart(s);
+  statistics_funcgen_runout_cnt = 0;
+  const uint32_t start_ms = host_millis;
+  replay(r, s);
+
+  // Every step the planner asked for came out, in the right direction
+  const xyze_pos_t &end = path.back().pos;
+  LOOP_L_N(i, AXIS_SIZE) {
+    CHECK_EQ(r.position[i], LROUND(end[i] * planner.settings.axis_steps_per_mm[i]));
+  }
+  CHECK_EQ(statistics_funcgen_runout_cnt, 0);
+  // A task that runs every ms keeps the ISR out of the step calculation
+  if (s.task_ms == 1) CHECK_EQ(axisManager.counts[SHAPER_DBG_STEP_UNDERRUN], 0);
+  // Unshaped, each move is a line and goes one way on each axis, not a step
+  // more or less than the rounded positions it joins
+  if (s.shaper == InputShaperType::none) {
+    uint32_t steps = 0;
+    int32_t last[AXIS_SIZE] = { 0 };
+    for (size_t n = 0; n < path.size(); n++) {
+      LOOP_L_N(i, AXIS_SIZE) {
+        const int32_t to = LROUND(path[n].pos[i] * planner.settings.axis_steps_per_mm[i]);
+        steps += ABS(to - last[i]);
+        last[i] = to;
+      }
+    }
+    CHECK_EQ(r.steps, steps);
+  }
+
+  printf("%s: %u moves, %u steps in %.1f s, %.0f ns of host time per step\n", name, (uint32_t)path.size(),
+         r.steps, (r.print_ms - start_ms) / 1000.0, r.host_ns);
+  printf("%s: empty moves %d, deferred %d, underruns %d, func params peak %d/%d/%d/%d, arena peak %d/%d chunks\n",
+         name, axisManager.counts[SHAPER_DBG_EMPTY_MOVES_COUNT], axisManager.counts[SHAPER_DBG_DEFERRED_DELIVERY],
+         axisManager.counts[SHAPER_DBG_STEP_UNDERRUN], axisManager.axis[0].func_manager.max_size,
+         axisManager.axis[1].func_manager.max_size, axisManager.axis[2].func_manager.max_size,
+         axisManager.axis[3].func_manager.max_size, FuncManager::chunk_peak, FUNC_PARAMS_CHUNK_COUNT);
+  print_isr_time(name, "popping a precomputed step", r.popped);
+  print_isr_time(name, "calculating the step", r.underrun);
+  if (r.retries) printf("%s: %u ISR calls found the task inside a calculation\n", name, r.retries);
+  if (s.switch_at) {
+    CHECK(r.switch_ms > 0);
+    printf("%s: profile %d after move %u, the old moves took %u ms to finish\n", name, s.switch_profile, s.switch_at, r.switch_ms);
+  }
+  printf("%s: E peak rate %d steps/s\n", name, axisManager.counts[SHAPER_DBG_E_PEAK_RATE]);
+  printf("%s: starved stops %d, feed slowdowns %d, window %.1f ms\n", name, axisManager.counts[SHAPER_DBG_STARVED_STOPS],
+         axisManager.counts[SHAPER_DBG_FEED_SLOWDOWN], planner.shaped_window_time);
+  if (s.arrival) {
+    // Slow gcode sets the pace, the print must not fall behind it
+    const float arrival_ms = path.size() / s.arrival;
+    printf("%s: %.1f s for the gcode to arrive\n", name, arrival_ms / 1000);
+    CHECK(r.print_ms - start_ms < arrival_ms * 1.01f);
+  }
+  return axisManager.counts[SHAPER_DBG_STARVED_STOPS];
+}
+
+void test_main() {
+  srand(1);
+  make_print(20000);
+  setup();
+  const scenario_t prints[] = {
+    { "shaped", InputShaperType::ei, 1, 0 },
+    { "unshaped", InputShaperType::none, 1, 0 },
+    // The ring runs dry between two task runs, the ISR calculates steps as it
+    // did before the task precomputed them
+    { "slow task", InputShaperType::ei, 10, 0 },
+    // The task is taken off the CPU inside a calculation as the ring runs dry,
+    // the ISR looks again shortly instead of masking itself out
+    { "preempted task", InputShaperType::ei, 10, 0, false, 0, 0, true },
+  };
+  for (uint8_t i = 0; i < COUNT(prints); i++) run(prints[i]);
+
+  // A tool change mid print to a tool with another shaper profile. The select
+  // does not wait, the idle() above fails any wait on queued blocks, and the
+  // steps add up on both sides of the switch
+  for (int axis = X_AXIS; axis <= Y_AXIS; axis++) {
+    axisManager.input_shaper_set_profile(INPUT_SHAPER_PROFILE_T1, axis, (int)InputShaperType::zvd, 35, 0.15f);
+  }
+  const uint32_t switch_at = path.size() / 2;
+  run({ "tool change", InputShaperType::ei, 1, 0, false, 0, 0, false, switch_at, INPUT_SHAPER_PROFILE_T1 });
+  CHECK_EQ(axisManager.shaper_profile, INPUT_SHAPER_PROFILE_T1);
+  CHECK((int)AxisInputShaper::axis_input_shaper_x.type == (int)InputShaperType::zvd);
+  CHECK(AxisInputShaper::axis_input_shaper_y.frequency == 35);
+  // Back to T0 with nothing queued, the switch is made at once
+  axisManager.input_shaper_select(INPUT_SHAPER_PROFILE_T0);
+  CHECK(!axisManager.shaper_switch_pending);
+  CHECK(AxisInputShaper::axis_input_shaper_x.type == InputShaperType::ei);
+
+  // Pressure advance leaves every E step where it was, only sooner, and the
+  // smoothed advance keeps the E step rate within what the extruder takes.
+  // The advance unwinds into the retract after a polygon, over a wider window
+  // it does for longer, so the peak is not ordered by the window
+  const float windows[] = { 0.01f, LIN_ADVANCE_SMOOTH_TIME, 0.1f };
+  const float e_max_rate = planner.settings.max_feedrate_mm_s[E_AXIS] * planner.settings.axis_steps_per_mm[E_AXIS];
+  for (uint8_t i = 0; i < COUNT(windows); i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "advance, W%.2f", windows[i]);
+    run({ name, InputShaperType::ei, 1, 0, false, LIN_ADVANCE_K, windows[i] });
+    CHECK(axisManager.counts[SHAPER_DBG_E_PEAK_RATE] <= e_max_rate);
+  }
+
+  // Small segments, as fast as the planner takes them, then arriving slower
+  // than they print. The adaptive window must not stop more often than a
+  // window held at the minimum
+  make_segments(50000);
+  run({ "small segments", InputShaperType::ei, 1, 0, false });
+  const float arrivals[] = { 0.15f, 0.1f };
+  for (uint8_t i = 0; i < COUNT(arrivals); i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "small segments, %.2f moves/ms", arrivals[i]);
+    const int32_t adaptive = run({ name, InputShaperType::ei, 1, arrivals[i], false });
+    strcat(name, ", fixed window");
+    const int32_t fixed = run({ name, InputShaperType::ei, 1, arrivals[i], true });
+    CHECK(adaptive <= fixed);
+  }
+}
@@ -0,0 +1,151 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The scheduling core that merges the steps of all axes into one stream, run
+// against a reference schedule: every step comes out once, in time order, the
+// lower axis first on a tie. The steps then go through a model of the single
+// STEP_TIMER ISR, and the jitter statistics must match the timing error the
+// model computes on its own
+
+#include "test.h"
+#include <algorithm>
+#include <vector>
+#include "src/inc/MarlinConfig.h"
+#include "src/module/AxisManager.h"
+
+#define SCHEDULE_US 2000000
+#define ISR_COST_US 2  // a STEP_TIMER entry, pulse and pop
+
+typedef struct {
+  uint32_t us;
+  int8_t axis;
+} event_t;
+
+static bool event_less(const event_t &a, const event_t &b) {
+  return a.us != b.us ? a.us < b.us : a.axis < b.axis;
+}
+
+static std::vector<event_t> steps[AXIS_SIZE];
+
+// Steps at a rate that swings between rate_min and rate_max steps/s
+static void make_axis(int8_t axis, float rate_min, float rate_max, uint32_t from_us = 0) {
+  const float period_us = 200000 + rand() % 300000;
+  for (uint32_t us = from_us; us < SCHEDULE_US;) {
+    steps[axis].push_back({ us, axis });
+    const float rate = rate_min + (rate_max - rate_min) * 0.5f * (1 + sinf(2 * M_PI * us / period_us));
+    us += _MAX((uint32_t)(1e6f / rate), 1U);
+  }
+}
+
+static time_double_t print_time(uint32_t us) {
+  return time_double_t(us / 1000.0f);
+}
+
+static void run_schedule(const char *name) {
+  std::vector<event_t> reference;
+  LOOP_L_N(i, AXIS_SIZE) reference.insert(reference.end(), steps[i].begin(), steps[i].end());
+  std::sort(reference.begin(), reference.end(), event_less);
+
+  Axis axes[AXIS_SIZE];
+  size_t next[AXIS_SIZE] = { 0 };
+  StepJitter jitter;
+  jitter.reset();
+
+  // What the jitter statistics must find, from the modelled pulse times
+  uint32_t last_fire[AXIS_SIZE] = { 0 }, last_us[AXIS_SIZE] = { 0 };
+  uint32_t want_max[AXIS_SIZE] = { 0 }, want_sum[AXIS_SIZE] = { 0 }, want_samples[AXIS_SIZE] = { 0 };
+  bool seen[AXIS_SIZE] = { false };
+  uint32_t busy_until = 0;
+
+  size_t n = 0;
+  for (;;) {
+    // The axes a step was taken from load their next one, as getNextStep() does
+    LOOP_L_N(i, AXIS_SIZE) {
+      if (axes[i].is_consumed && next[i] < steps[i].size()) {
+        axes[i].print_time = print_time(steps[i][next[i]++].us);
+        axes[i].is_consumed = false;
+      }
+    }
+    time_double_t time;
+    const int8_t axis = nextStepAxis(axes, AXIS_SIZE, time);
+    if (axis < 0) break;
+    axes[axis].is_consumed = true;
+
+    // In time order, ties to the lower axis
+    CHECK(n < reference.size());
+    if (n >= reference.size()) return;
+    const event_t &want = reference[n++];
+    CHECK_EQ(axis, want.axis);
+    CHECK(time == print_time(want.us));
+
+    // One timer serialises every axis, an entry waits for the one before it
+    const uint32_t fire = _MAX(want.us, busy_until);
+    busy_until = fire + ISR_COST_US;
+    jitter.record(axis, time, fire * HAL_CYCLES_PER_US);
+
+    const uint32_t planned = want.us - last_us[axis];
+    if (seen[axis] && planned > 0 && planned < STEP_JITTER_MAX_GAP * 1000) {
+      const int32_t error = (int32_t)(fire - last_fire[axis]) - (int32_t)planned;
+      NOLESS(want_max[axis], (uint32_t)ABS(error));
+      want_sum[axis] += ABS(error);
+      want_samples[axis]++;
+    }
+    seen[axis] = true;
+    last_fire[axis] = fire;
+    last_us[axis] = want.us;
+  }
+  CHECK_EQ(n, reference.size());
+
+  LOOP_L_N(i, AXIS_SIZE) {
+    CHECK_EQ(jitter.samples[i], want_samples[i]);
+    CHECK_EQ(jitter.max_us[i], want_max[i]);
+    CHECK_EQ(jitter.sum_us[i], want_sum[i]);
+    printf("%s: axis %d, %u steps, jitter max %u us, mean %.2f us\n", name, (int)i, (uint32_t)steps[i].size(),
+           jitter.max_us[i], jitter.samples[i] ? (double)jitter.sum_us[i] / jitter.samples[i] : 0.0);
+  }
+}
+
+void test_main() {
+  srand(1);
+
+  // Every axis on its own
+  LOOP_L_N(i, AXIS_SIZE) steps[i].clear();
+  make_axis(X_AXIS, 2000, 20000);
+  make_axis(Y_AXIS, 1000, 16000);
+  make_axis(Z_AXIS, 100, 1600);
+  make_axis(E_AXIS, 500, 5000);
+  run_schedule("independent");
+
+  // A 45 degree move, X and Y step at the same times, then Y goes its own way
+  LOOP_L_N(i, AXIS_SIZE) steps[i].clear();
+  make_axis(X_AXIS, 2000, 20000);
+  for (size_t n = 0; n < steps[X_AXIS].size() && steps[X_AXIS][n].us < SCHEDULE_US / 2; n++) {
+    steps[Y_AXIS].push_back({ steps[X_AXIS][n].us, Y_AXIS });
+  }
+  make_axis(Y_AXIS, 1000, 16000, SCHEDULE_US / 2);
+  make_axis(E_AXIS, 500, 5000);
+  run_schedule("diagonal");
+
+  // An axis without steps is never picked
+  Axis axes[AXIS_SIZE];
+  time_double_t time;
+  CHECK_EQ(nextStepAxis(axes, AXIS_SIZE, time), -1);
+}
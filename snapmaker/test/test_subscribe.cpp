@@ -0,0 +1,210 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The deadline scheduler of the subscribe task, driven pass by pass with the
+// clock jumping to the wait each pass returns. Every report runs at its
+// deadline and in deadline order, a wakeup always has something to run,
+// subscriptions of one period share their wakeups, and a callback that
+// unsubscribes itself or another one neither loses nor repeats a report
+
+#include "test.h"
+#include <map>
+#include <set>
+#include <vector>
+#include "src/inc/MarlinConfig.h"
+#include "snapmaker/event/subscribe.h"
+
+#define SUB_SET 0x01
+#define SUB_ID_COUNT 8
+
+typedef struct {
+  uint8_t id;
+  uint32_t ms;
+} report_t;
+
+static std::vector<report_t> reports;
+static uint32_t id_reports[SUB_ID_COUNT];
+static bool live[SUB_ID_COUNT];
+static uint32_t passes, empty_passes;
+
+// At its at-th report, id unsubscribes target
+typedef struct {
+  uint8_t id, at, target;
+} unsubscribe_t;
+static std::vector<unsubscribe_t> unsubscribes;
+
+static ErrCode sub_disable(uint8_t id);
+
+static ErrCode report_cb(event_param_t &event) {
+  uint8_t id = event.info.command_id;
+  reports.push_back({ id, millis() });
+  id_reports[id]++;
+  for (const unsubscribe_t &u : unsubscribes) {
+    if (u.id == id && u.at == id_reports[id]) {
+      CHECK_EQ(sub_disable(u.target), E_SUCCESS);
+    }
+  }
+  return E_SUCCESS;
+}
+
+static event_cb_info_t report_info = { 0, EVENT_CB_TASK_RUN, report_cb };
+event_cb_info_t * get_event_info(uint8_t cmd_set, uint8_t cmd_id) {
+  return cmd_set == SUB_SET && cmd_id < SUB_ID_COUNT ? &report_info : NULL;
+}
+
+static event_param_t request(uint8_t *data, uint16_t length) {
+  event_param_t event = {};
+  event.info.recever_id = 0x02;
+  event.source = EVENT_SOURCE_HMI;
+  event.data = data;
+  event.length = length;
+  return event;
+}
+
+static ErrCode sub_enable(uint8_t id, uint16_t period) {
+  uint8_t data[4] = { SUB_SET, id, (uint8_t)period, (uint8_t)(period >> 8) };
+  event_param_t event = request(data, sizeof(data));
+  live[id] = true;
+  return subscribe.enable(event);
+}
+
+static ErrCode sub_disable(uint8_t id) {
+  uint8_t data[2] = { SUB_SET, id };
+  event_param_t event = request(data, sizeof(data));
+  live[id] = false;
+  return subscribe.disable(event);
+}
+
+// What loop_task does, with a clock that jumps to the next deadline. The
+// first pass is the one enable() wakes the task up for
+static void run_until(uint32_t end_ms) {
+  for (bool notified = true; PENDING(millis(), end_ms); notified = false) {
+    size_t before = reports.size();
+    uint32_t wait_ms = subscribe.run_due(millis());
+    if (!notified) {
+      passes++;
+      if (reports.size() == before) empty_passes++;
+    }
+    host_millis += _MIN(wait_ms, end_ms - millis());
+  }
+}
+
+static void reset() {
+  for (uint8_t id = 0; id < SUB_ID_COUNT; id++) {
+    if (live[id]) sub_disable(id);
+  }
+  reports.clear();
+  unsubscribes.clear();
+  memset(id_reports, 0, sizeof(id_reports));
+  passes = empty_passes = 0;
+}
+
+// Reports of id come exactly period apart, once per deadline
+static void check_period(uint8_t id, uint16_t period, uint32_t &first, uint32_t &last, uint32_t &count) {
+  count = 0;
+  for (const report_t &r : reports) {
+    if (r.id != id) continue;
+    if (count) CHECK_EQ(r.ms - last, period);
+    else first = r.ms;
+    last = r.ms;
+    count++;
+  }
+}
+
+static void check_deadlines() {
+  reset();
+  CHECK_EQ(subscribe.run_due(millis()), SUBSCRIBE_IDLE_WAIT_MS);
+
+  const uint32_t start = millis();
+  CHECK_EQ(sub_enable(1, 100), E_SUCCESS);
+  CHECK_EQ(sub_enable(2, 250), E_SUCCESS);
+  run_until(start + 37);
+  CHECK_EQ(sub_enable(3, 100), E_SUCCESS);
+  run_until(start + 1013);
+  CHECK_EQ(sub_enable(4, 250), E_SUCCESS);
+  CHECK_EQ(sub_enable(5, 30), E_SUCCESS);
+  // Below the shortest period
+  CHECK_EQ(sub_enable(6, 3), E_SUCCESS);
+  run_until(start + 11000);
+
+  // In deadline order, and no wakeup without a report
+  for (size_t i = 1; i < reports.size(); i++) CHECK(!PENDING(reports[i].ms, reports[i - 1].ms));
+  CHECK_EQ(empty_passes, 0);
+
+  uint32_t first[SUB_ID_COUNT], last[SUB_ID_COUNT], count[SUB_ID_COUNT];
+  const uint16_t period[SUB_ID_COUNT] = { 0, 100, 250, 100, 250, 30, SUBSCRIBE_MIN_INTERVAL_MS };
+  for (uint8_t id = 1; id <= 6; id++) check_period(id, period[id], first[id], last[id], count[id]);
+  CHECK_EQ(first[1], start);
+  CHECK_EQ(first[2], start);
+  CHECK_EQ(count[1], 110);
+  CHECK_EQ(count[2], 44);
+  // A later subscription of the same period joins the earlier one's wakeup
+  CHECK_EQ(first[3], start + 100);
+  CHECK_EQ(first[4], start + 1250);
+  CHECK_EQ(first[5], start + 1013);
+  CHECK_EQ(first[6], start + 1013);
+
+  // One wakeup per deadline, start and 1013 ran in the pass enable() gave
+  std::set<uint32_t> deadlines;
+  for (const report_t &r : reports) deadlines.insert(r.ms);
+  CHECK_EQ(passes + 2, deadlines.size());
+  printf("deadlines: %u reports in %u wakeups over %u ms\n", (uint32_t)reports.size(), passes, millis() - start);
+}
+
+static void check_unsubscribe() {
+  reset();
+  const uint32_t start = millis();
+  for (uint8_t id = 1; id <= 7; id++) CHECK_EQ(sub_enable(id, 50), E_SUCCESS);
+
+  // Itself, a later slot, the last slot and an earlier slot, which moves a
+  // subscription not run yet in this pass in front of the one running
+  unsubscribes.push_back({ 2, 3, 2 });
+  unsubscribes.push_back({ 3, 5, 6 });
+  unsubscribes.push_back({ 1, 6, 7 });
+  unsubscribes.push_back({ 5, 8, 1 });
+  run_until(start + 1000);
+
+  std::map<uint32_t, std::set<uint8_t> > by_ms;
+  for (const report_t &r : reports) {
+    // Never twice at a deadline
+    CHECK(!by_ms[r.ms].count(r.id));
+    by_ms[r.ms].insert(r.id);
+  }
+  CHECK_EQ(by_ms.size(), 20);
+
+  // Until its unsubscribe every subscription reports at every deadline. 6
+  // and 7 run after the one removing them and miss that deadline already
+  const uint32_t until[8] = { 0, 8, 3, 20, 20, 20, 4, 5 };
+  for (uint8_t id = 1; id <= 7; id++) {
+    CHECK_EQ(id_reports[id], until[id]);
+    uint32_t first, last, count;
+    check_period(id, 50, first, last, count);
+    CHECK_EQ(first, start);
+  }
+  CHECK_EQ(live[1] + live[2] + live[6] + live[7], 0);
+}
+
+void test_main() {
+  subscribe.init();
+  host_millis = 5000;
+  check_deadlines();
+  check_unsubscribe();
+}
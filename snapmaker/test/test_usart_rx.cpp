@@ -0,0 +1,258 @@
+/*
+ * Snapmaker 3D Printer Firmware
+ * Copyright (C) 2023 Snapmaker [https://github.com/Snapmaker]
+ *
+ * This file is part of SnapmakerController-IDEX
+ * (see https://github.com/Snapmaker/SnapmakerController-IDEX)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The SACP receive path: the libmaple USART IRQ, its RX ring and idle line
+// notify, run against a model of the USART at 115200 baud and of the SACP recv
+// task. A burst of frames must reach the task one character time after its
+// last byte, where the task used to poll every 5ms, and a quiet line must not
+// wake the task
+
+#include "test.h"
+#include <stdlib.h>
+#include <vector>
+#include <libmaple/usart.h>  // with usart_private.h, by host/libmaple.h
+
+#define BAUDRATE 115200
+#define BYTE_US (10 * 1000000 / BAUDRATE)  // 8N1, IDLE follows a character time after the last
+#define WAKE_US 5                           // from the IRQ to the task running
+#define POLL_US 5000                        // recv_task() timeout while bytes keep coming
+#define RECV_BUF 64                         // what recv_task() reads at a time
+
+static usart_reg_map regs;
+static ring_buffer rx_rb, tx_rb;
+static usart_dev dev;
+
+// vTaskNotifyGiveFromISR()
+static uint32_t notify_value, notify_calls;
+static void notify() {
+  notify_value++;
+  notify_calls++;
+}
+
+// The USART raises its IRQ for an enabled flag, the IRQ reads SR then DR and
+// that clears RXNE and IDLE
+static void isr() {
+  const uint32_t sr = regs.SR;
+  if (!((sr & USART_SR_RXNE) && (regs.CR1 & USART_CR1_RXNEIE)) &&
+      !((sr & USART_SR_IDLE) && (regs.CR1 & USART_CR1_IDLEIE))) {
+    return;
+  }
+  usart_irq(dev.rb, dev.wb, dev.regs, dev.rx_notify, dev.tx_pull);
+  regs.SR &= ~(USART_SR_RXNE | USART_SR_IDLE);
+}
+
+static void setup(voidFuncPtr fn) {
+  static uint8 tx_buf[USART_TX_BUF_SIZE];
+  regs = usart_reg_map();
+  regs.CR1 = USART_CR1_UE | USART_CR1_RE | USART_CR1_TE | USART_CR1_RXNEIE;
+  rb_init(&rx_rb, USART_RX_BUF_SIZE, dev.rx_buf);
+  rb_init(&tx_rb, USART_TX_BUF_SIZE, tx_buf);
+  dev.regs = &regs;
+  dev.rb = &rx_rb;
+  dev.wb = &tx_rb;
+  dev.tx_pull = NULL;
+  usart_set_rx_notify(&dev, fn);
+  notify_value = notify_calls = 0;
+}
+
+static uint8_t stream_byte(uint32_t n) {
+  return (uint8_t)(n * 7 + (n >> 8));
+}
+
+typedef struct {
+  uint32_t frames, bytes;
+  uint32_t wakeups, timeouts;
+  uint32_t quiet_wakeups;    // while the line is quiet after the last frame
+  uint32_t latency_max_us;   // from the last byte of a frame to the task
+  double latency_sum_us;
+  uint32_t idle_max_us;      // from the last byte of a burst to the task
+  uint32_t lost;
+} recv_t;
+
+// Sends the frames with the gaps between them and runs recv_task() on what
+// comes in. frames[i] bytes follow gaps[i] us of a quiet line. With notify set
+// the task waits POLL_US after a pass that got data and for a notify only
+// after one that did not, without it polls every POLL_US as it used to
+static void run(recv_t &r, const std::vector<uint32_t> &frames, const std::vector<uint32_t> &gaps, bool notified) {
+  r = recv_t();
+  std::vector<uint32_t> frame_end;  // stream index of each frame's last byte
+  std::vector<uint32_t> frame_rx_us;  // when the USART took it
+  std::vector<uint32_t> burst_last;   // the last frame of the burst each frame is in
+  uint32_t total = 0;
+  for (uint32_t len : frames) frame_end.push_back(total += len);
+  for (size_t i = frames.size(); i--;) {
+    burst_last.insert(burst_last.begin(), i + 1 < frames.size() && !gaps[i + 1] ? burst_last.front() : i);
+  }
+
+  uint32_t sent = 0, next_frame = 0, frame_left = 0, gap_left = gaps[0];
+  uint32_t next_byte_us = 0, idle_us = UINT32_MAX;
+  uint32_t received = 0, done_frame = 0;
+  bool blocked = false, timed = false;
+  uint32_t wake_us = 0, deadline_us = 0;
+
+  uint32_t now = 0;
+  for (; received < total || !blocked; now++) {
+    // The line: a byte every BYTE_US within a frame, IDLE one character later
+    if (sent < total && now >= next_byte_us) {
+      if (!frame_left && gap_left) {
+        next_byte_us = now + gap_left;
+        gap_left = 0;
+      } else {
+        if (!frame_left) frame_left = frames[next_frame];
+        regs.DR = stream_byte(sent++);
+        regs.SR |= USART_SR_RXNE;
+        isr();
+        next_byte_us = idle_us = now + BYTE_US;
+        if (!--frame_left) {
+          frame_rx_us.push_back(now);
+          if (++next_frame < frames.size()) gap_left = gaps[next_frame];
+        }
+      }
+    }
+    // A byte that follows at once moved idle_us on
+    if (now == idle_us) {
+      regs.SR |= USART_SR_IDLE;
+      isr();
+    }
+
+    // recv_task(): read until the ring is empty, then ulTaskNotifyTake()
+    if (blocked) {
+      if (notify_value) {
+        notify_value = 0;
+        blocked = false;
+        wake_us = now + WAKE_US;
+        r.wakeups++;
+      } else if (timed && now >= deadline_us) {
+        blocked = false;
+        wake_us = now;
+        r.wakeups++;
+        r.timeouts++;
+      }
+    }
+    if (!blocked && now >= wake_us) {
+      uint8 buf[RECV_BUF];
+      uint32_t len;
+      bool got_data = false;
+      while ((len = usart_rx(&dev, buf, sizeof(buf)))) {
+        got_data = true;
+        for (uint32_t i = 0; i < len; i++) {
+          if (buf[i] != stream_byte(received)) r.lost++;
+          received++;
+        }
+        while (done_frame < frame_end.size() && received >= frame_end[done_frame]) {
+          const uint32_t latency = now - frame_rx_us[done_frame];
+          if (latency > r.latency_max_us) r.latency_max_us = latency;
+          // Read within a burst by a timeout, or once the burst is over
+          const uint32_t last = burst_last[done_frame];
+          if (last < frame_rx_us.size() && now - frame_rx_us[last] > r.idle_max_us) {
+            r.idle_max_us = now - frame_rx_us[last];
+          }
+          r.latency_sum_us += latency;
+          r.frames++;
+          done_frame++;
+        }
+      }
+      if (notify_value) {
+        notify_value = 0;  // ulTaskNotifyTake() returns at once
+      } else {
+        blocked = true;
+        timed = got_data || !notified;
+        deadline_us = now + POLL_US;
+      }
+    }
+    if (now > 600000000) {
+      CHECK(!"receive stalled");
+      break;
+    }
+  }
+  r.bytes = received;
+  // Then the line stays quiet, the task reads nothing on each wakeup
+  for (const uint32_t end = now + 100 * POLL_US; now < end; now++) {
+    if (notify_value || (timed && now >= deadline_us)) {
+      notify_value = 0;
+      r.quiet_wakeups++;
+      timed = !notified;
+      deadline_us = now + POLL_US;
+    }
+  }
+}
+
+static void print(const char *name, const recv_t &r) {
+  printf("%s: %u frames, %u bytes, latency mean %.0f us, max %u us, %u us after a burst\n", name, r.frames, r.bytes,
+         r.frames ? r.latency_sum_us / r.frames : 0.0, r.latency_max_us, r.idle_max_us);
+  printf("%s: %u wakeups, %u of them timeouts, %u wakeups in %u ms of quiet line\n", name, r.wakeups, r.timeouts,
+         r.quiet_wakeups, 100 * POLL_US / 1000);
+}
+
+void test_main() {
+  srand(1);
+
+  // SACP frames with quiet gaps, a few back to back
+  std::vector<uint32_t> frames, gaps;
+  uint32_t bursts = 0;
+  for (int i = 0; i < 2000; i++) {
+    frames.push_back(8 + rand() % 300);
+    const uint32_t gap = rand() % 4 ? 200 + rand() % 30000 : 0;
+    gaps.push_back(gap);
+    if (gap || !i) bursts++;
+  }
+
+  // Woken by the idle line, one character time after the last byte
+  recv_t notified;
+  setup(notify);
+  CHECK(regs.CR1 & USART_CR1_IDLEIE);
+  run(notified, frames, gaps, true);
+  print("idle notify", notified);
+  CHECK_EQ(notified.lost, 0);
+  CHECK_EQ(notified.frames, frames.size());
+  CHECK(notify_calls >= bursts);
+  CHECK(notified.idle_max_us <= BYTE_US + WAKE_US);
+  // Inside a burst the bytes waiting or the timeout wake it, as soon as a poll would
+  CHECK(notified.latency_max_us <= POLL_US + WAKE_US);
+  // A quiet line lets it sleep, at most the timeout after the last byte
+  CHECK(notified.quiet_wakeups <= 1);
+
+  // Without the hook, as recv_task() was: polled every 5ms
+  recv_t polled;
+  setup(NULL);
+  CHECK(!(regs.CR1 & USART_CR1_IDLEIE));
+  run(polled, frames, gaps, false);
+  print("5ms poll", polled);
+  CHECK_EQ(polled.lost, 0);
+  CHECK_EQ(polled.frames, frames.size());
+  CHECK_EQ(notify_calls, 0);
+  CHECK(polled.idle_max_us > POLL_US / 2);
+  CHECK(polled.quiet_wakeups >= 99);
+  CHECK(notified.latency_sum_us < polled.latency_sum_us / 2);
+
+  // A burst longer than the ring never goes idle, the bytes waiting wake the task
+  recv_t burst;
+  setup(notify);
+  run(burst, std::vector<uint32_t>(1, 4 * USART_RX_BUF_SIZE), std::vector<uint32_t>(1, 0), true);
+  print("long burst", burst);
+  CHECK_EQ(burst.lost, 0);
+  CHECK_EQ(burst.bytes, 4 * USART_RX_BUF_SIZE);
+  CHECK(notify_calls >= 1);
+
+  // Turning the hook off stops the IDLE interrupt too
+  usart_set_rx_notify(&dev, NULL);
+  CHECK(!(regs.CR1 & USART_CR1_IDLEIE));
+}